@@ -0,0 +1,65 @@
+BITS 16
+GLOBAL ap_trampoline_start
+GLOBAL ap_trampoline_params
+GLOBAL ap_trampoline_end
+
+; Copied to AP_TRAMPOLINE_BASE and entered in real mode by the start-up IPI.
+; Switches to flat protected mode with paging on the kernel's page
+; directory, then calls entry(cpu) on the stack from the parameter block,
+; which the BSP fills before each start-up.
+%define BASE 0x8000
+%define REL(x) (BASE + (x) - ap_trampoline_start)
+
+SECTION .text
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [REL(tramp_gdtr)]
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+    jmp dword 0x08:REL(tramp_pm)
+
+BITS 32
+tramp_pm:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    mov eax, [REL(tramp_cr3)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80010000     ; PG | WP, as on the BSP
+    mov cr0, eax
+
+    mov esp, [REL(tramp_stack)]
+    push dword [REL(tramp_cpu)]
+    mov eax, [REL(tramp_entry)]
+    call eax
+
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+align 8
+tramp_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF  ; 0x08 code
+    dq 0x00CF92000000FFFF  ; 0x10 data
+tramp_gdtr:
+    dw 3 * 8 - 1
+    dd REL(tramp_gdt)
+
+align 4
+ap_trampoline_params:
+tramp_cr3:   dd 0
+tramp_stack: dd 0
+tramp_entry: dd 0
+tramp_cpu:   dd 0
+ap_trampoline_end:
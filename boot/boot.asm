@@ -11,6 +11,16 @@ mb2_header_start:
     dd mb2_header_end - mb2_header_start
     dd -(0xE85250D6 + 0 + (mb2_header_end - mb2_header_start))
 
+    ; framebuffer tag: 1024x768x32 linear framebuffer, optional (the
+    ; console falls back to VGA text if the loader cannot set it)
+    dw 5
+    dw 1
+    dd 20
+    dd 1024
+    dd 768
+    dd 32
+    align 8, db 0
+
     ; end tag
     dw 0
     dw 0
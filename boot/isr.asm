@@ -3,13 +3,20 @@ GLOBAL idt_load
 GLOBAL isr_default_stub
 GLOBAL irq1_keyboard_stub
 GLOBAL irq0_timer_stub
+GLOBAL irq4_serial_stub
 GLOBAL isr_stub_table
 GLOBAL syscall_stub
+GLOBAL sysenter_stub
+GLOBAL lapic_timer_stub
+GLOBAL isr_spurious_stub
+GLOBAL lapic_wake_stub
+GLOBAL irq_apic_stubs
 
 EXTERN isr_default_handler_c
 EXTERN isr_exception_handler_c
 EXTERN irq_handler_c
 EXTERN syscall_handler_c
+EXTERN sysenter_handler_c
 
 idt_load:
     mov eax, [esp + 4]
@@ -29,29 +36,53 @@ isr%1_stub:
     jmp isr_common
 %endmacro
 
+; Entries from ring 3 arrive with user data segments loaded.
+%macro SAVE_SEGS 0
+    push ds
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+%endmacro
+
+%macro RESTORE_SEGS 0
+    pop eax
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+%endmacro
+
 isr_common:
     pusha
+    SAVE_SEGS
     push esp
     call isr_exception_handler_c
     add esp, 4
+    RESTORE_SEGS
     popa
     add esp, 8
     iretd
 
 irq_common:
     pusha
+    SAVE_SEGS
     push esp
     call irq_handler_c
     add esp, 4
+    RESTORE_SEGS
     popa
     add esp, 8
     iretd
 
 syscall_common:
     pusha
+    SAVE_SEGS
     push esp
     call syscall_handler_c
     add esp, 4
+    RESTORE_SEGS
     popa
     add esp, 8
     iretd
@@ -72,11 +103,74 @@ irq1_keyboard_stub:
     push dword 33
     jmp irq_common
 
+irq4_serial_stub:
+    push dword 0
+    push dword 36
+    jmp irq_common
+
 syscall_stub:
     push dword 0
     push dword 128
     jmp syscall_common
 
+; SYSENTER entry: eax = number, ebx/esi/edi = arguments, ecx = user esp,
+; edx = user return eip; the result comes back in eax. The SYSENTER_ESP
+; MSR points at this CPU's TSS esp0 slot, so the first load switches to the
+; current task's kernel stack. Interrupts stay off in the kernel, as they
+; do behind the int 0x80 gate; sti takes effect after sysexit.
+sysenter_stub:
+    mov esp, [esp]
+    push ecx
+    push edx
+    push ds
+    mov cx, 0x10
+    mov ds, cx
+    mov es, cx
+    mov fs, cx
+    mov gs, cx
+    push edi
+    push esi
+    push ebx
+    push eax
+    call sysenter_handler_c
+    add esp, 16
+    pop edx
+    mov ds, dx
+    mov es, dx
+    mov fs, dx
+    mov gs, dx
+    pop edx
+    pop ecx
+    sti
+    sysexit
+
+lapic_timer_stub:
+    push dword 0
+    push dword 0x30
+    jmp irq_common
+
+lapic_wake_stub:
+    push dword 0
+    push dword 0x31
+    jmp irq_common
+
+; I/O APIC routed IRQs: vectors 0x40-0x6F (IRQ_VECTOR_BASE, three
+; priority classes of 16 ISA IRQs), one 16-byte stub per vector.
+align 16
+irq_apic_stubs:
+%assign v 0x40
+%rep 48
+    push dword 0
+    push dword v
+    jmp irq_common
+    align 16
+%assign v v + 1
+%endrep
+
+; Spurious local APIC interrupts take no EOI.
+isr_spurious_stub:
+    iretd
+
 ISR_NOERR 0
 ISR_NOERR 1
 ISR_NOERR 2
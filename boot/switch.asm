@@ -0,0 +1,35 @@
+BITS 32
+GLOBAL ctx_switch
+GLOBAL proc_enter_user
+EXTERN proc_switch_done
+
+; void ctx_switch(uint32_t* save_esp, uint32_t next_esp)
+; Saves the callee-saved registers and flags on the current stack, stores
+; the stack pointer in *save_esp and resumes the context saved at next_esp.
+ctx_switch:
+    mov eax, [esp + 4]
+    mov edx, [esp + 8]
+    push ebp
+    push ebx
+    push esi
+    push edi
+    pushfd
+    mov [eax], esp
+    mov esp, edx
+    popfd
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; First return target of a new process's kernel stack: the iret frame
+; (eip, cs, eflags, esp, ss) is already on the stack.
+proc_enter_user:
+    call proc_switch_done
+    mov ax, 0x23
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    iretd
@@ -3,5 +3,10 @@ GLOBAL _start
 
 SECTION .text
 _start:
-    mov eax, 99
+    ; Absolute reference: needs an R_386_RELATIVE fixup at load time.
+    mov eax, [answer]
     ret
+
+SECTION .data
+answer:
+    dd 99
@@ -0,0 +1,205 @@
+BITS 32
+GLOBAL _start
+
+; Round-trip cost of a trivial syscall (SYS_GET_TICKS) through the int 0x80
+; gate and through SYSENTER/SYSEXIT, in TSC cycles per call, the cost per
+; operation of NOPs submitted RING_BATCH at a time through a syscall ring,
+; and the cost of reading the clock from the time page without a trap.
+SYS_WRITE      equ 1
+SYS_GET_TICKS  equ 3
+SYS_FEATURES   equ 5
+SYS_RING_SETUP equ 6
+SYS_RING_ENTER equ 7
+FEAT_SYSENTER  equ 1
+ITERATIONS     equ 102400
+
+; Shared ring page layout (kernel/ring.h).
+RING_SQ_TAIL   equ 0x004
+RING_CQ_HEAD   equ 0x008
+RING_CQ_TAIL   equ 0x00C
+RING_SQ        equ 0x020
+RING_ENTRIES   equ 64
+RING_SQE_SHIFT equ 5
+RING_SQE_DATA  equ 20
+RING_OP_NOP    equ 0
+RING_BATCH     equ 64
+
+SECTION .text
+_start:
+    push ebx
+    push esi
+    push edi
+    push ebp
+
+    mov esi, msg_int80
+    call print_str
+    rdtsc
+    mov edi, eax
+    mov ebp, ITERATIONS
+.int80_loop:
+    mov eax, SYS_GET_TICKS
+    int 0x80
+    dec ebp
+    jnz .int80_loop
+    call print_cycles
+
+    mov eax, SYS_FEATURES
+    int 0x80
+    test eax, FEAT_SYSENTER
+    jz .no_sysenter
+
+    mov esi, msg_sysenter
+    call print_str
+    rdtsc
+    mov edi, eax
+    mov ebp, ITERATIONS
+.sysenter_loop:
+    mov eax, SYS_GET_TICKS
+    call sys_fast
+    dec ebp
+    jnz .sysenter_loop
+    call print_cycles
+    jmp .ring
+
+.no_sysenter:
+    mov esi, msg_none
+    call print_str
+
+.ring:
+    mov eax, SYS_RING_SETUP
+    xor ebx, ebx
+    int 0x80
+    cmp eax, -1
+    je .vdso
+    mov [ring], eax
+
+    mov esi, msg_ring
+    call print_str
+    rdtsc
+    mov edi, eax
+    mov ebp, ITERATIONS / RING_BATCH
+.ring_loop:
+    mov ebx, [ring]
+    mov edx, [ebx + RING_SQ_TAIL]
+    mov ecx, RING_BATCH
+.fill:
+    mov eax, edx
+    and eax, RING_ENTRIES - 1
+    shl eax, RING_SQE_SHIFT
+    mov dword [ebx + RING_SQ + eax], RING_OP_NOP
+    mov [ebx + RING_SQ + eax + RING_SQE_DATA], edx
+    inc edx
+    dec ecx
+    jnz .fill
+    mov [ebx + RING_SQ_TAIL], edx
+
+    mov eax, SYS_RING_ENTER
+    mov ebx, RING_BATCH
+    mov ecx, RING_BATCH
+    int 0x80
+
+    ; Every NOP has completed; consume the whole CQ.
+    mov ebx, [ring]
+    mov eax, [ebx + RING_CQ_TAIL]
+    mov [ebx + RING_CQ_HEAD], eax
+    dec ebp
+    jnz .ring_loop
+    call print_cycles
+
+.vdso:
+    mov eax, SYS_FEATURES
+    int 0x80
+    test eax, FEAT_VDSO
+    jz .done
+
+    mov esi, msg_vdso
+    call print_str
+    rdtsc
+    mov edi, eax
+    mov ebp, ITERATIONS
+.vdso_loop:
+    call vdso_time_us
+    dec ebp
+    jnz .vdso_loop
+    call print_cycles
+
+.done:
+    xor eax, eax
+    pop ebp
+    pop edi
+    pop esi
+    pop ebx
+    ret
+
+; User-side SYSENTER stub: eax = number, ebx/esi/edi = arguments, result in
+; eax. The kernel returns to edx with esp = ecx; both are clobbered, so they
+; are saved here.
+sys_fast:
+    push ecx
+    push edx
+    mov ecx, esp
+    mov edx, .back
+    sysenter
+.back:
+    pop edx
+    pop ecx
+    ret
+
+%include "vdso.inc"
+
+; Prints (rdtsc - edi) / ITERATIONS and a newline.
+print_cycles:
+    rdtsc
+    sub eax, edi
+    xor edx, edx
+    mov ecx, ITERATIONS
+    div ecx
+    call print_u32
+    mov esi, msg_nl
+    jmp print_str
+
+; Prints eax in decimal.
+print_u32:
+    mov edi, numbuf_end
+    mov ecx, 10
+.digit:
+    xor edx, edx
+    div ecx
+    add dl, '0'
+    dec edi
+    mov [edi], dl
+    test eax, eax
+    jnz .digit
+    mov ebx, edi
+    mov ecx, numbuf_end
+    sub ecx, edi
+    mov eax, SYS_WRITE
+    int 0x80
+    ret
+
+; Prints the NUL-terminated string at esi.
+print_str:
+    mov ebx, esi
+    xor ecx, ecx
+.len:
+    cmp byte [esi + ecx], 0
+    je .write
+    inc ecx
+    jmp .len
+.write:
+    mov eax, SYS_WRITE
+    int 0x80
+    ret
+
+SECTION .data
+msg_int80:    db "int 0x80 cycles/call=", 0
+msg_sysenter: db "sysenter cycles/call=", 0
+msg_none:     db "sysenter not available", 10, 0
+msg_ring:     db "ring nop cycles/op=", 0
+msg_vdso:     db "vdso time cycles/call=", 0
+msg_nl:       db 10, 0
+
+SECTION .bss
+ring:         resd 1
+numbuf:       resb 12
+numbuf_end:
@@ -0,0 +1,176 @@
+#include <stdint.h>
+#include "acpi.h"
+#include "mb2.h"
+#include "console.h"
+
+// Tables are parsed once, before paging is enabled, while every physical
+// address is still directly reachable; only the digest in g_madt is kept.
+typedef struct {
+    char sig[8];
+    uint8_t checksum;
+    char oem[6];
+    uint8_t revision;
+    uint32_t rsdt;
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct {
+    char sig[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem[6];
+    char oem_table[8];
+    uint32_t oem_revision;
+    uint32_t creator;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_t;
+
+typedef struct {
+    acpi_sdt_t h;
+    uint32_t lapic_addr;
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_hdr_t;
+
+#define MADT_LAPIC     0
+#define MADT_IOAPIC    1
+#define MADT_OVERRIDE  2
+
+static acpi_madt_t g_madt;
+static int g_have_madt = 0;
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+static int checksum_ok(const void* p, uint32_t len) {
+    const uint8_t* b = (const uint8_t*)p;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) sum = (uint8_t)(sum + b[i]);
+    return sum == 0;
+}
+
+static int sig_is(const char* sig, const char* want, int n) {
+    for (int i = 0; i < n; i++) {
+        if (sig[i] != want[i]) return 0;
+    }
+    return 1;
+}
+
+static const acpi_rsdp_t* scan_rsdp(uint32_t start, uint32_t end) {
+    for (uint32_t a = start; a + sizeof(acpi_rsdp_t) <= end; a += 16) {
+        const acpi_rsdp_t* r = (const acpi_rsdp_t*)a;
+        if (sig_is(r->sig, "RSD PTR ", 8) && checksum_ok(r, sizeof(acpi_rsdp_t))) return r;
+    }
+    return 0;
+}
+
+// GRUB hands over a copy of the RSDP; otherwise search the EBDA and the
+// BIOS area as the ACPI spec describes.
+static const acpi_rsdp_t* find_rsdp(uint32_t mb2_info_addr) {
+    const mb2_tag_t* tag = mb2_find_tag(mb2_info_addr, MB2_TAG_ACPI_NEW);
+    if (!tag) tag = mb2_find_tag(mb2_info_addr, MB2_TAG_ACPI_OLD);
+    if (tag && tag->size >= sizeof(mb2_tag_t) + sizeof(acpi_rsdp_t)) {
+        const acpi_rsdp_t* r = (const acpi_rsdp_t*)((uint32_t)tag + sizeof(mb2_tag_t));
+        if (checksum_ok(r, sizeof(acpi_rsdp_t))) return r;
+    }
+
+    // BDA word 0x40E holds the EBDA segment. The empty asm hides the
+    // constant address from GCC, which would otherwise flag it as null+offset.
+    uint32_t bda_ebda = 0x40E;
+    __asm__("" : "+r"(bda_ebda));
+    uint32_t ebda = (uint32_t)*(const uint16_t*)bda_ebda << 4;
+    const acpi_rsdp_t* r = 0;
+    if (ebda >= 0x80000 && ebda < 0xA0000) r = scan_rsdp(ebda, ebda + 1024);
+    if (!r) r = scan_rsdp(0xE0000, 0x100000);
+    return r;
+}
+
+static void parse_madt(const acpi_madt_hdr_t* m) {
+    g_madt.lapic_addr = m->lapic_addr;
+    g_madt.pcat_compat = (m->flags & 1) != 0;
+    g_madt.cpu_count = 0;
+    g_madt.ioapic_count = 0;
+    g_madt.override_count = 0;
+
+    const uint8_t* p = (const uint8_t*)(m + 1);
+    const uint8_t* end = (const uint8_t*)m + m->h.length;
+    while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end) {
+        switch (p[0]) {
+        case MADT_LAPIC:
+            // acpi id, apic id, flags: enabled (bit 0) or online capable (bit 1)
+            if (p[1] >= 8 && (*(const uint32_t*)(p + 4) & 3) && g_madt.cpu_count < ACPI_MAX_CPUS) {
+                g_madt.cpu_apic_id[g_madt.cpu_count++] = p[3];
+            }
+            break;
+        case MADT_IOAPIC:
+            if (p[1] >= 12 && g_madt.ioapic_count < ACPI_MAX_IOAPICS) {
+                acpi_ioapic_t* io = &g_madt.ioapic[g_madt.ioapic_count++];
+                io->id = p[2];
+                io->addr = *(const uint32_t*)(p + 4);
+                io->gsi_base = *(const uint32_t*)(p + 8);
+            }
+            break;
+        case MADT_OVERRIDE:
+            if (p[1] >= 10 && g_madt.override_count < ACPI_MAX_OVERRIDES) {
+                acpi_override_t* o = &g_madt.override[g_madt.override_count++];
+                o->irq = p[3];
+                o->gsi = *(const uint32_t*)(p + 4);
+                o->flags = *(const uint16_t*)(p + 8);
+            }
+            break;
+        default:
+            break;
+        }
+        p += p[1];
+    }
+}
+
+// Must run before vmm_init(): the tables usually sit above the identity map.
+int acpi_init(uint32_t mb2_info_addr) {
+    const acpi_rsdp_t* rsdp = find_rsdp(mb2_info_addr);
+    if (!rsdp) {
+        console_puts("[acpi] no RSDP\n");
+        return -1;
+    }
+
+    const acpi_sdt_t* rsdt = (const acpi_sdt_t*)rsdp->rsdt;
+    if (!sig_is(rsdt->sig, "RSDT", 4) || !checksum_ok(rsdt, rsdt->length)) {
+        console_puts("[acpi] bad RSDT\n");
+        return -1;
+    }
+
+    const uint32_t* entries = (const uint32_t*)(rsdt + 1);
+    uint32_t n = (rsdt->length - sizeof(acpi_sdt_t)) / 4;
+    for (uint32_t i = 0; i < n; i++) {
+        const acpi_sdt_t* t = (const acpi_sdt_t*)entries[i];
+        if (!sig_is(t->sig, "APIC", 4) || !checksum_ok(t, t->length)) continue;
+
+        parse_madt((const acpi_madt_hdr_t*)t);
+        g_have_madt = 1;
+        console_puts("[acpi] MADT cpus=");
+        print_u32(g_madt.cpu_count);
+        console_puts(" ioapics=");
+        print_u32(g_madt.ioapic_count);
+        console_puts(" overrides=");
+        print_u32(g_madt.override_count);
+        console_putc('\n');
+        return 0;
+    }
+
+    console_puts("[acpi] no MADT\n");
+    return -1;
+}
+
+const acpi_madt_t* acpi_madt(void) {
+    return g_have_madt ? &g_madt : 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+
+#define ACPI_MAX_CPUS      16
+#define ACPI_MAX_IOAPICS   4
+#define ACPI_MAX_OVERRIDES 16
+
+typedef struct {
+    uint8_t id;
+    uint32_t addr;
+    uint32_t gsi_base;
+} acpi_ioapic_t;
+
+// ISA IRQ `irq` is wired to global system interrupt `gsi`; `flags` holds
+// the MPS polarity (bits 0-1) and trigger mode (bits 2-3).
+typedef struct {
+    uint8_t irq;
+    uint32_t gsi;
+    uint16_t flags;
+} acpi_override_t;
+
+// What the kernel needs from the MADT ("APIC" table).
+typedef struct {
+    uint32_t lapic_addr;
+    int pcat_compat;              // dual 8259s present as well
+    uint32_t cpu_count;
+    uint8_t cpu_apic_id[ACPI_MAX_CPUS];
+    uint32_t ioapic_count;
+    acpi_ioapic_t ioapic[ACPI_MAX_IOAPICS];
+    uint32_t override_count;
+    acpi_override_t override[ACPI_MAX_OVERRIDES];
+} acpi_madt_t;
+
+int acpi_init(uint32_t mb2_info_addr);
+const acpi_madt_t* acpi_madt(void);
@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include "ata.h"
 #include "port.h"
+#include "blkdev.h"
 
 #define ATA_IO_BASE   0x1F0
 #define ATA_CTRL_BASE 0x3F6
@@ -22,8 +23,17 @@
 
 #define ATA_CMD_IDENTIFY 0xEC
 #define ATA_CMD_READ_PIO 0x20
+#define ATA_CMD_WRITE_PIO 0x30
+#define ATA_CMD_READ_MULTIPLE 0xC4
+#define ATA_CMD_WRITE_MULTIPLE 0xC5
+#define ATA_CMD_SET_MULTIPLE 0xC6
+#define ATA_CMD_CACHE_FLUSH 0xE7
+
+#define ATA_MAX_MULTIPLE 16
 
 static int ata_ready = 0;
+static uint8_t ata_multiple = 0;
+static uint32_t ata_sectors = 0;
 
 static int ata_wait_not_busy(void) {
     for (uint32_t i = 0; i < 1000000; i++) {
@@ -79,40 +89,116 @@ int ata_init(void) {
         return drq;
     }
 
+    uint16_t max_multiple = 0;
+    uint32_t lba28_sectors = 0;
     for (int i = 0; i < 256; i++) {
-        (void)inw(ATA_REG_DATA);
+        uint16_t w = inw(ATA_REG_DATA);
+        if (i == 47) max_multiple = w & 0xFF;
+        if (i == 60) lba28_sectors = w;
+        if (i == 61) lba28_sectors |= (uint32_t)w << 16;
     }
 
     ata_ready = 1;
+    ata_multiple = 0;
+    ata_sectors = lba28_sectors;
+
+    // READ/WRITE MULTIPLE raise one DRQ per block of sectors instead of per
+    // sector; fall back to single-sector blocks if the drive refuses.
+    if (max_multiple > 1) {
+        uint8_t n = (max_multiple > ATA_MAX_MULTIPLE) ? ATA_MAX_MULTIPLE : (uint8_t)max_multiple;
+        outb(ATA_REG_HDDEVSEL, 0xA0);
+        outb(ATA_REG_SECCOUNT0, n);
+        outb(ATA_REG_COMMAND, ATA_CMD_SET_MULTIPLE);
+        if (ata_wait_not_busy() == 0 && !(inb(ATA_REG_STATUS) & (ATA_SR_ERR | ATA_SR_DF))) {
+            ata_multiple = n;
+        }
+    }
+
     return 0;
 }
 
-int ata_read28(uint32_t lba, uint8_t count, void* buf) {
+static int ata_check_status(void) {
+    if (ata_wait_not_busy() < 0) return ATA_ERR_TIMEOUT;
+
+    uint8_t st = inb(ATA_REG_STATUS);
+    if (st & ATA_SR_DF) return ATA_ERR_DF;
+    if (st & ATA_SR_ERR) return ATA_ERR_ABRT;
+    return 0;
+}
+
+// One command moves `count` sectors. `bufs` holds one pointer per sector so
+// callers can gather scattered cache blocks into a single transfer.
+static int ata_pio_xfer(uint32_t lba, uint8_t count, uint8_t* const* bufs, uint8_t* linear, int write) {
     if (!ata_ready) return ATA_ERR_NO_DRIVE;
     if (count == 0) return 0;
-    if ((lba >> 28) != 0) return ATA_ERR_IO;
+    if ((lba >> 28) != 0 || ((lba + count - 1) >> 28) != 0) return ATA_ERR_IO;
 
-    uint16_t* dst = (uint16_t*)buf;
+    if (ata_wait_not_busy() < 0) return ATA_ERR_TIMEOUT;
 
-    for (uint8_t s = 0; s < count; s++) {
-        uint32_t cur = lba + s;
-
-        if (ata_wait_not_busy() < 0) return ATA_ERR_TIMEOUT;
+    uint8_t cmd;
+    uint8_t block = 1;
+    if (ata_multiple) {
+        block = ata_multiple;
+        cmd = write ? ATA_CMD_WRITE_MULTIPLE : ATA_CMD_READ_MULTIPLE;
+    } else {
+        cmd = write ? ATA_CMD_WRITE_PIO : ATA_CMD_READ_PIO;
+    }
 
-        outb(ATA_REG_HDDEVSEL, 0xE0 | ((cur >> 24) & 0x0F));
-        outb(ATA_REG_SECCOUNT0, 1);
-        outb(ATA_REG_LBA0, (uint8_t)(cur & 0xFF));
-        outb(ATA_REG_LBA1, (uint8_t)((cur >> 8) & 0xFF));
-        outb(ATA_REG_LBA2, (uint8_t)((cur >> 16) & 0xFF));
-        outb(ATA_REG_COMMAND, ATA_CMD_READ_PIO);
+    outb(ATA_REG_HDDEVSEL, 0xE0 | ((lba >> 24) & 0x0F));
+    outb(ATA_REG_SECCOUNT0, count);
+    outb(ATA_REG_LBA0, (uint8_t)(lba & 0xFF));
+    outb(ATA_REG_LBA1, (uint8_t)((lba >> 8) & 0xFF));
+    outb(ATA_REG_LBA2, (uint8_t)((lba >> 16) & 0xFF));
+    outb(ATA_REG_COMMAND, cmd);
 
+    uint32_t s = 0;
+    while (s < count) {
         int rc = ata_wait_drq();
         if (rc < 0) return rc;
 
-        for (int i = 0; i < 256; i++) {
-            *dst++ = inw(ATA_REG_DATA);
+        for (uint8_t b = 0; b < block && s < count; b++, s++) {
+            uint16_t* p = (uint16_t*)(bufs ? bufs[s] : linear + s * 512);
+            if (write) {
+                for (int i = 0; i < 256; i++) outw(ATA_REG_DATA, p[i]);
+            } else {
+                for (int i = 0; i < 256; i++) p[i] = inw(ATA_REG_DATA);
+            }
         }
     }
 
-    return 0;
+    return write ? ata_check_status() : 0;
+}
+
+int ata_read28(uint32_t lba, uint8_t count, void* buf) {
+    return ata_pio_xfer(lba, count, 0, (uint8_t*)buf, 0);
+}
+
+int ata_write28(uint32_t lba, uint8_t count, const void* buf) {
+    return ata_pio_xfer(lba, count, 0, (uint8_t*)buf, 1);
+}
+
+int ata_write28_gather(uint32_t lba, uint8_t count, const void* const* bufs) {
+    return ata_pio_xfer(lba, count, (uint8_t* const*)bufs, 0, 1);
+}
+
+int ata_flush(void) {
+    if (!ata_ready) return ATA_ERR_NO_DRIVE;
+    if (ata_wait_not_busy() < 0) return ATA_ERR_TIMEOUT;
+
+    outb(ATA_REG_HDDEVSEL, 0xE0);
+    outb(ATA_REG_COMMAND, ATA_CMD_CACHE_FLUSH);
+    return ata_check_status();
+}
+
+const blkdev_t* ata_device(void) {
+    static blkdev_t dev;
+    if (!ata_ready) return 0;
+
+    dev.name = "ata0";
+    dev.sectors = ata_sectors;
+    dev.base = 0;
+    dev.read = ata_read28;
+    dev.write_gather = ata_write28_gather;
+    dev.flush = ata_flush;
+    return &dev;
 }
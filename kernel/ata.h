@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include "blkdev.h"
 
 #define ATA_ERR_TIMEOUT  -1
 #define ATA_ERR_NO_DRIVE -2
@@ -9,3 +10,7 @@
 
 int ata_init(void);
 int ata_read28(uint32_t lba, uint8_t count, void* buf);
+int ata_write28(uint32_t lba, uint8_t count, const void* buf);
+int ata_write28_gather(uint32_t lba, uint8_t count, const void* const* bufs);
+int ata_flush(void);
+const blkdev_t* ata_device(void);
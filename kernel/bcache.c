@@ -0,0 +1,395 @@
+#include <stdint.h>
+#include "bcache.h"
+#include "pit.h"
+#include "console.h"
+
+#define BCACHE_BLOCKS   128
+#define BCACHE_HASH     64
+#define BCACHE_MAX_RUN  128
+#define BCACHE_FLUSH_MS 1000
+
+#define NO_BUF -1
+
+// Block cache with delayed write-back. Dirty blocks carry the epoch they
+// were last modified in; bcache_barrier() starts a new epoch and the flusher
+// makes each epoch durable (sorted by LBA, coalesced into multi-sector
+// writes, then FLUSH CACHE) before writing anything from a later one.
+// Held blocks are modified but not yet writable; bcache_commit() releases
+// them into the current epoch, which lets metadata be prepared before the
+// data it describes and still reach the disk after it.
+// A memory-backed device bypasses all of this: blocks are handed out as
+// pointers into the device's own pages and nothing is ever dirty.
+typedef struct {
+    uint32_t lba;
+    uint32_t epoch;
+    uint32_t lru;
+    int16_t hnext;
+    uint8_t valid;
+    uint8_t dirty;
+    uint8_t held;
+} bcache_buf_t;
+
+static uint8_t g_data[BCACHE_BLOCKS][512] __attribute__((aligned(16)));
+static bcache_buf_t g_bufs[BCACHE_BLOCKS];
+static int16_t g_hash[BCACHE_HASH];
+
+static const blkdev_t* g_dev = 0;
+static uint32_t g_clock = 0;
+static uint32_t g_epoch = 0;
+static uint32_t g_dirty = 0;
+static uint32_t g_held = 0;
+static uint32_t g_first_dirty_tick = 0;
+static uint32_t g_flush_ticks = 100;
+static volatile int g_flush_due = 0;
+
+static uint32_t g_stat_hits = 0;
+static uint32_t g_stat_misses = 0;
+static uint32_t g_stat_blocks_written = 0;
+static uint32_t g_stat_write_cmds = 0;
+static uint32_t g_stat_flushes = 0;
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+static void copy512(void* dst, const void* src) {
+    uint32_t* d = (uint32_t*)dst;
+    const uint32_t* s = (const uint32_t*)src;
+    for (int i = 0; i < 128; i++) d[i] = s[i];
+}
+
+static uint8_t* direct(uint32_t lba) {
+    if (!g_dev || !g_dev->base || lba >= g_dev->sectors) return 0;
+    return g_dev->base + lba * 512;
+}
+
+static inline uint32_t hash_lba(uint32_t lba) {
+    return (lba ^ (lba >> 6)) & (BCACHE_HASH - 1);
+}
+
+static int find(uint32_t lba) {
+    for (int i = g_hash[hash_lba(lba)]; i != NO_BUF; i = g_bufs[i].hnext) {
+        if (g_bufs[i].valid && g_bufs[i].lba == lba) return i;
+    }
+    return NO_BUF;
+}
+
+static void hash_remove(int idx) {
+    int16_t* link = &g_hash[hash_lba(g_bufs[idx].lba)];
+    while (*link != NO_BUF) {
+        if (*link == idx) {
+            *link = g_bufs[idx].hnext;
+            return;
+        }
+        link = &g_bufs[*link].hnext;
+    }
+}
+
+static void hash_insert(int idx) {
+    uint32_t h = hash_lba(g_bufs[idx].lba);
+    g_bufs[idx].hnext = g_hash[h];
+    g_hash[h] = (int16_t)idx;
+}
+
+static void mark_clean(int idx) {
+    if (!g_bufs[idx].dirty) return;
+    g_bufs[idx].dirty = 0;
+    g_dirty--;
+}
+
+// Writes every dirty block of the oldest epoch in LBA order, one command per
+// run of consecutive LBAs. Returns 1 if anything was written.
+static int flush_oldest_epoch(int* err) {
+    static int16_t order[BCACHE_BLOCKS];
+    static const void* run[BCACHE_MAX_RUN];
+
+    uint32_t oldest = 0;
+    int found = 0;
+    for (int i = 0; i < BCACHE_BLOCKS; i++) {
+        if (!g_bufs[i].dirty) continue;
+        if (!found || (int32_t)(g_bufs[i].epoch - oldest) < 0) oldest = g_bufs[i].epoch;
+        found = 1;
+    }
+    if (!found) return 0;
+
+    int n = 0;
+    for (int i = 0; i < BCACHE_BLOCKS; i++) {
+        if (!g_bufs[i].dirty || g_bufs[i].epoch != oldest) continue;
+
+        int j = n++;
+        while (j > 0 && g_bufs[order[j - 1]].lba > g_bufs[i].lba) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = (int16_t)i;
+    }
+
+    int k = 0;
+    while (k < n) {
+        uint32_t start = g_bufs[order[k]].lba;
+        int len = 0;
+        while (k + len < n && len < BCACHE_MAX_RUN && g_bufs[order[k + len]].lba == start + (uint32_t)len) {
+            run[len] = g_data[order[k + len]];
+            len++;
+        }
+
+        if (g_dev->write_gather(start, (uint8_t)len, run) < 0) {
+            *err = 1;
+            return 0;
+        }
+        for (int i = 0; i < len; i++) mark_clean(order[k + i]);
+
+        g_stat_write_cmds++;
+        g_stat_blocks_written += (uint32_t)len;
+        k += len;
+    }
+
+    // Make this epoch durable before a later one can reach the platter.
+    if (g_dev->flush() < 0) {
+        *err = 1;
+        return 0;
+    }
+    g_stat_flushes++;
+    return 1;
+}
+
+static int alloc_buf(uint32_t lba) {
+    for (int pass = 0; pass < 2; pass++) {
+        int best = NO_BUF;
+        for (int i = 0; i < BCACHE_BLOCKS; i++) {
+            bcache_buf_t* b = &g_bufs[i];
+            if (!b->valid) {
+                best = i;
+                break;
+            }
+            if (b->dirty || b->held) continue;
+            if (best == NO_BUF || (int32_t)(b->lru - g_bufs[best].lru) < 0) best = i;
+        }
+
+        if (best != NO_BUF) {
+            bcache_buf_t* b = &g_bufs[best];
+            if (b->valid) hash_remove(best);
+            b->lba = lba;
+            b->valid = 1;
+            b->dirty = 0;
+            b->held = 0;
+            b->lru = ++g_clock;
+            hash_insert(best);
+            return best;
+        }
+
+        // Every block is dirty or held: push out the oldest epoch and retry.
+        int err = 0;
+        if (!flush_oldest_epoch(&err)) return NO_BUF;
+    }
+    return NO_BUF;
+}
+
+void bcache_init(const blkdev_t* dev) {
+    g_dev = dev;
+    for (int i = 0; i < BCACHE_HASH; i++) g_hash[i] = NO_BUF;
+    for (int i = 0; i < BCACHE_BLOCKS; i++) {
+        g_bufs[i].valid = 0;
+        g_bufs[i].dirty = 0;
+        g_bufs[i].held = 0;
+        g_bufs[i].hnext = NO_BUF;
+    }
+    g_clock = 0;
+    g_epoch = 0;
+    g_dirty = 0;
+    g_held = 0;
+    g_flush_due = 0;
+
+    g_flush_ticks = (BCACHE_FLUSH_MS * pit_get_hz()) / 1000;
+    if (g_flush_ticks == 0) g_flush_ticks = 1;
+}
+
+uint8_t* bcache_get(uint32_t lba) {
+    if (g_dev->base) {
+        g_stat_hits++;
+        return direct(lba);
+    }
+
+    int idx = find(lba);
+    if (idx != NO_BUF) {
+        g_stat_hits++;
+        g_bufs[idx].lru = ++g_clock;
+        return g_data[idx];
+    }
+
+    g_stat_misses++;
+    idx = alloc_buf(lba);
+    if (idx == NO_BUF) return 0;
+
+    if (g_dev->read(lba, 1, g_data[idx]) < 0) {
+        hash_remove(idx);
+        g_bufs[idx].valid = 0;
+        return 0;
+    }
+    return g_data[idx];
+}
+
+// For callers about to overwrite all 512 bytes: skips the disk read.
+uint8_t* bcache_get_nofill(uint32_t lba) {
+    if (g_dev->base) return direct(lba);
+
+    int idx = find(lba);
+    if (idx != NO_BUF) {
+        g_bufs[idx].lru = ++g_clock;
+        return g_data[idx];
+    }
+
+    idx = alloc_buf(lba);
+    if (idx == NO_BUF) return 0;
+    return g_data[idx];
+}
+
+void bcache_dirty(uint32_t lba) {
+    int idx = find(lba);
+    if (idx == NO_BUF) return;
+
+    bcache_buf_t* b = &g_bufs[idx];
+    if (b->held) return;
+    if (!b->dirty) {
+        if (g_dirty == 0) g_first_dirty_tick = pit_get_ticks();
+        b->dirty = 1;
+        g_dirty++;
+    }
+    // Re-dirtying moves the block to the current epoch so its newest
+    // contents are never written ahead of an earlier barrier's data.
+    b->epoch = g_epoch;
+}
+
+void bcache_defer(uint32_t lba) {
+    int idx = find(lba);
+    if (idx == NO_BUF) return;
+
+    bcache_buf_t* b = &g_bufs[idx];
+    if (b->held) return;
+    mark_clean(idx);
+    b->held = 1;
+    g_held++;
+}
+
+void bcache_commit(void) {
+    if (g_held == 0) return;
+
+    for (int i = 0; i < BCACHE_BLOCKS; i++) {
+        if (!g_bufs[i].held) continue;
+        g_bufs[i].held = 0;
+        bcache_dirty(g_bufs[i].lba);
+    }
+    g_held = 0;
+}
+
+void bcache_barrier(void) {
+    for (int i = 0; i < BCACHE_BLOCKS; i++) {
+        if (g_bufs[i].dirty && g_bufs[i].epoch == g_epoch) {
+            g_epoch++;
+            return;
+        }
+    }
+}
+
+// Direct pointer to count sectors starting at lba, or 0 unless the device is
+// memory-backed. Callers may read in place instead of copying.
+const uint8_t* bcache_map(uint32_t lba, uint32_t count) {
+    if (count == 0 || lba + count < lba) return 0;
+    if (!direct(lba) || !direct(lba + count - 1)) return 0;
+    return direct(lba);
+}
+
+// Reads count sectors into buf. Cached blocks (which may be newer than the
+// disk) are copied; uncached runs go straight from the drive into buf and
+// are not inserted, so streaming reads do not push out metadata.
+int bcache_read(uint32_t lba, uint32_t count, void* buf) {
+    uint8_t* out = (uint8_t*)buf;
+    uint32_t i = 0;
+
+    if (g_dev->base) {
+        const uint8_t* src = bcache_map(lba, count);
+        if (!src) return -1;
+        for (i = 0; i < count; i++) copy512(out + i * 512, src + i * 512);
+        g_stat_hits += count;
+        return 0;
+    }
+
+    while (i < count) {
+        int idx = find(lba + i);
+        if (idx != NO_BUF) {
+            copy512(out + i * 512, g_data[idx]);
+            g_stat_hits++;
+            i++;
+            continue;
+        }
+
+        uint32_t n = 1;
+        while (i + n < count && n < 255 && find(lba + i + n) == NO_BUF) n++;
+        if (g_dev->read(lba + i, (uint8_t)n, out + i * 512) < 0) return -1;
+        g_stat_misses += n;
+        i += n;
+    }
+
+    return 0;
+}
+
+int bcache_write(uint32_t lba, uint32_t count, const void* buf) {
+    const uint8_t* in = (const uint8_t*)buf;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t* b = bcache_get_nofill(lba + i);
+        if (!b) return -1;
+        copy512(b, in + i * 512);
+        bcache_dirty(lba + i);
+    }
+    return 0;
+}
+
+int bcache_sync(void) {
+    int err = 0;
+    while (g_dirty > 0) {
+        if (!flush_oldest_epoch(&err)) break;
+    }
+    g_flush_due = 0;
+    return (err || g_dirty > 0) ? -1 : 0;
+}
+
+// IRQ0 context: only decides whether a write-back is due.
+void bcache_tick(uint32_t now) {
+    if (g_dirty > 0 && !g_flush_due && (now - g_first_dirty_tick) >= g_flush_ticks) {
+        g_flush_due = 1;
+    }
+}
+
+void bcache_poll(void) {
+    if (!g_flush_due) return;
+    bcache_sync();
+}
+
+void bcache_dump(void) {
+    console_puts("[blk] dev=");
+    console_puts(g_dev ? g_dev->name : "none");
+    console_puts(" hits/misses=");
+    print_u32(g_stat_hits);
+    console_putc('/');
+    print_u32(g_stat_misses);
+    console_puts(" dirty=");
+    print_u32(g_dirty);
+    console_puts(" written=");
+    print_u32(g_stat_blocks_written);
+    console_puts(" cmds=");
+    print_u32(g_stat_write_cmds);
+    console_puts(" flushes=");
+    print_u32(g_stat_flushes);
+    console_putc('\n');
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+#include "blkdev.h"
+
+void bcache_init(const blkdev_t* dev);
+
+uint8_t* bcache_get(uint32_t lba);
+uint8_t* bcache_get_nofill(uint32_t lba);
+void bcache_dirty(uint32_t lba);
+void bcache_defer(uint32_t lba);
+void bcache_commit(void);
+void bcache_barrier(void);
+const uint8_t* bcache_map(uint32_t lba, uint32_t count);
+
+int bcache_read(uint32_t lba, uint32_t count, void* buf);
+int bcache_write(uint32_t lba, uint32_t count, const void* buf);
+int bcache_sync(void);
+
+void bcache_tick(uint32_t now);
+void bcache_poll(void);
+void bcache_dump(void);
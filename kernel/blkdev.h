@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+
+// A device of 512-byte sectors. Memory-backed devices set `base` and leave
+// the transfer hooks null: their sectors are read and written in place.
+typedef struct {
+    const char* name;
+    uint32_t sectors;
+    uint8_t* base;
+    int (*read)(uint32_t lba, uint8_t count, void* buf);
+    int (*write_gather)(uint32_t lba, uint8_t count, const void* const* bufs);
+    int (*flush)(void);
+} blkdev_t;
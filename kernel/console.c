@@ -1,9 +1,49 @@
 #include "console.h"
+#include "spinlock.h"
+#include "fbcon.h"
+#include "serial.h"
+
+// Text goes into a RAM shadow of the visible rows; only the spans that
+// changed are copied to VGA memory, at the end of each console call.
+// Scrolling moves the CRTC start address down one row instead of copying
+// the screen. The 32 KB text window holds VGA_WINDOW_ROWS rows; when the
+// screen would run off its end, it restarts at row 0 and is redrawn whole
+// from the shadow. The hardware cursor only follows output on the next timer tick.
+//
+// On a framebuffer the shadow grid is larger and fbcon renders dirty spans
+// into its back buffer; a scroll costs one copy of the back buffer to the
+// screen per console call, however many lines it moved.
+//
+// Everything written is mirrored to the serial port's queue and the UART
+// is kicked once per call.
+
+#define MAX_COLS 256
+#define MAX_ROWS 128
+#define VGA_COLS 80
+#define VGA_ROWS 25
+#define VGA_WINDOW_ROWS 204    // 16 K cells at 0xB8000
 
 static volatile uint16_t* const VGA = (uint16_t*)0xB8000;
 static uint16_t row = 0;
 static uint16_t col = 0;
 static uint8_t color = 0x0F;
+static spinlock_t g_lock = SPINLOCK_INIT;
+
+static uint16_t g_cols = VGA_COLS;
+static uint16_t g_rows = VGA_ROWS;
+static int g_fb = 0;
+
+static uint16_t g_shadow[MAX_ROWS][MAX_COLS];   // ring of rows, screen row 0 at g_top
+static uint16_t g_top = 0;
+static uint16_t g_base = 0;             // VGA row shown as screen row 0
+static uint16_t g_dirty_lo[MAX_ROWS];   // per shadow row: columns [lo, hi)
+static uint16_t g_dirty_hi[MAX_ROWS];   // still to be copied; clean if lo >= hi
+static int g_base_dirty = 0;            // scrolled: new CRTC start, or full blit
+static volatile int g_cursor_dirty = 0;
+static uint16_t g_cursor_row = 0;       // where the framebuffer cursor is drawn
+static uint16_t g_cursor_col = 0;
+static uint8_t g_cursor_start = 14;
+static uint8_t g_cursor_end = 15;
 
 static inline void outb(uint16_t port, uint8_t val) {
     __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
@@ -15,38 +55,142 @@ static inline uint8_t inb(uint16_t port) {
     return ret;
 }
 
-static void scroll_if_needed(void) {
-    if (row < 25) return;
+static inline uint16_t* shadow_row(uint16_t r) {
+    return g_shadow[(g_top + r) % g_rows];
+}
 
-    for (int y = 1; y < 25; y++) {
-        for (int x = 0; x < 80; x++) {
-            VGA[(y - 1) * 80 + x] = VGA[y * 80 + x];
-        }
+static void mark(uint16_t r, uint16_t lo, uint16_t hi) {
+    uint16_t s = (g_top + r) % g_rows;
+    if (g_dirty_lo[s] >= g_dirty_hi[s]) {
+        g_dirty_lo[s] = lo;
+        g_dirty_hi[s] = hi;
+        return;
     }
+    if (lo < g_dirty_lo[s]) g_dirty_lo[s] = lo;
+    if (hi > g_dirty_hi[s]) g_dirty_hi[s] = hi;
+}
 
+static void blank_row(uint16_t r) {
     uint16_t blank = (uint16_t)' ' | ((uint16_t)color << 8);
-    for (int x = 0; x < 80; x++) {
-        VGA[24 * 80 + x] = blank;
+    uint16_t* cells = shadow_row(r);
+    for (int x = 0; x < g_cols; x++) cells[x] = blank;
+    mark(r, 0, g_cols);
+}
+
+static inline void copy_dwords(volatile uint16_t* dst, const uint16_t* src, uint32_t n) {
+    __asm__ __volatile__("rep movsl" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+}
+
+static void flush_fb(void) {
+    for (uint16_t r = 0; r < g_rows; r++) {
+        uint16_t s = (g_top + r) % g_rows;
+        if (g_dirty_lo[s] >= g_dirty_hi[s]) continue;
+
+        fbcon_render(s, g_shadow[s], g_dirty_lo[s], g_dirty_hi[s]);
+        if (!g_base_dirty) fbcon_blit(r, s, g_dirty_lo[s], g_dirty_hi[s]);
+        g_dirty_lo[s] = 0;
+        g_dirty_hi[s] = 0;
     }
 
-    row = 24;
+    if (g_base_dirty) {
+        for (uint16_t r = 0; r < g_rows; r++) fbcon_blit(r, (g_top + r) % g_rows, 0, g_cols);
+        g_base_dirty = 0;
+    }
 }
 
-void console_set_cursor(uint16_t r, uint16_t c) {
-    if (r > 24) r = 24;
-    if (c > 79) c = 79;
+// Dirty spans are widened to even columns so every copy is whole,
+// aligned dwords (a row is 160 bytes).
+static void flush(void) {
+    if (g_fb) {
+        flush_fb();
+        return;
+    }
 
-    row = r;
-    col = c;
+    for (uint16_t r = 0; r < g_rows; r++) {
+        uint16_t s = (g_top + r) % g_rows;
+        if (g_dirty_lo[s] >= g_dirty_hi[s]) continue;
+
+        uint32_t lo = g_dirty_lo[s] & ~1u;
+        uint32_t hi = (g_dirty_hi[s] + 1u) & ~1u;
+        copy_dwords(&VGA[(g_base + r) * g_cols + lo], &g_shadow[s][lo], (hi - lo) / 2);
+        g_dirty_lo[s] = 0;
+        g_dirty_hi[s] = 0;
+    }
+
+    // Only after the new rows are in place, so the screen never shows a
+    // half-drawn page.
+    if (g_base_dirty) {
+        uint16_t start = (uint16_t)(g_base * g_cols);
+        outb(0x3D4, 0x0C);
+        outb(0x3D5, (uint8_t)((start >> 8) & 0xFF));
+        outb(0x3D4, 0x0D);
+        outb(0x3D5, (uint8_t)(start & 0xFF));
+        g_base_dirty = 0;
+    }
+}
+
+static void scroll_if_needed(void) {
+    if (row < g_rows) return;
+
+    g_top = (g_top + 1) % g_rows;
+    g_base_dirty = 1;
+    if (!g_fb && ++g_base + g_rows > VGA_WINDOW_ROWS) {
+        g_base = 0;
+        for (uint16_t r = 0; r < g_rows; r++) mark(r, 0, g_cols);
+    }
+    blank_row(g_rows - 1);
+
+    row = g_rows - 1;
+}
+
+static void update_cursor(void) {
+    g_cursor_dirty = 0;
+    if (g_fb) {
+        // Put back the cell under the old bar, then draw the new one.
+        fbcon_blit(g_cursor_row, (g_top + g_cursor_row) % g_rows, g_cursor_col, g_cursor_col + 1u);
+        g_cursor_row = row;
+        g_cursor_col = col;
+        fbcon_cursor(row, col, (uint8_t)(shadow_row(row)[col] >> 8), g_cursor_start, g_cursor_end);
+        return;
+    }
 
-    uint16_t pos = (uint16_t)(row * 80 + col);
+    uint16_t pos = (uint16_t)((g_base + row) * g_cols + col);
     outb(0x3D4, 0x0F);
     outb(0x3D5, (uint8_t)(pos & 0xFF));
     outb(0x3D4, 0x0E);
     outb(0x3D5, (uint8_t)((pos >> 8) & 0xFF));
 }
 
+static void set_cursor(uint16_t r, uint16_t c) {
+    if (r > g_rows - 1) r = g_rows - 1;
+    if (c > g_cols - 1) c = g_cols - 1;
+
+    row = r;
+    col = c;
+    update_cursor();
+}
+
+void console_set_cursor(uint16_t r, uint16_t c) {
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    set_cursor(r, c);
+    spin_unlock_irqrestore(&g_lock, flags);
+}
+
+// Timer tick: moves the hardware cursor if output has gone quiet since it
+// was last placed.
+void console_tick(void) {
+    if (!g_cursor_dirty) return;
+
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    if (g_cursor_dirty) update_cursor();
+    spin_unlock_irqrestore(&g_lock, flags);
+}
+
 void console_enable_cursor(uint8_t start, uint8_t end) {
+    g_cursor_start = start & 0x1F;
+    g_cursor_end = end & 0x1F;
+    if (g_fb) return;
+
     outb(0x3D4, 0x0A);
     uint8_t cur_start = inb(0x3D5);
     cur_start = (cur_start & 0xC0) | (start & 0x1F);
@@ -59,42 +203,141 @@ void console_enable_cursor(uint8_t start, uint8_t end) {
 }
 
 void console_clear(void) {
-    for (uint16_t y = 0; y < 25; y++) {
-        for (uint16_t x = 0; x < 80; x++) {
-            VGA[y * 80 + x] = (uint16_t)' ' | ((uint16_t)color << 8);
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    g_top = 0;
+    g_base = 0;
+    g_base_dirty = 1;
+    for (uint16_t r = 0; r < g_rows; r++) blank_row(r);
+    flush();
+    set_cursor(0, 0);
+    spin_unlock_irqrestore(&g_lock, flags);
+}
+
+// Moves the console onto the loader's framebuffer, if there is one. The
+// text already on screen is kept, with screen row 0 in shadow slot 0.
+int console_init_fb(uint32_t mb2_info_addr) {
+    if (fbcon_init(mb2_info_addr, MAX_COLS, MAX_ROWS) < 0) return -1;
+
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    uint16_t tmp[VGA_COLS];
+    for (; g_top; g_top--) {
+        for (int x = 0; x < VGA_COLS; x++) tmp[x] = g_shadow[0][x];
+        for (uint16_t r = 0; r + 1 < g_rows; r++) {
+            for (int x = 0; x < VGA_COLS; x++) g_shadow[r][x] = g_shadow[r + 1][x];
         }
+        for (int x = 0; x < VGA_COLS; x++) g_shadow[g_rows - 1][x] = tmp[x];
     }
-    console_set_cursor(0, 0);
+
+    uint16_t old_cols = g_cols;
+    uint16_t old_rows = g_rows;
+    g_cols = (uint16_t)fbcon_cols();
+    g_rows = (uint16_t)fbcon_rows();
+    g_fb = 1;
+    g_base = 0;
+    g_base_dirty = 1;
+    uint16_t blank = (uint16_t)' ' | ((uint16_t)color << 8);
+    for (uint16_t r = 0; r < g_rows; r++) {
+        uint16_t from = r < old_rows ? old_cols : 0;
+        for (uint16_t x = from; x < g_cols; x++) g_shadow[r][x] = blank;
+        mark(r, 0, g_cols);
+    }
+    if (row >= g_rows) row = g_rows - 1;
+    flush();
+    update_cursor();
+    spin_unlock_irqrestore(&g_lock, flags);
+    return 0;
 }
 
-void console_putc(char c) {
+static void newline(void) {
+    row++;
+    col = 0;
+    scroll_if_needed();
+}
+
+static void putc_locked(char c) {
+    serial_putc(c);
     if (c == '\n') {
-        row++;
-        col = 0;
-        scroll_if_needed();
-        console_set_cursor(row, col);
+        newline();
         return;
     }
 
-    VGA[row * 80 + col] = (uint16_t)c | ((uint16_t)color << 8);
+    shadow_row(row)[col] = (uint16_t)(uint8_t)c | ((uint16_t)color << 8);
+    mark(row, col, (uint16_t)(col + 1));
     col++;
+    if (col >= g_cols) newline();
+}
+
+// Copies each run of characters up to a newline or the end of the row
+// into the shadow and marks it dirty once.
+static void write_locked(const char* s, uint32_t len) {
+    serial_write(s, len);
+    uint16_t attr = (uint16_t)color << 8;
+    uint32_t i = 0;
+    while (i < len) {
+        if (s[i] == '\n') {
+            newline();
+            i++;
+            continue;
+        }
 
-    if (col >= 80) {
-        col = 0;
-        row++;
-        scroll_if_needed();
+        uint16_t* cell = &shadow_row(row)[col];
+        uint32_t room = g_cols - col;
+        uint32_t n = 0;
+        for (; n < room && i + n < len && s[i + n] != '\n'; n++) {
+            cell[n] = (uint16_t)(uint8_t)s[i + n] | attr;
+        }
+        mark(row, col, (uint16_t)(col + n));
+        i += n;
+        col = (uint16_t)(col + n);
+        if (col >= g_cols) newline();
     }
+}
 
-    console_set_cursor(row, col);
+void console_putc(char c) {
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    putc_locked(c);
+    flush();
+    serial_kick();
+    g_cursor_dirty = 1;
+    spin_unlock_irqrestore(&g_lock, flags);
 }
 
+// One lock hold per string, so lines from different CPUs do not interleave.
 void console_puts(const char* s) {
-    for (; *s; s++) console_putc(*s);
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    for (; *s; s++) putc_locked(*s);
+    flush();
+    serial_kick();
+    g_cursor_dirty = 1;
+    spin_unlock_irqrestore(&g_lock, flags);
+}
+
+// Bulk output: `len` bytes (NULs included) with one lock hold and one
+// flush.
+void console_write(const char* s, uint32_t len) {
+    console_iov_t iov = { s, len };
+    console_writev(&iov, 1);
+}
+
+void console_writev(const console_iov_t* iov, uint32_t count) {
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    for (uint32_t i = 0; i < count; i++) write_locked(iov[i].base, iov[i].len);
+    flush();
+    serial_kick();
+    g_cursor_dirty = 1;
+    spin_unlock_irqrestore(&g_lock, flags);
 }
 
 void console_backspace(void) {
-    if (col == 0) return;
-    col--;
-    VGA[row * 80 + col] = (uint16_t)' ' | ((uint16_t)color << 8);
-    console_set_cursor(row, col);
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    if (col > 0) {
+        col--;
+        shadow_row(row)[col] = (uint16_t)' ' | ((uint16_t)color << 8);
+        mark(row, col, (uint16_t)(col + 1));
+        flush();
+        g_cursor_dirty = 1;
+        serial_write("\b \b", 3);
+        serial_kick();
+    }
+    spin_unlock_irqrestore(&g_lock, flags);
 }
@@ -1,10 +1,19 @@
 #pragma once
 #include <stdint.h>
 
+typedef struct {
+    const char* base;
+    uint32_t len;
+} console_iov_t;
+
+int console_init_fb(uint32_t mb2_info_addr);
 void console_clear(void);
 void console_putc(char c);
 void console_puts(const char* s);
+void console_write(const char* s, uint32_t len);
+void console_writev(const console_iov_t* iov, uint32_t count);
 void console_backspace(void);
 
 void console_set_cursor(uint16_t row, uint16_t col);
 void console_enable_cursor(uint8_t start, uint8_t end);
+void console_tick(void);
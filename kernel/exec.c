@@ -1,12 +1,52 @@
 #include <stdint.h>
 #include "exec.h"
-#include "fs.h"
+#include "vfs.h"
 #include "console.h"
-
-typedef int (*user_entry_t)(int argc, char** argv);
-
-static uint8_t exec_file_buf[64 * 1024];
-static uint8_t exec_image_buf[64 * 1024];
+#include "pmm.h"
+#include "kheap.h"
+#include "pit.h"
+#include "proc.h"
+#include "job.h"
+
+#define EXEC_PAGE_SIZE  4096
+#define EXEC_MAX_PHDRS  16
+#define EXEC_MAX_IMAGE  (4 * 1024 * 1024)
+
+#define EXEC_CACHE_SLOTS  8
+#define EXEC_CACHE_BUDGET (2 * 1024 * 1024)
+
+// A loaded program: contiguous pages from the PMM sized to the image.
+// Words listed in `fixups` hold link-time addresses (relative to
+// `link_base`); they are rebased to wherever a copy of the image runs.
+typedef struct {
+    uint8_t* base;
+    uint32_t pages;
+    uint32_t entry_off;
+    uint32_t link_base;
+    uint32_t* fixups;
+    uint32_t nfixups;
+} exec_image_t;
+
+// Validated, loaded images kept pristine for the next launch, keyed by file
+// identity. A launch runs on a private copy rebased to wherever it lands, so
+// neither relocation nor whatever the program does to its data and BSS ever
+// reaches the cached image, and any number of copies can be resident at once.
+typedef struct {
+    int used;
+    uint32_t mount_id;
+    uint32_t ino;
+    uint32_t size;
+    uint32_t mtime;
+    uint32_t lru;
+    uint32_t sum;         // Adler-32 of the image pages, for EXEC_F_VERIFY
+    exec_image_t img;
+} exec_cache_t;
+
+static exec_cache_t g_cache[EXEC_CACHE_SLOTS];
+static uint32_t g_cache_bytes = 0;
+static uint32_t g_cache_clock = 0;
+static uint32_t g_cache_hits = 0;
+static uint32_t g_cache_misses = 0;
 
 typedef struct {
     uint8_t e_ident[16];
@@ -36,6 +76,43 @@ typedef struct {
     uint32_t p_align;
 } __attribute__((packed)) elf32_phdr_t;
 
+typedef struct {
+    uint32_t r_offset;
+    uint32_t r_info;
+} __attribute__((packed)) elf32_rel_t;
+
+typedef struct {
+    uint32_t st_name;
+    uint32_t st_value;
+    uint32_t st_size;
+    uint8_t st_info;
+    uint8_t st_other;
+    uint16_t st_shndx;
+} __attribute__((packed)) elf32_sym_t;
+
+#define PT_LOAD     1
+#define PT_DYNAMIC  2
+
+#define DT_NULL     0
+#define DT_NEEDED   1
+#define DT_PLTRELSZ 2
+#define DT_SYMTAB   6
+#define DT_RELA     7
+#define DT_REL      17
+#define DT_RELSZ    18
+#define DT_RELENT   19
+#define DT_PLTREL   20
+#define DT_JMPREL   23
+
+#define R_386_NONE     0
+#define R_386_32       1
+#define R_386_GLOB_DAT 6
+#define R_386_JMP_SLOT 7
+#define R_386_RELATIVE 8
+
+#define SHN_UNDEF 0
+#define SHN_ABS   0xFFF1
+
 typedef struct {
     uint8_t magic[4];
     uint32_t version;
@@ -86,58 +163,252 @@ static int ext_is(const char* name, const char* want) {
     return *ext == 0 && *want == 0;
 }
 
-static int check_elf_executable(const uint8_t* data, uint32_t size) {
-    if (size < sizeof(elf32_ehdr_t)) return 0;
+static int add_overflow_u32(uint32_t a, uint32_t b, uint32_t* out) {
+    if (a > 0xFFFFFFFFu - b) return 1;
+    *out = a + b;
+    return 0;
+}
+
+static int read_at(int fd, uint32_t off, void* buf, uint32_t n) {
+    if (n == 0) return 0;
+    if (vfs_seek(fd, (int32_t)off, VFS_SEEK_SET) < 0) return -1;
+    return vfs_read(fd, buf, n) == (int)n ? 0 : -1;
+}
+
+static int image_alloc(exec_image_t* img, uint32_t bytes) {
+    if (bytes == 0 || bytes > EXEC_MAX_IMAGE) return -1;
+
+    img->pages = (bytes + EXEC_PAGE_SIZE - 1) / EXEC_PAGE_SIZE;
+    img->link_base = 0;
+    img->fixups = 0;
+    img->nfixups = 0;
+    img->base = (uint8_t*)(uintptr_t)pmm_alloc_contiguous(img->pages);
+    return img->base ? 0 : -1;
+}
+
+static void image_free(exec_image_t* img) {
+    if (img->base) pmm_free_contiguous((uint32_t)(uintptr_t)img->base, img->pages);
+    if (img->fixups) kfree(img->fixups);
+    img->base = 0;
+    img->fixups = 0;
+    img->nfixups = 0;
+}
+
+// Moves the words `src` records as link-time addresses to `at`, the address
+// `dst` runs at. `dst` is either a fresh copy of `src` or `src` itself.
+static void image_rebase(exec_image_t* dst, const exec_image_t* src, uint32_t at) {
+    uint32_t bias = at - src->link_base;
+    for (uint32_t i = 0; i < src->nfixups; i++) {
+        *(uint32_t*)(dst->base + src->fixups[i]) += bias;
+    }
+}
+
+static void cache_evict(exec_cache_t* c) {
+    g_cache_bytes -= c->img.pages * EXEC_PAGE_SIZE;
+    image_free(&c->img);
+    c->used = 0;
+}
+
+static void cache_changed(uint32_t mount_id, uint32_t ino) {
+    for (int i = 0; i < EXEC_CACHE_SLOTS; i++) {
+        exec_cache_t* c = &g_cache[i];
+        if (c->used && c->mount_id == mount_id && c->ino == ino) cache_evict(c);
+    }
+}
+
+static exec_cache_t* cache_find(const vfs_stat_t* st) {
+    for (int i = 0; i < EXEC_CACHE_SLOTS; i++) {
+        exec_cache_t* c = &g_cache[i];
+        if (!c->used || c->mount_id != st->mount_id || c->ino != st->ino) continue;
+        if (c->size == st->size && c->mtime == st->mtime) return c;
+
+        // Same file, different contents: the entry can never hit again.
+        cache_evict(c);
+        return 0;
+    }
+    return 0;
+}
+
+// Takes ownership of `img` on success. Evicts least recently used entries
+// until the image fits the budget; images larger than the budget are refused.
+static int cache_insert(const vfs_stat_t* st, exec_image_t* img) {
+    uint32_t bytes = img->pages * EXEC_PAGE_SIZE;
+    if (bytes > EXEC_CACHE_BUDGET) return -1;
+
+    for (;;) {
+        exec_cache_t* free_slot = 0;
+        exec_cache_t* oldest = 0;
+        for (int i = 0; i < EXEC_CACHE_SLOTS; i++) {
+            exec_cache_t* c = &g_cache[i];
+            if (!c->used) {
+                if (!free_slot) free_slot = c;
+                continue;
+            }
+            if (!oldest || (int32_t)(c->lru - oldest->lru) < 0) oldest = c;
+        }
+
+        if (free_slot && g_cache_bytes + bytes <= EXEC_CACHE_BUDGET) {
+            free_slot->used = 1;
+            free_slot->mount_id = st->mount_id;
+            free_slot->ino = st->ino;
+            free_slot->size = st->size;
+            free_slot->mtime = st->mtime;
+            free_slot->lru = ++g_cache_clock;
+            free_slot->sum = job_adler32(1, img->base, bytes);
+            free_slot->img = *img;
+            g_cache_bytes += bytes;
+            return 0;
+        }
+        if (!oldest) return -1;
+        cache_evict(oldest);
+    }
+}
+
+// Copies a cached image into fresh pages and rebases it to the process
+// image base. The copy owns no fixup list, so it cannot be rebased again.
+static int image_clone(const exec_image_t* src, exec_image_t* dst) {
+    if (image_alloc(dst, src->pages * EXEC_PAGE_SIZE) < 0) return -1;
+
+    uint32_t* d = (uint32_t*)dst->base;
+    const uint32_t* s = (const uint32_t*)src->base;
+    for (uint32_t i = 0; i < src->pages * (EXEC_PAGE_SIZE / 4); i++) d[i] = s[i];
+    image_rebase(dst, src, PROC_IMAGE_BASE);
+    dst->entry_off = src->entry_off;
+    return 0;
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
 
-    const elf32_ehdr_t* eh = (const elf32_ehdr_t*)data;
+static int check_elf_header(const elf32_ehdr_t* eh, uint32_t size) {
     if (eh->e_ident[0] != 0x7F || eh->e_ident[1] != 'E' || eh->e_ident[2] != 'L' || eh->e_ident[3] != 'F') return 0;
     if (eh->e_ident[4] != 1 || eh->e_ident[5] != 1 || eh->e_ident[6] != 1) return 0;
     if (eh->e_machine != 3) return 0;
     if (!(eh->e_type == 2 || eh->e_type == 3)) return 0;
 
-    if (eh->e_phoff >= size) return 0;
     if (eh->e_phentsize != sizeof(elf32_phdr_t)) return 0;
-    if (eh->e_phnum == 0) return 0;
+    if (eh->e_phnum == 0 || eh->e_phnum > EXEC_MAX_PHDRS) return 0;
+
+    uint32_t ph_end = 0;
+    if (add_overflow_u32(eh->e_phoff, (uint32_t)eh->e_phnum * sizeof(elf32_phdr_t), &ph_end)) return 0;
+    return ph_end <= size;
+}
 
-    uint32_t ph_total = (uint32_t)eh->e_phentsize * (uint32_t)eh->e_phnum;
-    if (eh->e_phoff + ph_total > size) return 0;
+// True when [vaddr, vaddr + len) lies inside the loaded image.
+static int in_image(const exec_image_t* img, uint32_t vaddr, uint32_t len) {
+    uint32_t end = 0;
+    if (vaddr < img->link_base || add_overflow_u32(vaddr, len, &end)) return 0;
+    return end - img->link_base <= img->pages * EXEC_PAGE_SIZE;
+}
 
-    const elf32_phdr_t* ph = (const elf32_phdr_t*)(data + eh->e_phoff);
-    for (uint32_t i = 0; i < eh->e_phnum; i++) {
-        if (ph[i].p_type != 1) continue; // PT_LOAD
-        if (ph[i].p_filesz == 0) continue;
-        if (ph[i].p_flags & 0x1) return 1; // PF_X
-    }
+// Applies one DT_REL table. Every relocation is resolved against link-time
+// addresses and, unless the result is absolute, its offset is recorded so
+// image_rebase() can move it to the final load address.
+static int apply_rels(exec_image_t* img, uint32_t rel, uint32_t relsz, uint32_t symtab, uint32_t cap) {
+    if (relsz == 0) return 0;
+    if (relsz % sizeof(elf32_rel_t) || !in_image(img, rel, relsz)) return -1;
+
+    const elf32_rel_t* r = (const elf32_rel_t*)(img->base + (rel - img->link_base));
+    for (uint32_t i = 0; i < relsz / sizeof(elf32_rel_t); i++) {
+        uint32_t type = r[i].r_info & 0xFF;
+        uint32_t sym = r[i].r_info >> 8;
+        if (type == R_386_NONE) continue;
+        if (!in_image(img, r[i].r_offset, 4)) return -1;
+
+        uint32_t* where = (uint32_t*)(img->base + (r[i].r_offset - img->link_base));
+        int relative = 1;
+
+        if (type != R_386_RELATIVE) {
+            if (type != R_386_32 && type != R_386_GLOB_DAT && type != R_386_JMP_SLOT) return -1;
+
+            uint32_t value = 0;
+            if (sym == 0) {
+                // No symbol: only R_386_32 makes sense, and it stays absolute.
+                if (type != R_386_32) return -1;
+                relative = 0;
+            } else {
+                if (!symtab || !in_image(img, symtab + sym * sizeof(elf32_sym_t), sizeof(elf32_sym_t))) return -1;
+                const elf32_sym_t* s = (const elf32_sym_t*)(img->base + (symtab - img->link_base)) + sym;
+                // Nothing is linked in at run time, so every symbol must be defined here.
+                if (s->st_shndx == SHN_UNDEF) return -1;
+                if (s->st_shndx == SHN_ABS) relative = 0;
+                value = s->st_value;
+            }
+
+            if (type == R_386_32) *where += value;
+            else *where = value;
+        }
 
+        if (relative) {
+            if (img->nfixups == cap) return -1;
+            img->fixups[img->nfixups++] = r[i].r_offset - img->link_base;
+        }
+    }
     return 0;
 }
 
-static void mem_zero(uint8_t* dst, uint32_t n) {
-    for (uint32_t i = 0; i < n; i++) dst[i] = 0;
-}
+// Processes PT_DYNAMIC of a position-independent (ET_DYN) image.
+static int relocate_elf(exec_image_t* img, const elf32_phdr_t* dyn) {
+    if (!in_image(img, dyn->p_vaddr, dyn->p_filesz)) return -1;
+
+    uint32_t rel = 0, relsz = 0, relent = sizeof(elf32_rel_t);
+    uint32_t jmprel = 0, pltrelsz = 0, pltrel = DT_REL;
+    uint32_t symtab = 0;
+
+    const uint32_t* d = (const uint32_t*)(img->base + (dyn->p_vaddr - img->link_base));
+    for (uint32_t i = 0; i + 1 < dyn->p_filesz / 4 && d[i] != DT_NULL; i += 2) {
+        uint32_t val = d[i + 1];
+        switch (d[i]) {
+        case DT_NEEDED: return -1; // no shared libraries
+        case DT_RELA: return -1;   // i386 uses DT_REL only
+        case DT_REL: rel = val; break;
+        case DT_RELSZ: relsz = val; break;
+        case DT_RELENT: relent = val; break;
+        case DT_JMPREL: jmprel = val; break;
+        case DT_PLTRELSZ: pltrelsz = val; break;
+        case DT_PLTREL: pltrel = val; break;
+        case DT_SYMTAB: symtab = val; break;
+        default: break;
+        }
+    }
+    if (relent != sizeof(elf32_rel_t) || pltrel != DT_REL) return -1;
 
-static void mem_copy(uint8_t* dst, const uint8_t* src, uint32_t n) {
-    for (uint32_t i = 0; i < n; i++) dst[i] = src[i];
-}
+    uint32_t cap = (relsz + pltrelsz) / sizeof(elf32_rel_t);
+    if (cap == 0) return 0;
+    img->fixups = (uint32_t*)kmalloc(cap * sizeof(uint32_t));
+    if (!img->fixups) return -1;
 
-static int add_overflow_u32(uint32_t a, uint32_t b, uint32_t* out) {
-    if (a > 0xFFFFFFFFu - b) return 1;
-    *out = a + b;
-    return 0;
+    if (apply_rels(img, rel, relsz, symtab, cap) < 0) return -1;
+    return apply_rels(img, jmprel, pltrelsz, symtab, cap);
 }
 
-static int load_elf_image(const uint8_t* data, uint32_t size, user_entry_t* out_entry) {
-    if (!check_elf_executable(data, size)) return -1;
+// Reads the ELF and program headers, then each PT_LOAD segment's file bytes
+// straight into its place in a freshly allocated image. Only the gaps
+// between segments and each BSS tail are zeroed; nothing is copied twice.
+// ET_DYN images are relocated to link-time addresses and left for
+// image_rebase(); ET_EXEC images carry no relocations, so they load only if
+// linked at PROC_IMAGE_BASE (-14 otherwise).
+static int load_elf(int fd, uint32_t size, exec_image_t* img) {
+    elf32_ehdr_t eh;
+    elf32_phdr_t ph[EXEC_MAX_PHDRS];
 
-    const elf32_ehdr_t* eh = (const elf32_ehdr_t*)data;
-    const elf32_phdr_t* ph = (const elf32_phdr_t*)(data + eh->e_phoff);
+    if (size < sizeof(eh) || read_at(fd, 0, &eh, sizeof(eh)) < 0) return -1;
+    if (!check_elf_header(&eh, size)) return -1;
+    if (read_at(fd, eh.e_phoff, ph, (uint32_t)eh.e_phnum * sizeof(elf32_phdr_t)) < 0) return -1;
 
     uint32_t min_vaddr = 0xFFFFFFFFu;
     uint32_t max_vaddr = 0;
+    uint32_t prev_end = 0;
     int saw_load = 0;
+    int saw_exec = 0;
+    const elf32_phdr_t* dyn = 0;
 
-    for (uint32_t i = 0; i < eh->e_phnum; i++) {
-        if (ph[i].p_type != 1 || ph[i].p_memsz == 0) continue;
+    for (uint32_t i = 0; i < eh.e_phnum; i++) {
+        if (ph[i].p_type == PT_DYNAMIC) dyn = &ph[i];
+        if (ph[i].p_type != PT_LOAD || ph[i].p_memsz == 0) continue;
 
         uint32_t file_end = 0;
         if (add_overflow_u32(ph[i].p_offset, ph[i].p_filesz, &file_end)) return -2;
@@ -147,100 +418,246 @@ static int load_elf_image(const uint8_t* data, uint32_t size, user_entry_t* out_
         uint32_t seg_end = 0;
         if (add_overflow_u32(ph[i].p_vaddr, ph[i].p_memsz, &seg_end)) return -5;
 
+        // PT_LOAD entries are sorted by p_vaddr and must not overlap.
+        if (saw_load && ph[i].p_vaddr < prev_end) return -6;
+        prev_end = seg_end;
+
         if (ph[i].p_vaddr < min_vaddr) min_vaddr = ph[i].p_vaddr;
         if (seg_end > max_vaddr) max_vaddr = seg_end;
+        if (ph[i].p_filesz > 0 && (ph[i].p_flags & 0x1)) saw_exec = 1; // PF_X
         saw_load = 1;
     }
 
-    if (!saw_load || min_vaddr >= max_vaddr) return -6;
+    if (!saw_load || !saw_exec || min_vaddr >= max_vaddr) return -6;
+    if (eh.e_entry < min_vaddr || eh.e_entry >= max_vaddr) return -10;
+    if (eh.e_type == 2 && min_vaddr != PROC_IMAGE_BASE) return -14; // ET_EXEC
+    if (image_alloc(img, max_vaddr - min_vaddr) < 0) return -7;
+
+    uint32_t cursor = 0;
+    for (uint32_t i = 0; i < eh.e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD || ph[i].p_memsz == 0) continue;
 
-    uint32_t image_size = max_vaddr - min_vaddr;
-    if (image_size == 0 || image_size > sizeof(exec_image_buf)) return -7;
+        uint32_t dst = ph[i].p_vaddr - min_vaddr;
+        job_zero(img->base + cursor, dst - cursor);
+        if (read_at(fd, ph[i].p_offset, img->base + dst, ph[i].p_filesz) < 0) {
+            image_free(img);
+            return -8;
+        }
+        job_zero(img->base + dst + ph[i].p_filesz, ph[i].p_memsz - ph[i].p_filesz);
+        cursor = dst + ph[i].p_memsz;
+    }
+    job_zero(img->base + cursor, img->pages * EXEC_PAGE_SIZE - cursor);
 
-    mem_zero(exec_image_buf, image_size);
+    img->link_base = min_vaddr;
+    if (eh.e_type == 3 && dyn && relocate_elf(img, dyn) < 0) { // ET_DYN
+        image_free(img);
+        return -12;
+    }
 
-    for (uint32_t i = 0; i < eh->e_phnum; i++) {
-        if (ph[i].p_type != 1 || ph[i].p_memsz == 0) continue;
+    img->entry_off = eh.e_entry - min_vaddr;
+    return 0;
+}
 
-        uint32_t dst_off = ph[i].p_vaddr - min_vaddr;
-        uint32_t dst_end = 0;
-        if (add_overflow_u32(dst_off, ph[i].p_memsz, &dst_end)) return -8;
-        if (dst_end > image_size) return -9;
+// The whole flat binary is the image; its code must be position-independent.
+static int load_bin(int fd, uint32_t size, exec_image_t* img) {
+    if (size < sizeof(mbin_hdr_t)) {
+        console_puts("[exec] blocked: bad .bin header size\n");
+        return -13;
+    }
+    if (image_alloc(img, size) < 0) {
+        console_puts("[exec] blocked: file too large\n");
+        return -3;
+    }
+    if (read_at(fd, 0, img->base, size) < 0) {
+        image_free(img);
+        console_puts("[exec] file read failed\n");
+        return -1;
+    }
+    job_zero(img->base + size, img->pages * EXEC_PAGE_SIZE - size);
 
-        if (ph[i].p_filesz > 0) {
-            mem_copy(exec_image_buf + dst_off, data + ph[i].p_offset, ph[i].p_filesz);
-        }
+    int rc = 0;
+    const mbin_hdr_t* h = (const mbin_hdr_t*)img->base;
+    if (!(h->magic[0] == 'M' && h->magic[1] == 'B' && h->magic[2] == 'I' && h->magic[3] == 'N')) {
+        console_puts("[exec] blocked: bad .bin magic (need MBIN)\n");
+        rc = -14;
+    } else if (h->version != 1) {
+        console_puts("[exec] blocked: unsupported .bin version\n");
+        rc = -15;
+    } else if (!(h->flags & MBIN_EXECUTABLE)) {
+        console_puts("[exec] blocked: .bin is not executable\n");
+        rc = -16;
+    } else if (h->code_off >= size || h->code_size > size || h->code_off + h->code_size > size) {
+        console_puts("[exec] blocked: invalid .bin code range\n");
+        rc = -17;
+    } else if (h->entry_off >= h->code_size) {
+        console_puts("[exec] blocked: invalid .bin entry\n");
+        rc = -18;
+    }
+    if (rc < 0) {
+        image_free(img);
+        return rc;
     }
 
-    if (eh->e_entry < min_vaddr || eh->e_entry >= max_vaddr) return -10;
-    *out_entry = (user_entry_t)(uintptr_t)(exec_image_buf + (eh->e_entry - min_vaddr));
+    img->entry_off = h->code_off + h->entry_off;
     return 0;
 }
 
-int exec_run(const char* name, int argc, char** argv) {
-    if (!ext_is(name, ".bin") && !ext_is(name, ".elf")) {
-        console_puts("[exec] blocked: only .bin/.elf are allowed\n");
-        return -10;
-    }
+void exec_init(void) {
+    for (int i = 0; i < EXEC_CACHE_SLOTS; i++) g_cache[i].used = 0;
+    g_cache_bytes = 0;
+    vfs_watch(cache_changed);
+}
 
-    uint32_t size = 0;
-    if (fs_read_file(name, exec_file_buf, sizeof(exec_file_buf), &size) < 0) {
+// Loads `name` from the file system into a new image (cold path).
+static int load_file(const char* name, exec_image_t* img) {
+    // Loader reads land in the image once; bypass the page cache.
+    int fd = vfs_open(name, VFS_O_READ | VFS_O_DIRECT);
+    if (fd < 0) {
         console_puts("[exec] file read failed\n");
         return -1;
     }
 
-    if (size == 0) {
+    vfs_stat_t st;
+    if (vfs_fstat(fd, &st) < 0) {
+        vfs_close(fd);
+        console_puts("[exec] file read failed\n");
+        return -1;
+    }
+    if (st.size == 0) {
+        vfs_close(fd);
         console_puts("[exec] empty file\n");
         return -2;
     }
 
+    img->base = 0;
+    int rc;
     if (ext_is(name, ".elf")) {
-        user_entry_t elf_entry = 0;
-        int lr = load_elf_image(exec_file_buf, size, &elf_entry);
-        if (lr < 0) {
+        rc = load_elf(fd, st.size, img);
+        if (rc == -14) {
+            console_puts("[exec] blocked: ET_EXEC not linked at the user image base\n");
+        } else if (rc < 0) {
             console_puts("[exec] blocked: invalid/non-loadable ELF\n");
-            return -11;
+            rc = -11;
         }
-        int erc = elf_entry(argc, argv);
-        console_puts("[exec] exit=");
-        print_u32((uint32_t)erc);
-        console_putc('\n');
-        return 0;
+    } else {
+        rc = load_bin(fd, st.size, img);
+    }
+    vfs_close(fd);
+    return rc;
+}
+
+int exec_run(const char* name, int argc, char** argv, int flags) {
+    if (!ext_is(name, ".bin") && !ext_is(name, ".elf")) {
+        console_puts("[exec] blocked: only .bin/.elf are allowed\n");
+        return -10;
     }
 
-    if (size < sizeof(mbin_hdr_t)) {
-        console_puts("[exec] blocked: bad .bin header size\n");
-        return -13;
+    uint64_t t0 = rdtsc();
+    uint32_t tick0 = pit_get_ticks();
+
+    // A warm launch needs only the path lookup to confirm the file is unchanged.
+    vfs_stat_t st;
+    if (vfs_stat(name, &st) < 0 || st.type != VFS_FILE) {
+        console_puts("[exec] file read failed\n");
+        return -1;
     }
 
-    const mbin_hdr_t* h = (const mbin_hdr_t*)exec_file_buf;
-    if (!(h->magic[0] == 'M' && h->magic[1] == 'B' && h->magic[2] == 'I' && h->magic[3] == 'N')) {
-        console_puts("[exec] blocked: bad .bin magic (need MBIN)\n");
-        return -14;
+    exec_image_t run;
+    int warm = 0;
+    exec_cache_t* c = cache_find(&st);
+    if (c && (flags & EXEC_F_VERIFY) && job_adler32(1, c->img.base, c->img.pages * EXEC_PAGE_SIZE) != c->sum) {
+        console_puts("[exec] cached image failed verification, reloading\n");
+        cache_evict(c);
+        c = 0;
     }
-    if (h->version != 1) {
-        console_puts("[exec] blocked: unsupported .bin version\n");
-        return -15;
+    if (c) {
+        if (image_clone(&c->img, &run) < 0) {
+            console_puts("[exec] out of memory\n");
+            return -7;
+        }
+        c->lru = ++g_cache_clock;
+        g_cache_hits++;
+        warm = 1;
+    } else {
+        exec_image_t img;
+        int rc = load_file(name, &img);
+        if (rc < 0) return rc;
+        g_cache_misses++;
+
+        // Keep the pristine image when it fits and launch from a copy;
+        // otherwise launch from the freshly loaded image itself.
+        if (cache_insert(&st, &img) == 0) {
+            if (image_clone(&img, &run) < 0) {
+                console_puts("[exec] out of memory\n");
+                return -7;
+            }
+        } else {
+            run = img;
+            image_rebase(&run, &img, PROC_IMAGE_BASE);
+        }
     }
-    if (!(h->flags & MBIN_EXECUTABLE)) {
-        console_puts("[exec] blocked: .bin is not executable\n");
-        return -16;
+
+    proc_t* p = proc_create(name, (uint32_t)(uintptr_t)run.base, run.pages, PROC_IMAGE_BASE + run.entry_off, argc, argv);
+    if (!p) {
+        image_free(&run);
+        console_puts("[exec] cannot create process\n");
+        return -7;
     }
-    if (h->code_off >= size || h->code_size > size || h->code_off + h->code_size > size) {
-        console_puts("[exec] blocked: invalid .bin code range\n");
-        return -17;
+    // The process owns the image pages now; only an uncached load has fixups.
+    if (run.fixups) kfree(run.fixups);
+
+    uint32_t cycles = (uint32_t)(rdtsc() - t0);
+    uint32_t ticks = pit_get_ticks() - tick0;
+    if (flags & EXEC_F_TIMING) {
+        console_puts(warm ? "[exec] warm" : "[exec] cold");
+        console_puts(" launch cycles=");
+        print_u32(cycles);
+        console_puts(" ticks=");
+        print_u32(ticks);
+        console_putc('\n');
     }
-    if (h->entry_off >= h->code_size) {
-        console_puts("[exec] blocked: invalid .bin entry\n");
-        return -18;
+
+    int prio = (flags & EXEC_F_LOW_PRIO) ? PROC_PRIO_LOW : PROC_PRIO_NORMAL;
+    if (flags & EXEC_F_BACKGROUND) {
+        console_puts("[exec] pid ");
+        print_u32(p->pid);
+        console_puts(" started\n");
+        proc_start(p, prio, 1);
+        return 0;
     }
 
-    user_entry_t entry = (user_entry_t)(uintptr_t)(exec_file_buf + h->code_off + h->entry_off);
-    int rc = entry(argc, argv);
+    proc_start(p, prio, 0);
+    int erc = proc_wait(p);
 
     console_puts("[exec] exit=");
-    print_u32((uint32_t)rc);
+    print_u32((uint32_t)erc);
     console_putc('\n');
-
     return 0;
 }
+
+void exec_cache_flush(void) {
+    for (int i = 0; i < EXEC_CACHE_SLOTS; i++) {
+        if (g_cache[i].used) cache_evict(&g_cache[i]);
+    }
+}
+
+void exec_cache_dump(void) {
+    uint32_t entries = 0;
+    for (int i = 0; i < EXEC_CACHE_SLOTS; i++) {
+        if (g_cache[i].used) entries++;
+    }
+
+    console_puts("[exec] cache entries=");
+    print_u32(entries);
+    console_putc('/');
+    print_u32(EXEC_CACHE_SLOTS);
+    console_puts(" bytes=");
+    print_u32(g_cache_bytes);
+    console_putc('/');
+    print_u32(EXEC_CACHE_BUDGET);
+    console_puts(" hits/misses=");
+    print_u32(g_cache_hits);
+    console_putc('/');
+    print_u32(g_cache_misses);
+    console_putc('\n');
+}
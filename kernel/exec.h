@@ -1,3 +1,11 @@
 #pragma once
 
-int exec_run(const char* name, int argc, char** argv);
+#define EXEC_F_TIMING     0x1   // report launch latency and whether the image cache hit
+#define EXEC_F_BACKGROUND 0x2   // return once started; the scheduler reaps it
+#define EXEC_F_LOW_PRIO   0x4   // run below the shell
+#define EXEC_F_VERIFY     0x8   // checksum a cached image before launching it
+
+void exec_init(void);
+int exec_run(const char* name, int argc, char** argv, int flags);
+void exec_cache_flush(void);
+void exec_cache_dump(void);
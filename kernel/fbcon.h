@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+// Pixel backend for the console on a linear 32 bpp framebuffer. Text rows
+// are drawn into a RAM back buffer, one band of pixels per console row
+// slot, and only the spans the console asks for are copied to the screen.
+
+#define FBCON_GLYPH_W 8
+#define FBCON_GLYPH_H 16
+
+int fbcon_init(uint32_t mb2_info_addr, uint32_t max_cols, uint32_t max_rows);
+uint32_t fbcon_cols(void);
+uint32_t fbcon_rows(void);
+
+// Draws cells [lo, hi) of `cells` (VGA char | attr << 8) into back buffer slot `slot`.
+void fbcon_render(uint32_t slot, const uint16_t* cells, uint32_t lo, uint32_t hi);
+// Copies cells [lo, hi) of back buffer slot `slot` to screen row `row`.
+void fbcon_blit(uint32_t row, uint32_t slot, uint32_t lo, uint32_t hi);
+// Draws the cursor bar (glyph scanlines start..end) straight onto the screen.
+void fbcon_cursor(uint32_t row, uint32_t col, uint8_t attr, uint8_t start, uint8_t end);
@@ -1,7 +1,10 @@
 #include <stdint.h>
 #include "fs.h"
-#include "ata.h"
+#include "bcache.h"
 #include "console.h"
+#include "kheap.h"
+#include "vfs.h"
+#include "rtc.h"
 
 #pragma pack(push, 1)
 typedef struct {
@@ -21,6 +24,16 @@ typedef struct {
     uint32_t total_sectors32;
 } fat_bpb_t;
 
+typedef struct {
+    uint32_t fat_size32;
+    uint16_t ext_flags;
+    uint16_t fs_version;
+    uint32_t root_cluster;
+    uint16_t fs_info;
+    uint16_t backup_boot;
+    uint8_t reserved[12];
+} fat32_ext_t;
+
 typedef struct {
     char name[8];
     char ext[3];
@@ -38,16 +51,79 @@ typedef struct {
 } dirent83_t;
 #pragma pack(pop)
 
+#define ATTR_READ_ONLY 0x01
+#define ATTR_VOLUME_ID 0x08
+#define ATTR_DIRECTORY 0x10
+#define ATTR_ARCHIVE   0x20
+#define ATTR_LFN       0x0F
+
+#define FSINFO_LEAD_SIG   0x41615252u
+#define FSINFO_STRUCT_SIG 0x61417272u
+#define FSINFO_UNKNOWN    0xFFFFFFFFu
+
+#define FAT_DATE_1980_01_01 0x0021
+
+#define NO_LBA 0xFFFFFFFFu
+
+typedef struct fat_node {
+    vnode_t vn;
+    uint8_t attr;
+    uint32_t first_cluster;
+    uint32_t cur_cluster;
+    uint32_t cur_index;
+    uint32_t dir_lba;
+    uint32_t dir_slot;
+    struct fat_node* next;
+} fat_node_t;
+
+// Directory cursor. cluster == 0 walks the fixed FAT12/16 root region,
+// otherwise the directory's cluster chain. lba/slot locate the entry most
+// recently returned.
+typedef struct {
+    uint32_t cluster;
+    uint32_t sector;
+    uint32_t index;
+    uint32_t lba;
+    uint32_t slot;
+} dir_iter_t;
+
 static fat_bpb_t g_bpb;
-static uint8_t g_sector[512];
-static uint8_t g_fat_sector[512];
+#define FAT_TOUCHED_MAX 16
+
+// g_sector/g_fat_sector point into the block cache and stay valid only until
+// the next cache call that may evict.
+static uint8_t* g_sector = 0;
+static uint8_t* g_fat_sector = 0;
+static uint32_t g_sector_lba = NO_LBA;
+static uint32_t g_fat_touched[FAT_TOUCHED_MAX];
+static uint32_t g_fat_touched_count = 0;
 static int g_ready = 0;
 
+static int g_fat_type = 0;
 static uint32_t g_root_lba = 0;
 static uint32_t g_root_sectors = 0;
+static uint32_t g_root_cluster = 0;
 static uint32_t g_data_lba = 0;
 static uint32_t g_fat_lba = 0;
-static uint16_t g_fat_size = 0;
+static uint32_t g_fat_size = 0;
+static uint32_t g_cluster_count = 0;
+static uint32_t g_cluster_bytes = 0;
+static uint16_t g_fsinfo_sector = 0;
+static uint32_t g_fsinfo_free = FSINFO_UNKNOWN;
+static uint32_t g_fsinfo_next = FSINFO_UNKNOWN;
+
+// Free-cluster bitmap built at mount: bit set = cluster in use. Allocation
+// only consults this map; the FAT is written but never rescanned.
+static uint32_t* g_used_map = 0;
+static uint32_t g_free_clusters = 0;
+static int g_meta_dirty = 0;
+
+// Live nodes, keyed by the location of their directory entry, so every
+// open of a file shares one size and cluster cursor. The root has no entry.
+static fat_node_t g_root_node;
+static fat_node_t* g_nodes = 0;
+
+static const vnode_ops_t fat_ops;
 
 static void print_u32(uint32_t v) {
     char buf[16];
@@ -106,137 +182,1023 @@ static void format_name(const dirent83_t* e, char out[13]) {
     out[p] = 0;
 }
 
-static uint16_t fat12_next_cluster(uint16_t cluster) {
-    uint32_t fat_offset = cluster + (cluster / 2);
-    uint32_t fat_sector = g_fat_lba + (fat_offset / 512);
+static void mem_copy(uint8_t* dst, const uint8_t* src, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) dst[i] = src[i];
+}
+
+static void mem_zero(uint8_t* dst, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) dst[i] = 0;
+}
+
+static int load_sector(uint32_t lba) {
+    g_sector = bcache_get(lba);
+    g_sector_lba = g_sector ? lba : NO_LBA;
+    return g_sector ? 0 : -1;
+}
+
+static int load_sector_nofill(uint32_t lba) {
+    g_sector = bcache_get_nofill(lba);
+    g_sector_lba = g_sector ? lba : NO_LBA;
+    return g_sector ? 0 : -1;
+}
+
+static int store_sector(void) {
+    if (g_sector_lba == NO_LBA) return -1;
+    bcache_dirty(g_sector_lba);
+    return 0;
+}
+
+static int load_fat_sector(uint32_t lba) {
+    if (lba >= g_fat_lba + g_fat_size) return -1;
+    g_fat_sector = bcache_get(lba);
+    return g_fat_sector ? 0 : -1;
+}
+
+// Copies modified FAT sectors into the other FAT copies. Everything stays
+// held in the cache until fat_commit().
+static int fat_mirror(void) {
+    for (uint32_t i = 0; i < g_fat_touched_count; i++) {
+        uint32_t lba = g_fat_touched[i];
+        for (uint32_t k = 1; k < g_bpb.num_fats; k++) {
+            uint32_t copy_lba = lba + k * g_fat_size;
+            uint8_t* dst = bcache_get_nofill(copy_lba);
+            uint8_t* src = bcache_get(lba);
+            if (!dst || !src) return -1;
+            mem_copy(dst, src, 512);
+            bcache_defer(copy_lba);
+        }
+    }
+    g_fat_touched_count = 0;
+    return 0;
+}
+
+static int write_fsinfo(void);
+
+static int fat_touch(uint32_t lba) {
+    bcache_defer(lba);
+    for (uint32_t i = 0; i < g_fat_touched_count; i++) {
+        if (g_fat_touched[i] == lba) return 0;
+    }
+    if (g_fat_touched_count == FAT_TOUCHED_MAX && fat_mirror() < 0) return -1;
+    g_fat_touched[g_fat_touched_count++] = lba;
+    return 0;
+}
+
+// Releases held FAT updates into the current write-back epoch. Callers
+// issue bcache_barrier() first when the FAT must land after other blocks.
+static int fat_commit(void) {
+    if (fat_mirror() < 0) return -1;
+    bcache_commit();
+    if (g_meta_dirty) {
+        if (write_fsinfo() < 0) return -1;
+        g_meta_dirty = 0;
+    }
+    return 0;
+}
+
+static int cluster_valid(uint32_t cluster) {
+    return cluster >= 2 && cluster < g_cluster_count + 2;
+}
+
+static uint32_t cluster_lba(uint32_t cluster) {
+    return g_data_lba + (cluster - 2) * g_bpb.sectors_per_cluster;
+}
+
+static uint32_t clusters_for(uint32_t bytes) {
+    return (bytes + g_cluster_bytes - 1) / g_cluster_bytes;
+}
+
+static uint32_t entry_cluster(const dirent83_t* e) {
+    uint32_t c = e->first_cluster_lo;
+    if (g_fat_type == 32) c |= (uint32_t)e->first_cluster_hi << 16;
+    return c;
+}
+
+static void set_entry_cluster(dirent83_t* e, uint32_t cluster) {
+    e->first_cluster_lo = (uint16_t)(cluster & 0xFFFF);
+    e->first_cluster_hi = (g_fat_type == 32) ? (uint16_t)(cluster >> 16) : 0;
+}
+
+static uint32_t fat_eoc(void) {
+    if (g_fat_type == 12) return 0xFFF;
+    if (g_fat_type == 16) return 0xFFFF;
+    return 0x0FFFFFFF;
+}
+
+// Returns the FAT entry for `cluster`, or 0xFFFFFFFF on I/O error. Any value
+// that is not a valid cluster number terminates a chain.
+static uint32_t fat_next_cluster(uint32_t cluster) {
+    if (g_fat_type == 12) {
+        uint32_t fat_offset = cluster + (cluster / 2);
+        uint32_t fat_sector = g_fat_lba + (fat_offset / 512);
+        uint32_t ent_off = fat_offset % 512;
+
+        if (load_fat_sector(fat_sector) < 0) return 0xFFFFFFFFu;
+        uint32_t val = g_fat_sector[ent_off];
+
+        // A 12-bit entry may straddle two FAT sectors.
+        if (ent_off == 511) {
+            if (load_fat_sector(fat_sector + 1) < 0) return 0xFFFFFFFFu;
+            val |= (uint32_t)g_fat_sector[0] << 8;
+        } else {
+            val |= (uint32_t)g_fat_sector[ent_off + 1] << 8;
+        }
+
+        if (cluster & 1) val >>= 4;
+        else val &= 0x0FFF;
+        return val;
+    }
+
+    uint32_t width = (g_fat_type == 16) ? 2 : 4;
+    uint32_t fat_offset = cluster * width;
+    if (load_fat_sector(g_fat_lba + fat_offset / 512) < 0) return 0xFFFFFFFFu;
+
     uint32_t ent_off = fat_offset % 512;
+    if (width == 2) return *(uint16_t*)&g_fat_sector[ent_off];
+    return *(uint32_t*)&g_fat_sector[ent_off] & 0x0FFFFFFFu;
+}
 
-    if (fat_sector >= g_fat_lba + g_fat_size) return 0xFFF;
-    if (ata_read28(fat_sector, 1, g_fat_sector) < 0) return 0xFFF;
+// Updates the FAT entry in the cached sector and holds the sector until
+// fat_commit(), so repeated updates to one sector cost a single write.
+static int fat_set(uint32_t cluster, uint32_t value) {
+    if (g_fat_type == 12) {
+        uint32_t fat_offset = cluster + (cluster / 2);
+        uint32_t fat_sector = g_fat_lba + (fat_offset / 512);
+        uint32_t ent_off = fat_offset % 512;
+        value &= 0x0FFF;
 
-    uint16_t val = *(uint16_t*)&g_fat_sector[ent_off];
-    if (cluster & 1) val >>= 4;
-    else val &= 0x0FFF;
+        uint8_t lo_mask = (cluster & 1) ? 0x0F : 0x00;
+        uint8_t lo = (cluster & 1) ? (uint8_t)(value << 4) : (uint8_t)value;
+        uint8_t hi_mask = (cluster & 1) ? 0x00 : 0xF0;
+        uint8_t hi = (cluster & 1) ? (uint8_t)(value >> 4) : (uint8_t)(value >> 8);
 
-    return val;
+        if (load_fat_sector(fat_sector) < 0) return -1;
+        g_fat_sector[ent_off] = (uint8_t)((g_fat_sector[ent_off] & lo_mask) | lo);
+        if (fat_touch(fat_sector) < 0) return -1;
+
+        uint32_t hi_off = ent_off + 1;
+        if (ent_off == 511) {
+            fat_sector++;
+            if (load_fat_sector(fat_sector) < 0) return -1;
+            hi_off = 0;
+        }
+        g_fat_sector[hi_off] = (uint8_t)((g_fat_sector[hi_off] & hi_mask) | hi);
+        return fat_touch(fat_sector);
+    }
+
+    uint32_t width = (g_fat_type == 16) ? 2 : 4;
+    uint32_t fat_offset = cluster * width;
+    uint32_t fat_sector = g_fat_lba + fat_offset / 512;
+    if (load_fat_sector(fat_sector) < 0) return -1;
+
+    uint32_t ent_off = fat_offset % 512;
+    if (width == 2) {
+        *(uint16_t*)&g_fat_sector[ent_off] = (uint16_t)value;
+    } else {
+        uint32_t* ent = (uint32_t*)&g_fat_sector[ent_off];
+        *ent = (*ent & 0xF0000000u) | (value & 0x0FFFFFFFu);
+    }
+    return fat_touch(fat_sector);
 }
 
-static int find_root_entry(const char* name, dirent83_t* out_ent) {
-    char want[11];
-    to_83(name, want);
+static inline int map_test(uint32_t c) { return (g_used_map[c >> 5] >> (c & 31)) & 1u; }
+static inline void map_set(uint32_t c) { g_used_map[c >> 5] |= (1u << (c & 31)); }
+static inline void map_clear(uint32_t c) { g_used_map[c >> 5] &= ~(1u << (c & 31)); }
 
-    for (uint32_t s = 0; s < g_root_sectors; s++) {
-        if (ata_read28(g_root_lba + s, 1, g_sector) < 0) return -1;
+static int build_free_map(void) {
+    uint32_t words = (g_cluster_count + 2 + 31) / 32;
 
-        dirent83_t* ents = (dirent83_t*)g_sector;
-        for (int i = 0; i < 16; i++) {
-            dirent83_t* e = &ents[i];
-            if ((uint8_t)e->name[0] == 0x00) return -1;
-            if ((uint8_t)e->name[0] == 0xE5) continue;
-            if (e->attr == 0x0F) continue;
-            if (e->attr & 0x08) continue;
+    if (g_used_map) kfree(g_used_map);
+    g_used_map = (uint32_t*)kmalloc(words * 4);
+    if (!g_used_map) return -1;
 
-            int ok = 1;
-            for (int j = 0; j < 8; j++) if (e->name[j] != want[j]) ok = 0;
-            for (int j = 0; j < 3; j++) if (e->ext[j] != want[8 + j]) ok = 0;
-            if (!ok) continue;
+    for (uint32_t i = 0; i < words; i++) g_used_map[i] = 0;
+    map_set(0);
+    map_set(1);
+    for (uint32_t c = g_cluster_count + 2; c < words * 32; c++) map_set(c);
 
-            *out_ent = *e;
+    g_free_clusters = 0;
+    for (uint32_t c = 2; c < g_cluster_count + 2; c++) {
+        uint32_t v = fat_next_cluster(c);
+        if (v == 0xFFFFFFFFu) {
+            kfree(g_used_map);
+            g_used_map = 0;
+            return -1;
+        }
+        if (v != 0) map_set(c);
+        else g_free_clusters++;
+    }
+
+    return 0;
+}
+
+// Length of the free run starting at `start`, capped at `max`.
+static uint32_t free_run(uint32_t start, uint32_t max) {
+    uint32_t n = 0;
+    while (n < max && cluster_valid(start + n) && !map_test(start + n)) n++;
+    return n;
+}
+
+// Picks up to `want` free clusters as one extent. The run right after `hint`
+// (a file's current last cluster) is preferred so growing files stay
+// contiguous; otherwise the first run that fits the whole request, or the
+// longest run seen. Fully used bitmap words are skipped 32 clusters at a time.
+static uint32_t find_extent(uint32_t hint, uint32_t want, uint32_t* got) {
+    *got = 0;
+    if (g_free_clusters == 0 || want == 0) return 0;
+
+    if (cluster_valid(hint + 1)) {
+        uint32_t n = free_run(hint + 1, want);
+        if (n > 0) {
+            *got = n;
+            return hint + 1;
+        }
+    }
+
+    uint32_t best = 0;
+    uint32_t best_len = 0;
+    uint32_t c = 2;
+    uint32_t end = g_cluster_count + 2;
+
+    while (c < end) {
+        if ((c & 31) == 0 && g_used_map[c >> 5] == 0xFFFFFFFFu) {
+            c += 32;
+            continue;
+        }
+        if (map_test(c)) {
+            c++;
+            continue;
+        }
+
+        uint32_t n = free_run(c, want);
+        if (n == want) {
+            *got = n;
+            return c;
+        }
+        if (n > best_len) {
+            best = c;
+            best_len = n;
+        }
+        c += n;
+    }
+
+    *got = best_len;
+    return best;
+}
+
+// Allocates `count` clusters linked after `last` (0 = start a new chain).
+// Returns the first new cluster, or 0 when the volume is full.
+static uint32_t alloc_chain(uint32_t last, uint32_t count) {
+    uint32_t first = 0;
+
+    while (count > 0) {
+        uint32_t len = 0;
+        uint32_t start = find_extent(last ? last : g_fsinfo_next, count, &len);
+        if (!start || len == 0) return 0;
+
+        for (uint32_t i = 0; i < len; i++) {
+            uint32_t c = start + i;
+            map_set(c);
+            if (fat_set(c, (i + 1 < len) ? c + 1 : fat_eoc()) < 0) return 0;
+        }
+        if (last && fat_set(last, start) < 0) return 0;
+
+        if (!first) first = start;
+        g_free_clusters -= len;
+        g_fsinfo_next = start + len - 1;
+        g_meta_dirty = 1;
+        last = start + len - 1;
+        count -= len;
+    }
+
+    return first;
+}
+
+static int free_chain(uint32_t cluster) {
+    while (cluster_valid(cluster)) {
+        uint32_t next = fat_next_cluster(cluster);
+        if (next == 0xFFFFFFFFu) return -1;
+        if (fat_set(cluster, 0) < 0) return -1;
+        if (map_test(cluster)) {
+            map_clear(cluster);
+            g_free_clusters++;
+        }
+        cluster = next;
+    }
+    g_meta_dirty = 1;
+    return 0;
+}
+
+static int zero_cluster(uint32_t cluster) {
+    uint32_t lba = cluster_lba(cluster);
+    for (uint32_t s = 0; s < g_bpb.sectors_per_cluster; s++) {
+        if (load_sector_nofill(lba + s) < 0) return -1;
+        mem_zero(g_sector, 512);
+        if (store_sector() < 0) return -1;
+    }
+    return 0;
+}
+
+static void dir_open(uint32_t dir_cluster, dir_iter_t* it) {
+    if (dir_cluster == 0 && g_fat_type == 32) dir_cluster = g_root_cluster;
+    it->cluster = dir_cluster;
+    it->sector = 0;
+    it->index = 0;
+    it->lba = NO_LBA;
+    it->slot = 0;
+}
+
+// Steps to the next raw slot and loads its sector. Returns 1 with the slot,
+// 0 when the directory has no more slots, -1 on error.
+static int dir_step(dir_iter_t* it, dirent83_t** out) {
+    if (it->index >= 16) {
+        it->index = 0;
+        it->sector++;
+    }
+
+    uint32_t lba;
+    if (it->cluster == 0) {
+        if (it->sector >= g_root_sectors) return 0;
+        lba = g_root_lba + it->sector;
+    } else {
+        if (it->sector >= g_bpb.sectors_per_cluster) {
+            uint32_t next = fat_next_cluster(it->cluster);
+            if (next == 0xFFFFFFFFu) return -1;
+            if (!cluster_valid(next)) return 0;
+            it->cluster = next;
+            it->sector = 0;
+        }
+        lba = cluster_lba(it->cluster) + it->sector;
+    }
+
+    if (load_sector(lba) < 0) return -1;
+
+    it->lba = lba;
+    it->slot = it->index;
+    *out = &((dirent83_t*)g_sector)[it->index++];
+    return 1;
+}
+
+// Returns 1 with the next live entry, 0 at the end of the directory, -1 on error.
+static int dir_next(dir_iter_t* it, dirent83_t* out) {
+    for (;;) {
+        dirent83_t* e;
+        int rc = dir_step(it, &e);
+        if (rc <= 0) return rc;
+
+        if ((uint8_t)e->name[0] == 0x00) return 0;
+        if ((uint8_t)e->name[0] == 0xE5) continue;
+        if (e->attr == ATTR_LFN) continue;
+        if (e->attr & ATTR_VOLUME_ID) continue;
+
+        *out = *e;
+        return 1;
+    }
+}
+
+// 0 when found, -1 when absent, -2 when the directory could not be read.
+static int find_in_dir(uint32_t dir_cluster, const char want[11], dirent83_t* out_ent,
+                       uint32_t* out_lba, uint32_t* out_slot) {
+    dir_iter_t it;
+    dirent83_t e;
+    dir_open(dir_cluster, &it);
+
+    int rc;
+    while ((rc = dir_next(&it, &e)) > 0) {
+        int ok = 1;
+        for (int j = 0; j < 8; j++) if (e.name[j] != want[j]) ok = 0;
+        for (int j = 0; j < 3; j++) if (e.ext[j] != want[8 + j]) ok = 0;
+        if (!ok) continue;
+
+        *out_ent = e;
+        *out_lba = it.lba;
+        *out_slot = it.slot;
+        return 0;
+    }
+
+    return rc < 0 ? -2 : -1;
+}
+
+// Finds an unused slot in a directory, growing cluster-chained directories
+// by one zeroed cluster when every slot is taken.
+static int dir_find_free(uint32_t dir_cluster, uint32_t* out_lba, uint32_t* out_slot) {
+    dir_iter_t it;
+    dirent83_t* e;
+    dir_open(dir_cluster, &it);
+
+    uint32_t last = it.cluster;
+    int rc;
+    while ((rc = dir_step(&it, &e)) > 0) {
+        last = it.cluster;
+        uint8_t c0 = (uint8_t)e->name[0];
+        if (c0 == 0x00 || c0 == 0xE5) {
+            *out_lba = it.lba;
+            *out_slot = it.slot;
             return 0;
         }
     }
+    if (rc < 0 || last == 0 || !g_used_map) return -1;
+
+    // The link to the new cluster stays held until the caller's barrier, so
+    // the zeroed cluster reaches the disk before the FAT points at it.
+    uint32_t added = alloc_chain(last, 1);
+    if (!added) return -1;
+    if (zero_cluster(added) < 0) return -1;
+
+    *out_lba = cluster_lba(added);
+    *out_slot = 0;
+    return 0;
+}
+
 
-    return -1;
+static int write_fsinfo(void) {
+    if (g_fat_type != 32 || g_fsinfo_sector == 0) return 0;
+    if (load_sector(g_fsinfo_sector) < 0) return -1;
+
+    *(uint32_t*)&g_sector[488] = g_free_clusters;
+    *(uint32_t*)&g_sector[492] = cluster_valid(g_fsinfo_next) ? g_fsinfo_next : FSINFO_UNKNOWN;
+    return store_sector();
 }
 
-int fs_init(void) {
+static int read_fsinfo(uint16_t sector) {
+    g_fsinfo_sector = 0;
+    g_fsinfo_free = FSINFO_UNKNOWN;
+    g_fsinfo_next = FSINFO_UNKNOWN;
+    if (sector == 0 || sector == 0xFFFF || sector >= g_bpb.reserved_sectors) return -1;
+    if (load_sector(sector) < 0) return -1;
+
+    if (*(uint32_t*)&g_sector[0] != FSINFO_LEAD_SIG) return -1;
+    if (*(uint32_t*)&g_sector[484] != FSINFO_STRUCT_SIG) return -1;
+
+    uint32_t free_count = *(uint32_t*)&g_sector[488];
+    uint32_t next_free = *(uint32_t*)&g_sector[492];
+    g_fsinfo_sector = sector;
+    if (free_count <= g_cluster_count) g_fsinfo_free = free_count;
+    if (cluster_valid(next_free)) g_fsinfo_next = next_free;
+    return 0;
+}
+
+int fs_init(const blkdev_t* dev) {
     g_ready = 0;
+    g_sector_lba = NO_LBA;
+    g_fat_touched_count = 0;
+    g_meta_dirty = 0;
+    g_nodes = 0;
 
-    int rc = ata_init();
-    if (rc < 0) {
-        console_puts("[fs] ata init failed\n");
-        return rc;
-    }
+    if (!dev) return -1;
+    bcache_init(dev);
 
-    if (ata_read28(0, 1, g_sector) < 0) {
+    if (load_sector(0) < 0) {
         console_puts("[fs] boot sector read failed\n");
         return -1;
     }
 
     g_bpb = *(fat_bpb_t*)g_sector;
-    if (g_bpb.bytes_per_sector != 512 || g_bpb.num_fats == 0 || g_bpb.fat_size16 == 0) {
+    fat32_ext_t ext = *(fat32_ext_t*)(g_sector + sizeof(fat_bpb_t));
+
+    uint8_t spc = g_bpb.sectors_per_cluster;
+    g_fat_size = g_bpb.fat_size16 ? g_bpb.fat_size16 : ext.fat_size32;
+    uint32_t total = g_bpb.total_sectors16 ? g_bpb.total_sectors16 : g_bpb.total_sectors32;
+
+    if (g_bpb.bytes_per_sector != 512 || g_bpb.num_fats == 0 || g_fat_size == 0 ||
+        spc == 0 || (spc & (spc - 1)) != 0 || g_bpb.reserved_sectors == 0) {
         console_puts("[fs] unsupported fat\n");
         return -1;
     }
 
     g_fat_lba = g_bpb.reserved_sectors;
-    g_fat_size = g_bpb.fat_size16;
-
     g_root_sectors = (g_bpb.root_entries * 32 + (g_bpb.bytes_per_sector - 1)) / g_bpb.bytes_per_sector;
-    g_root_lba = g_fat_lba + (g_bpb.num_fats * g_bpb.fat_size16);
+    g_root_lba = g_fat_lba + g_bpb.num_fats * g_fat_size;
     g_data_lba = g_root_lba + g_root_sectors;
+    g_cluster_bytes = (uint32_t)spc * 512;
+
+    if (total <= g_data_lba || (dev->sectors && total > dev->sectors)) {
+        console_puts("[fs] unsupported fat\n");
+        return -1;
+    }
+    g_cluster_count = (total - g_data_lba) / spc;
+
+    if (g_cluster_count < 4085) g_fat_type = 12;
+    else if (g_cluster_count < 65525) g_fat_type = 16;
+    else g_fat_type = 32;
+
+    // The FAT must be large enough to describe every data cluster.
+    uint32_t fat_bits = (g_fat_type == 12) ? 12 : (g_fat_type == 16) ? 16 : 32;
+    if (((g_cluster_count + 2) * fat_bits + 4095) / 4096 > g_fat_size) {
+        console_puts("[fs] unsupported fat\n");
+        return -1;
+    }
+
+    g_root_cluster = 0;
+    if (g_fat_type == 32) {
+        if (g_bpb.root_entries != 0 || !cluster_valid(ext.root_cluster)) {
+            console_puts("[fs] unsupported fat\n");
+            return -1;
+        }
+        g_root_cluster = ext.root_cluster;
+        read_fsinfo(ext.fs_info);
+    } else {
+        g_fsinfo_sector = 0;
+        g_fsinfo_free = FSINFO_UNKNOWN;
+        g_fsinfo_next = FSINFO_UNKNOWN;
+    }
+
+    if (build_free_map() < 0) {
+        console_puts("[fs] free map unavailable, mounting read-only\n");
+    }
+
+    g_root_node.vn.ops = &fat_ops;
+    g_root_node.vn.mnt = 0;
+    g_root_node.vn.type = VFS_DIR;
+    g_root_node.vn.size = 0;
+    g_root_node.vn.ino = 0;
+    g_root_node.vn.mtime = 0;
+    g_root_node.vn.refs = 0;
+    g_root_node.attr = ATTR_DIRECTORY;
+    g_root_node.first_cluster = 0;
+    g_root_node.dir_lba = NO_LBA;
+    g_root_node.dir_slot = 0;
 
     g_ready = 1;
-    console_puts("[fs] FAT12 ready\n");
+    console_puts("[fs] FAT");
+    print_u32((uint32_t)g_fat_type);
+    console_puts(" ready clusters=");
+    print_u32(g_cluster_count);
+    if (g_used_map) {
+        console_puts(" free=");
+        print_u32(g_free_clusters);
+    } else if (g_fsinfo_free != FSINFO_UNKNOWN) {
+        console_puts(" free_hint=");
+        print_u32(g_fsinfo_free);
+    }
+    console_putc('\n');
     return 0;
 }
 
-int fs_list(void) {
-    if (!g_ready) return -1;
+vnode_t* fs_root(void) {
+    return g_ready ? &g_root_node.vn : 0;
+}
 
-    for (uint32_t s = 0; s < g_root_sectors; s++) {
-        if (ata_read28(g_root_lba + s, 1, g_sector) < 0) return -1;
+static fat_node_t* node_of(vnode_t* vn) {
+    return (fat_node_t*)vn;
+}
 
-        dirent83_t* ents = (dirent83_t*)g_sector;
-        for (int i = 0; i < 16; i++) {
-            dirent83_t* e = &ents[i];
-            if ((uint8_t)e->name[0] == 0x00) return 0;
-            if ((uint8_t)e->name[0] == 0xE5) continue;
-            if (e->attr == 0x0F) continue;
-            if (e->attr & 0x08) continue;
+// Returns the live node for the entry at (lba, slot), creating it from `e`
+// if nobody holds it. The result carries a reference.
+static fat_node_t* node_get(const dirent83_t* e, uint32_t lba, uint32_t slot) {
+    // Entries pointing at cluster 0 (".." one level below the root) are the root.
+    if ((e->attr & ATTR_DIRECTORY) && entry_cluster(e) == 0) {
+        vfs_ref(&g_root_node.vn);
+        return &g_root_node;
+    }
 
-            char name[13];
-            format_name(e, name);
-            console_puts(name);
-            console_puts(" ");
-            print_u32(e->file_size);
-            console_putc('\n');
+    for (fat_node_t* n = g_nodes; n; n = n->next) {
+        if (n->dir_lba == lba && n->dir_slot == slot) {
+            vfs_ref(&n->vn);
+            return n;
         }
     }
 
+    fat_node_t* n = (fat_node_t*)kmalloc(sizeof(fat_node_t));
+    if (!n) return 0;
+
+    n->vn.ops = &fat_ops;
+    n->vn.mnt = g_root_node.vn.mnt;
+    n->vn.type = (e->attr & ATTR_DIRECTORY) ? VFS_DIR : VFS_FILE;
+    n->vn.size = (e->attr & ATTR_DIRECTORY) ? 0 : e->file_size;
+    n->vn.ino = (lba << 4) | slot;
+    n->vn.mtime = ((uint32_t)e->wrt_date << 16) | e->wrt_time;
+    n->vn.refs = 1;
+    n->attr = e->attr;
+    n->first_cluster = entry_cluster(e);
+    n->cur_cluster = n->first_cluster;
+    n->cur_index = 0;
+    n->dir_lba = lba;
+    n->dir_slot = slot;
+    n->next = g_nodes;
+    g_nodes = n;
+    return n;
+}
+
+static int node_live(uint32_t lba, uint32_t slot) {
+    for (fat_node_t* n = g_nodes; n; n = n->next) {
+        if (n->dir_lba == lba && n->dir_slot == slot) return 1;
+    }
     return 0;
 }
 
-int fs_read_file(const char* name, void* buf, uint32_t maxlen, uint32_t* out_len) {
-    if (!g_ready || !name || !buf || !out_len) return -1;
+static void fat_release(vnode_t* vn) {
+    fat_node_t* n = node_of(vn);
+    if (n == &g_root_node) return;
 
-    dirent83_t ent;
-    if (find_root_entry(name, &ent) < 0) return -1;
+    fat_node_t** link = &g_nodes;
+    while (*link && *link != n) link = &(*link)->next;
+    if (*link) *link = n->next;
+    kfree(n);
+}
 
-    uint32_t to_copy = ent.file_size;
-    if (to_copy > maxlen) to_copy = maxlen;
+// Move the cached cluster cursor to the cluster holding byte offset `pos`.
+// Walks forward from the cached position when possible, otherwise restarts
+// from the first cluster.
+static int seek_cluster(fat_node_t* f, uint32_t pos) {
+    uint32_t want = pos / g_cluster_bytes;
 
-    uint8_t* out = (uint8_t*)buf;
-    uint32_t copied = 0;
-    uint16_t cluster = ent.first_cluster_lo;
+    if (!cluster_valid(f->cur_cluster) || want < f->cur_index) {
+        f->cur_cluster = f->first_cluster;
+        f->cur_index = 0;
+    }
+
+    while (f->cur_index < want) {
+        if (!cluster_valid(f->cur_cluster)) return -1;
+        f->cur_cluster = fat_next_cluster(f->cur_cluster);
+        f->cur_index++;
+    }
+
+    if (!cluster_valid(f->cur_cluster)) return -1;
+    return 0;
+}
+
+// Now as a FAT date and time (2-second resolution), from the CMOS clock;
+// 1980-01-01 00:00 if it cannot be read or predates FAT.
+static void fat_now(uint16_t* date, uint16_t* time) {
+    rtc_time_t t;
+    if (rtc_read(&t) < 0 || t.year < 1980 || t.year > 2107) {
+        *date = FAT_DATE_1980_01_01;
+        *time = 0;
+        return;
+    }
+    *date = (uint16_t)(((t.year - 1980) << 9) | (t.month << 5) | t.day);
+    *time = (uint16_t)((t.hour << 11) | (t.minute << 5) | (t.second / 2));
+}
+
+// Called whenever the file's data changed, so it also stamps the write time
+// that vfs_stat() reports as mtime.
+static int update_dirent(fat_node_t* f) {
+    if (f->dir_lba == NO_LBA) return -1;
+    if (load_sector(f->dir_lba) < 0) return -1;
 
-    while (cluster >= 2 && cluster < 0xFF8 && copied < to_copy) {
-        uint32_t first_sector = g_data_lba + (cluster - 2) * g_bpb.sectors_per_cluster;
+    dirent83_t* e = &((dirent83_t*)g_sector)[f->dir_slot];
+    e->file_size = f->vn.size;
+    set_entry_cluster(e, f->first_cluster);
+    e->attr |= ATTR_ARCHIVE;
+    fat_now(&e->wrt_date, &e->wrt_time);
+    e->last_access_date = e->wrt_date;
+    f->vn.mtime = ((uint32_t)e->wrt_date << 16) | e->wrt_time;
+    return store_sector();
+}
 
-        for (uint8_t s = 0; s < g_bpb.sectors_per_cluster && copied < to_copy; s++) {
-            if (ata_read28(first_sector + s, 1, g_sector) < 0) return -1;
+// Makes sure the chain covers `bytes`, allocating new clusters after the
+// current tail in as few extents as possible.
+static int ensure_clusters(fat_node_t* f, uint32_t bytes) {
+    uint32_t need = clusters_for(bytes);
+    if (need == 0) return 0;
 
-            uint32_t chunk = to_copy - copied;
-            if (chunk > 512) chunk = 512;
-            for (uint32_t i = 0; i < chunk; i++) {
-                out[copied + i] = g_sector[i];
-            }
-            copied += chunk;
+    uint32_t have = 0;
+    uint32_t last = 0;
+    if (cluster_valid(f->first_cluster)) {
+        have = clusters_for(f->vn.size);
+        if (have == 0) have = 1;
+        if (seek_cluster(f, (have - 1) * g_cluster_bytes) < 0) return -1;
+        last = f->cur_cluster;
+
+        // Reuse clusters already chained past the recorded size.
+        while (have < need) {
+            uint32_t next = fat_next_cluster(last);
+            if (next == 0xFFFFFFFFu) return -1;
+            if (!cluster_valid(next)) break;
+            last = next;
+            have++;
         }
+    }
+    if (have >= need) return 0;
+    if (need - have > g_free_clusters) return -1;
 
-        cluster = fat12_next_cluster(cluster);
+    uint32_t first = alloc_chain(last, need - have);
+    if (!first) return -1;
+    if (!cluster_valid(f->first_cluster)) {
+        f->first_cluster = first;
+        f->cur_cluster = first;
+        f->cur_index = 0;
     }
+    return 0;
+}
+
+// Writes n bytes at pos; src == 0 writes zeroes.
+static int write_at(fat_node_t* f, uint32_t pos, const uint8_t* src, uint32_t n) {
+    uint32_t done = 0;
+
+    while (done < n) {
+        if (seek_cluster(f, pos) < 0) return -1;
+
+        uint32_t in_cluster = pos % g_cluster_bytes;
+        uint32_t sector = cluster_lba(f->cur_cluster) + in_cluster / 512;
+        uint32_t in_sector = in_cluster % 512;
+        uint32_t left = n - done;
+
+        if (src && in_sector == 0 && left >= 512) {
+            // Whole sectors go straight from the caller's buffer.
+            uint32_t count = left / 512;
+            uint32_t remain = (g_cluster_bytes - in_cluster) / 512;
+            if (count > remain) count = remain;
+            if (bcache_write(sector, count, src + done) < 0) return -1;
+            done += count * 512;
+            pos += count * 512;
+            continue;
+        }
+
+        uint32_t chunk = 512 - in_sector;
+        if (chunk > left) chunk = left;
+
+        int rc = (in_sector == 0 && chunk == 512) ? load_sector_nofill(sector) : load_sector(sector);
+        if (rc < 0) return -1;
+
+        if (src) mem_copy(g_sector + in_sector, src + done, chunk);
+        else mem_zero(g_sector + in_sector, chunk);
+        if (store_sector() < 0) return -1;
+
+        done += chunk;
+        pos += chunk;
+    }
+
+    return 0;
+}
+
+// VFS leaf names are at most VFS_NAME_MAX bytes; anything that does not fit
+// 8.3 would be silently truncated by to_83, so reject it instead.
+static int name_83(const char* name, char out[11]) {
+    int base = 0;
+    int ext = -1;
+    for (int i = 0; name[i]; i++) {
+        if (name[i] == '.') {
+            if (ext >= 0 || i == 0) return -1;
+            ext = 0;
+        } else if (ext >= 0) {
+            if (++ext > 3) return -1;
+        } else if (++base > 8) {
+            return -1;
+        }
+    }
+    if (base == 0) return -1;
+    to_83(name, out);
+    return 0;
+}
 
-    *out_len = copied;
+static int fat_lookup(vnode_t* dir, const char* name, vnode_t** out) {
+    char want[11];
+    if (name_83(name, want) < 0) return -1;
+
+    dirent83_t e;
+    uint32_t lba = 0;
+    uint32_t slot = 0;
+    if (find_in_dir(node_of(dir)->first_cluster, want, &e, &lba, &slot) < 0) return -1;
+
+    fat_node_t* n = node_get(&e, lba, slot);
+    if (!n) return -1;
+    *out = &n->vn;
+    return 0;
+}
+
+static int fat_create(vnode_t* dir, const char* name, vnode_t** out) {
+    if (!g_used_map) return -1;
+
+    char want[11];
+    if (name_83(name, want) < 0) return -1;
+
+    uint32_t dir_cluster = node_of(dir)->first_cluster;
+    dirent83_t e;
+    uint32_t lba = 0;
+    uint32_t slot = 0;
+    // Only a clean "absent" may create: after a read error the name could
+    // still be there.
+    if (find_in_dir(dir_cluster, want, &e, &lba, &slot) != -1) return -1;
+
+    if (dir_find_free(dir_cluster, &lba, &slot) < 0) return -1;
+    if (load_sector(lba) < 0) return -1;
+
+    dirent83_t* d = &((dirent83_t*)g_sector)[slot];
+    for (int i = 0; i < 8; i++) d->name[i] = want[i];
+    for (int i = 0; i < 3; i++) d->ext[i] = want[8 + i];
+    d->attr = ATTR_ARCHIVE;
+    d->ntres = 0;
+    d->crt_time_tenth = 0;
+    fat_now(&d->crt_date, &d->crt_time);
+    d->last_access_date = d->crt_date;
+    d->wrt_time = d->crt_time;
+    d->wrt_date = d->crt_date;
+    set_entry_cluster(d, 0);
+    d->file_size = 0;
+    e = *d;
+    if (store_sector() < 0) return -1;
+
+    bcache_barrier();
+    if (fat_commit() < 0) return -1;
+
+    fat_node_t* n = node_get(&e, lba, slot);
+    if (!n) return -1;
+    *out = &n->vn;
     return 0;
 }
+
+static int fat_unlink(vnode_t* dir, const char* name) {
+    if (!g_used_map) return -1;
+
+    char want[11];
+    if (name_83(name, want) < 0) return -1;
+
+    dirent83_t e;
+    uint32_t lba = 0;
+    uint32_t slot = 0;
+    if (find_in_dir(node_of(dir)->first_cluster, want, &e, &lba, &slot) < 0) return -1;
+    if (e.attr & (ATTR_DIRECTORY | ATTR_READ_ONLY)) return -1;
+    if (node_live(lba, slot)) return -1;
+
+    if (load_sector(lba) < 0) return -1;
+    ((dirent83_t*)g_sector)[slot].name[0] = (char)0xE5;
+    if (store_sector() < 0) return -1;
+
+    bcache_barrier();
+    if (free_chain(entry_cluster(&e)) < 0) return -1;
+    return fat_commit();
+}
+
+static int fat_readdir(vnode_t* dir, vfs_filldir_t fn, void* ctx) {
+    dir_iter_t it;
+    dirent83_t e;
+    dir_open(node_of(dir)->first_cluster, &it);
+
+    int rc;
+    while ((rc = dir_next(&it, &e)) > 0) {
+        if (e.name[0] == '.') continue;
+
+        char name[13];
+        format_name(&e, name);
+        int is_dir = (e.attr & ATTR_DIRECTORY) != 0;
+        if (fn(ctx, name, is_dir ? VFS_DIR : VFS_FILE, is_dir ? 0 : e.file_size)) return 0;
+    }
+
+    return rc;
+}
+
+static int fat_read(vnode_t* vn, uint32_t off, void* buf, uint32_t n) {
+    fat_node_t* f = node_of(vn);
+    if (off >= vn->size) return 0;
+    if (n > vn->size - off) n = vn->size - off;
+
+    uint8_t* out = (uint8_t*)buf;
+    uint32_t done = 0;
+    uint32_t pos = off;
+
+    while (done < n) {
+        if (seek_cluster(f, pos) < 0) return -1;
+
+        uint32_t in_cluster = pos % g_cluster_bytes;
+        uint32_t sector = cluster_lba(f->cur_cluster) + in_cluster / 512;
+        uint32_t in_sector = in_cluster % 512;
+        uint32_t left = n - done;
+
+        if (in_sector == 0 && left >= 512) {
+            // Whole sectors go straight into the caller's buffer.
+            uint32_t count = left / 512;
+            uint32_t remain = (g_cluster_bytes - in_cluster) / 512;
+            if (count > remain) count = remain;
+            if (bcache_read(sector, count, out + done) < 0) return -1;
+            done += count * 512;
+            pos += count * 512;
+            continue;
+        }
+
+        // A partial sector is copied straight from its cache block; g_sector
+        // is left alone for the metadata paths that rely on it.
+        const uint8_t* block = bcache_get(sector);
+        if (!block) return -1;
+
+        uint32_t chunk = 512 - in_sector;
+        if (chunk > left) chunk = left;
+        mem_copy(out + done, block + in_sector, chunk);
+        done += chunk;
+        pos += chunk;
+    }
+
+    return (int)done;
+}
+
+// A file's bytes can be handed out in place when the device is memory-backed
+// and the clusters covering [off, off + len) are consecutive.
+static const void* fat_map(vnode_t* vn, uint32_t off, uint32_t len) {
+    fat_node_t* f = node_of(vn);
+    if (len == 0 || off + len < off || off + len > vn->size) return 0;
+    if (seek_cluster(f, off) < 0) return 0;
+
+    uint32_t first = f->cur_cluster;
+    uint32_t last_index = (off + len - 1) / g_cluster_bytes;
+    uint32_t c = first;
+    for (uint32_t i = f->cur_index; i < last_index; i++) {
+        uint32_t next = fat_next_cluster(c);
+        if (next != c + 1) return 0;
+        c = next;
+    }
+
+    uint32_t in_cluster = off % g_cluster_bytes;
+    uint32_t lba = cluster_lba(first) + in_cluster / 512;
+    uint32_t count = (in_cluster % 512 + len + 511) / 512;
+    const uint8_t* p = bcache_map(lba, count);
+    return p ? p + in_cluster % 512 : 0;
+}
+
+static int fat_write(vnode_t* vn, uint32_t off, const void* buf, uint32_t n) {
+    fat_node_t* f = node_of(vn);
+    if (!g_used_map || (f->attr & ATTR_READ_ONLY)) return -1;
+    if (n == 0) return 0;
+    if (off + n < off) return -1;
+
+    if (ensure_clusters(f, off + n) < 0) {
+        fat_commit();
+        return -1;
+    }
+
+    // Writing past EOF leaves a hole that must read back as zeroes.
+    int rc = 0;
+    if (off > vn->size) rc = write_at(f, vn->size, 0, off - vn->size);
+    if (rc == 0) rc = write_at(f, off, (const uint8_t*)buf, n);
+    if (rc < 0) {
+        // Clusters already chained stay past EOF and are reused next time.
+        fat_commit();
+        return -1;
+    }
+    if (off + n > vn->size) vn->size = off + n;
+
+    // New data must be on disk before the FAT and entry that reference it.
+    bcache_barrier();
+    if (fat_commit() < 0) return -1;
+    if (update_dirent(f) < 0) return -1;
+    return (int)n;
+}
+
+static int fat_truncate(vnode_t* vn, uint32_t len) {
+    fat_node_t* f = node_of(vn);
+    if (!g_used_map || (f->attr & ATTR_READ_ONLY)) return -1;
+    if (len == vn->size) return 0;
+
+    if (len > vn->size) {
+        if (ensure_clusters(f, len) < 0) {
+            fat_commit();
+            return -1;
+        }
+        if (write_at(f, vn->size, 0, len - vn->size) < 0) {
+            fat_commit();
+            return -1;
+        }
+        vn->size = len;
+
+        bcache_barrier();
+        if (fat_commit() < 0) return -1;
+        return update_dirent(f);
+    }
+
+    uint32_t keep = clusters_for(len);
+    uint32_t old_first = f->first_cluster;
+    uint32_t tail_owner = 0;
+    if (keep > 0) {
+        if (seek_cluster(f, (keep - 1) * g_cluster_bytes) < 0) return -1;
+        tail_owner = f->cur_cluster;
+    } else {
+        f->first_cluster = 0;
+    }
+    vn->size = len;
+
+    // The entry stops covering the clusters before the FAT releases them.
+    if (update_dirent(f) < 0) return -1;
+    bcache_barrier();
+
+    if (keep == 0) {
+        if (free_chain(old_first) < 0) return -1;
+    } else {
+        uint32_t tail = fat_next_cluster(tail_owner);
+        if (tail == 0xFFFFFFFFu) return -1;
+        if (fat_set(tail_owner, fat_eoc()) < 0) return -1;
+        if (free_chain(tail) < 0) return -1;
+    }
+    f->cur_cluster = f->first_cluster;
+    f->cur_index = 0;
+    return fat_commit();
+}
+
+static const vnode_ops_t fat_ops = {
+    .flags = VFS_OPS_PAGE_CACHE,
+    .lookup = fat_lookup,
+    .create = fat_create,
+    .mkdir = 0,
+    .unlink = fat_unlink,
+    .readdir = fat_readdir,
+    .read = fat_read,
+    .write = fat_write,
+    .truncate = fat_truncate,
+    .map = fat_map,
+    .release = fat_release,
+};
+
+int fs_sync(void) {
+    if (!g_ready) return -1;
+    if (fat_commit() < 0) return -1;
+    return bcache_sync();
+}
@@ -1,6 +1,10 @@
 #pragma once
 #include <stdint.h>
+#include "vfs.h"
+#include "blkdev.h"
 
-int fs_init(void);
-int fs_list(void);
-int fs_read_file(const char* name, void* buf, uint32_t maxlen, uint32_t* out_len);
+// Mounts the FAT volume on `dev`; fs_root() is the vnode to hand to
+// vfs_mount() once this succeeds.
+int fs_init(const blkdev_t* dev);
+vnode_t* fs_root(void);
+int fs_sync(void);
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include "gdt.h"
+#include "smp.h"
 
 typedef struct {
     uint16_t limit_low;
@@ -15,35 +16,83 @@ typedef struct {
     uint32_t base;
 } __attribute__((packed)) gdt_ptr_t;
 
-static gdt_entry_t gdt[3];
-static gdt_ptr_t gp;
+// Only ss0/esp0 matter: they are the stack the CPU switches to when an
+// interrupt arrives in ring 3. The I/O bitmap offset points past the end,
+// so ring 3 has no port access.
+typedef struct {
+    uint32_t prev_tss;
+    uint32_t esp0;
+    uint32_t ss0;
+    uint32_t unused[22];
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed)) tss_t;
+
+// One table per CPU: each needs its own TSS, and loading a TSS marks its
+// descriptor busy.
+static gdt_entry_t gdt[SMP_MAX_CPUS][6];
+static gdt_ptr_t gp[SMP_MAX_CPUS];
+static tss_t tss[SMP_MAX_CPUS];
 
 extern void gdt_flush(uint32_t gp_addr);
 
-static void gdt_set_gate(int num, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
-    gdt[num].base_low  = base & 0xFFFF;
-    gdt[num].base_mid  = (base >> 16) & 0xFF;
-    gdt[num].base_high = (base >> 24) & 0xFF;
+static void gdt_set_gate(gdt_entry_t* g, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
+    g->base_low  = base & 0xFFFF;
+    g->base_mid  = (base >> 16) & 0xFF;
+    g->base_high = (base >> 24) & 0xFF;
 
-    gdt[num].limit_low = limit & 0xFFFF;
-    gdt[num].gran      = (limit >> 16) & 0x0F;
-    gdt[num].gran     |= gran & 0xF0;
+    g->limit_low = limit & 0xFFFF;
+    g->gran      = (limit >> 16) & 0x0F;
+    g->gran     |= gran & 0xF0;
 
-    gdt[num].access    = access;
+    g->access    = access;
 }
 
 void gdt_init(void) {
-    gp.limit = sizeof(gdt_entry_t) * 3 - 1;
-    gp.base  = (uint32_t)&gdt;
+    gdt_init_cpu(0);
+}
+
+// Builds and loads the calling CPU's GDT and TSS.
+void gdt_init_cpu(int cpu) {
+    gdt_entry_t* g = gdt[cpu];
+    tss_t* t = &tss[cpu];
+
+    gp[cpu].limit = sizeof(gdt_entry_t) * 6 - 1;
+    gp[cpu].base  = (uint32_t)g;
 
     // null
-    gdt_set_gate(0, 0, 0, 0, 0);
+    gdt_set_gate(&g[0], 0, 0, 0, 0);
 
     // code: base 0, limit 4GB, ring0
-    gdt_set_gate(1, 0, 0xFFFFFFFF, 0x9A, 0xCF); // 0x08
+    gdt_set_gate(&g[1], 0, 0xFFFFFFFF, 0x9A, 0xCF); // 0x08
 
     // data: base 0, limit 4GB, ring0
-    gdt_set_gate(2, 0, 0xFFFFFFFF, 0x92, 0xCF); // 0x10
+    gdt_set_gate(&g[2], 0, 0xFFFFFFFF, 0x92, 0xCF); // 0x10
+
+    // code: base 0, limit 4GB, ring3
+    gdt_set_gate(&g[3], 0, 0xFFFFFFFF, 0xFA, 0xCF); // 0x18
+
+    // data: base 0, limit 4GB, ring3
+    gdt_set_gate(&g[4], 0, 0xFFFFFFFF, 0xF2, 0xCF); // 0x20
+
+    // tss: 32-bit available, byte granular
+    uint8_t* b = (uint8_t*)t;
+    for (uint32_t i = 0; i < sizeof(tss_t); i++) b[i] = 0;
+    t->ss0 = GDT_KERNEL_DATA;
+    t->iomap_base = sizeof(tss_t);
+    gdt_set_gate(&g[5], (uint32_t)t, sizeof(tss_t) - 1, 0x89, 0x00); // 0x28
+
+    gdt_flush((uint32_t)&gp[cpu]);
+    __asm__ __volatile__("ltr %0" : : "r"((uint16_t)GDT_TSS));
+}
+
+// Kernel stack used for the next interrupt or syscall `cpu` takes in ring 3.
+void gdt_set_kernel_stack(int cpu, uint32_t esp0) {
+    tss[cpu].esp0 = esp0;
+}
 
-    gdt_flush((uint32_t)&gp);
+// Where that stack pointer lives, for entry paths that must load it
+// themselves (SYSENTER).
+uint32_t gdt_kernel_stack_slot(int cpu) {
+    return (uint32_t)&tss[cpu].esp0;
 }
\ No newline at end of file
@@ -1,2 +1,13 @@
 #pragma once
-void gdt_init(void);
\ No newline at end of file
+#include <stdint.h>
+
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_CODE   0x1B    // 0x18 | RPL 3
+#define GDT_USER_DATA   0x23    // 0x20 | RPL 3
+#define GDT_TSS         0x28
+
+void gdt_init(void);
+void gdt_init_cpu(int cpu);
+void gdt_set_kernel_stack(int cpu, uint32_t esp0);
+uint32_t gdt_kernel_stack_slot(int cpu);
@@ -1,4 +1,6 @@
 #include "idt.h"
+#include "lapic.h"
+#include "irq.h"
 
 typedef struct {
     uint16_t base_low;
@@ -20,8 +22,13 @@ extern void idt_load(uint32_t idt_ptr_addr);
 extern void isr_default_stub(void);
 extern void irq0_timer_stub(void);
 extern void irq1_keyboard_stub(void);
+extern void irq4_serial_stub(void);
 extern void syscall_stub(void);
+extern void lapic_timer_stub(void);
+extern void isr_spurious_stub(void);
+extern void lapic_wake_stub(void);
 extern uint32_t isr_stub_table[];
+extern uint8_t irq_apic_stubs[];   // IRQ_STUB_SIZE bytes per vector
 
 static void idt_set_gate(uint8_t vec, uint32_t handler, uint16_t sel, uint8_t flags) {
     idt[vec].base_low = handler & 0xFFFF;
@@ -45,9 +52,23 @@ void idt_init(void) {
 
     idt_set_gate(0x20, (uint32_t)irq0_timer_stub, 0x08, 0x8E);
     idt_set_gate(0x21, (uint32_t)irq1_keyboard_stub, 0x08, 0x8E);
+    idt_set_gate(0x24, (uint32_t)irq4_serial_stub, 0x08, 0x8E);
+
+    for (int i = 0; i < 16 * IRQ_PRIOS; i++) {
+        idt_set_gate((uint8_t)(IRQ_VECTOR_BASE + i), (uint32_t)(irq_apic_stubs + i * IRQ_STUB_SIZE), 0x08, 0x8E);
+    }
+
+    idt_set_gate(LAPIC_TIMER_VECTOR, (uint32_t)lapic_timer_stub, 0x08, 0x8E);
+    idt_set_gate(LAPIC_WAKE_VECTOR, (uint32_t)lapic_wake_stub, 0x08, 0x8E);
+    idt_set_gate(LAPIC_SPURIOUS_VECTOR, (uint32_t)isr_spurious_stub, 0x08, 0x8E);
 
     // Ring3 callable syscall gate
     idt_set_gate(0x80, (uint32_t)syscall_stub, 0x08, 0xEE);
 
     idt_load((uint32_t)&idtp);
 }
+
+// Application processors share the BSP's table.
+void idt_load_cpu(void) {
+    idt_load((uint32_t)&idtp);
+}
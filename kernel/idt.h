@@ -2,3 +2,4 @@
 #include <stdint.h>
 
 void idt_init(void);
+void idt_load_cpu(void);
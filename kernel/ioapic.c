@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include "ioapic.h"
+#include "vmm.h"
+#include "spinlock.h"
+#include "console.h"
+
+#define IOREGSEL        0x00
+#define IOWIN           0x10
+
+#define IOAPIC_VER      0x01
+#define IOAPIC_REDTBL   0x10
+
+#define RED_ACTIVE_LOW  0x00002000u
+#define RED_LEVEL       0x00008000u
+#define RED_MASKED      0x00010000u
+
+typedef struct {
+    volatile uint32_t* regs;
+    uint32_t gsi_base;
+    uint32_t pins;
+} ioapic_t;
+
+static ioapic_t g_ioapics[ACPI_MAX_IOAPICS];
+static int g_count = 0;
+static spinlock_t g_lock = SPINLOCK_INIT;
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+// Registers are reached through a select/window pair: g_lock held.
+static uint32_t rd(const ioapic_t* io, uint32_t reg) {
+    io->regs[IOREGSEL / 4] = reg;
+    return io->regs[IOWIN / 4];
+}
+
+static void wr(const ioapic_t* io, uint32_t reg, uint32_t v) {
+    io->regs[IOREGSEL / 4] = reg;
+    io->regs[IOWIN / 4] = v;
+}
+
+static const ioapic_t* find(uint32_t gsi, uint32_t* pin) {
+    for (int i = 0; i < g_count; i++) {
+        const ioapic_t* io = &g_ioapics[i];
+        if (gsi >= io->gsi_base && gsi < io->gsi_base + io->pins) {
+            *pin = gsi - io->gsi_base;
+            return io;
+        }
+    }
+    return 0;
+}
+
+// Maps every I/O APIC in the MADT and masks all of its inputs. Like
+// lapic_init(), must run before the first address space is created.
+int ioapic_init(const acpi_madt_t* madt) {
+    if (!madt) return -1;
+
+    for (uint32_t i = 0; i < madt->ioapic_count; i++) {
+        const acpi_ioapic_t* a = &madt->ioapic[i];
+        if (vmm_map_mmio(a->addr, VMM_PAGE_SIZE) < 0) continue;
+
+        ioapic_t* io = &g_ioapics[g_count++];
+        io->regs = (volatile uint32_t*)a->addr;
+        io->gsi_base = a->gsi_base;
+        io->pins = ((rd(io, IOAPIC_VER) >> 16) & 0xFF) + 1;
+        for (uint32_t pin = 0; pin < io->pins; pin++) {
+            wr(io, IOAPIC_REDTBL + pin * 2, RED_MASKED);
+            wr(io, IOAPIC_REDTBL + pin * 2 + 1, 0);
+        }
+
+        console_puts("[ioapic] gsi ");
+        print_u32(io->gsi_base);
+        console_putc('-');
+        print_u32(io->gsi_base + io->pins - 1);
+        console_putc('\n');
+    }
+    return g_count ? 0 : -1;
+}
+
+int ioapic_present(void) {
+    return g_count != 0;
+}
+
+// Fixed delivery of `gsi` as `vector` to the local APIC `apic_id`, unmasked.
+int ioapic_route(uint32_t gsi, uint8_t vector, uint8_t apic_id, int level, int active_low) {
+    uint32_t pin;
+    const ioapic_t* io = find(gsi, &pin);
+    if (!io) return -1;
+
+    uint32_t lo = vector;
+    if (level) lo |= RED_LEVEL;
+    if (active_low) lo |= RED_ACTIVE_LOW;
+
+    // Masked while the destination changes so no half-written entry fires.
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    wr(io, IOAPIC_REDTBL + pin * 2, RED_MASKED);
+    wr(io, IOAPIC_REDTBL + pin * 2 + 1, (uint32_t)apic_id << 24);
+    wr(io, IOAPIC_REDTBL + pin * 2, lo);
+    spin_unlock_irqrestore(&g_lock, flags);
+    return 0;
+}
+
+void ioapic_mask(uint32_t gsi) {
+    uint32_t pin;
+    const ioapic_t* io = find(gsi, &pin);
+    if (!io) return;
+
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    wr(io, IOAPIC_REDTBL + pin * 2, rd(io, IOAPIC_REDTBL + pin * 2) | RED_MASKED);
+    spin_unlock_irqrestore(&g_lock, flags);
+}
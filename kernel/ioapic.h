@@ -0,0 +1,8 @@
+#pragma once
+#include <stdint.h>
+#include "acpi.h"
+
+int ioapic_init(const acpi_madt_t* madt);
+int ioapic_present(void);
+int ioapic_route(uint32_t gsi, uint8_t vector, uint8_t apic_id, int level, int active_low);
+void ioapic_mask(uint32_t gsi);
@@ -0,0 +1,199 @@
+#include <stdint.h>
+#include "irq.h"
+#include "acpi.h"
+#include "ioapic.h"
+#include "lapic.h"
+#include "pic.h"
+#include "pit.h"
+#include "smp.h"
+#include "console.h"
+#include "serial.h"
+
+#define PIC_VECTOR_BASE 0x20
+#define PIT_CHECK_SPINS 50000000u
+
+// ISA IRQs start on the 8259s (remapped to 0x20-0x2F, EOI by port I/O).
+// When the MADT lists an I/O APIC, irq_init() moves them there: each IRQ
+// gets its own vector, priority class and destination CPU, the EOI is a
+// single local APIC register write, and the 8259s are masked. The BSP then
+// schedules from its local APIC timer like the other CPUs, and the PIT is
+// only the clock.
+typedef struct {
+    uint32_t gsi;
+    int level;
+    int active_low;
+    int cpu;
+    int prio;
+    int routed;
+} irq_line_t;
+
+static irq_line_t g_lines[IRQ_LEGACY_COUNT];
+static uint32_t g_counts[IRQ_LEGACY_COUNT][SMP_MAX_CPUS];
+static int g_apic = 0;
+static int g_pit_sched = 1;
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+static void print_hex8(uint8_t v) {
+    const char* hex = "0123456789ABCDEF";
+    console_puts("0x");
+    console_putc(hex[(v >> 4) & 0xF]);
+    console_putc(hex[v & 0xF]);
+}
+
+// ISA lines are edge triggered, active high, on the GSI of the same number
+// unless the MADT says otherwise. MPS flags: polarity bits 0-1 (3 = low),
+// trigger bits 2-3 (3 = level).
+static void resolve_lines(const acpi_madt_t* m) {
+    for (int i = 0; i < IRQ_LEGACY_COUNT; i++) {
+        irq_line_t* l = &g_lines[i];
+        l->gsi = (uint32_t)i;
+        l->level = 0;
+        l->active_low = 0;
+        l->cpu = 0;
+        l->prio = IRQ_PRIO_NORMAL;
+        l->routed = 0;
+    }
+    for (uint32_t i = 0; i < m->override_count; i++) {
+        const acpi_override_t* o = &m->override[i];
+        if (o->irq >= IRQ_LEGACY_COUNT) continue;
+
+        irq_line_t* l = &g_lines[o->irq];
+        l->gsi = o->gsi;
+        l->active_low = (o->flags & 3) == 3;
+        l->level = ((o->flags >> 2) & 3) == 3;
+    }
+}
+
+static uint8_t vector_of(int irq, int prio) {
+    return (uint8_t)(IRQ_VECTOR_BASE + 16 * prio + irq);
+}
+
+static int pit_ticking(void) {
+    uint32_t t = pit_get_ticks();
+    for (uint32_t i = 0; i < PIT_CHECK_SPINS && pit_get_ticks() == t; i++) {
+        __asm__ __volatile__("pause");
+    }
+    return pit_get_ticks() != t;
+}
+
+// Called on the BSP with interrupts on, once the other CPUs are up.
+void irq_init(void) {
+    const acpi_madt_t* m = acpi_madt();
+    if (!m || !lapic_present() || !ioapic_present()) {
+        console_puts("[irq] 8259 PIC routing\n");
+        return;
+    }
+
+    resolve_lines(m);
+    g_lines[0].prio = IRQ_PRIO_HIGH;   // the clock
+    g_apic = 1;
+
+    uint32_t flags;
+    __asm__ __volatile__("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    int ok = irq_route(0, 0, g_lines[0].prio) == 0 && irq_route(1, 0, g_lines[1].prio) == 0;
+    if (ok && serial_present()) ok = irq_route(SERIAL_IRQ, 0, IRQ_PRIO_LOW) == 0;
+    if (ok) pic_set_mask(0xFFFF);
+    // Whatever COM1 raised while it was on the 8259 would never reach an
+    // edge-triggered I/O APIC input: serve it now so the line drops.
+    serial_irq();
+    if (flags & 0x200) __asm__ __volatile__("sti");
+
+    // Firmware that lists an I/O APIC the PIT is not wired to: go back.
+    if (!ok || !pit_ticking()) {
+        ioapic_mask(g_lines[0].gsi);
+        ioapic_mask(g_lines[1].gsi);
+        ioapic_mask(g_lines[SERIAL_IRQ].gsi);
+        g_apic = 0;
+        pic_set_mask(PIC_MASK_BOOT);
+        console_puts("[irq] I/O APIC routing failed, back to 8259 PIC\n");
+        return;
+    }
+
+    lapic_timer_calibrate(pit_get_hz());
+    if (lapic_timer_start() == 0) g_pit_sched = 0;
+
+    console_puts("[irq] I/O APIC routing, PIC masked\n");
+}
+
+int irq_apic_mode(void) {
+    return g_apic;
+}
+
+// Whether PIT ticks drive the scheduler on the CPU they arrive at; once the
+// BSP has a local APIC timer they only advance the clock.
+int irq_pit_schedules(void) {
+    return g_pit_sched;
+}
+
+// The ISA IRQ a vector belongs to, or -1.
+int irq_from_vector(uint32_t vector) {
+    if (g_apic) {
+        if (vector < IRQ_VECTOR_BASE || vector >= IRQ_VECTOR_BASE + 16 * IRQ_PRIOS) return -1;
+        return (int)((vector - IRQ_VECTOR_BASE) % 16);
+    }
+    if (vector < PIC_VECTOR_BASE || vector >= PIC_VECTOR_BASE + IRQ_LEGACY_COUNT) return -1;
+    return (int)(vector - PIC_VECTOR_BASE);
+}
+
+void irq_eoi(int irq) {
+    g_counts[irq][cpu_this()->index]++;
+    if (g_apic) lapic_eoi();
+    else pic_send_eoi((uint8_t)irq);
+}
+
+// Sends `irq` to CPU `cpu` at priority `prio` (I/O APIC routing only).
+int irq_route(int irq, int cpu, int prio) {
+    if (!g_apic || irq < 0 || irq >= IRQ_LEGACY_COUNT) return -1;
+    if (cpu < 0 || cpu >= smp_cpu_count() || prio < 0 || prio >= IRQ_PRIOS) return -1;
+
+    irq_line_t* l = &g_lines[irq];
+    if (ioapic_route(l->gsi, vector_of(irq, prio), (uint8_t)cpu_get(cpu)->apic_id, l->level, l->active_low) < 0) return -1;
+
+    l->cpu = cpu;
+    l->prio = prio;
+    l->routed = 1;
+    return 0;
+}
+
+void irq_dump(void) {
+    console_puts(g_apic ? "[irq] mode=ioapic\n" : "[irq] mode=pic\n");
+    for (int i = 0; i < IRQ_LEGACY_COUNT; i++) {
+        const irq_line_t* l = &g_lines[i];
+        uint32_t total = 0;
+        for (int c = 0; c < SMP_MAX_CPUS; c++) total += g_counts[i][c];
+        if (!total && !(g_apic && l->routed)) continue;
+
+        console_puts("irq=");
+        print_u32((uint32_t)i);
+        if (g_apic) {
+            console_puts(" gsi=");
+            print_u32(l->gsi);
+            console_puts(" vector=");
+            print_hex8(vector_of(i, l->prio));
+            console_puts(" prio=");
+            print_u32((uint32_t)l->prio);
+            console_puts(" cpu=");
+            print_u32((uint32_t)l->cpu);
+        }
+        console_puts(" count=");
+        print_u32(total);
+        for (int c = 0; c < smp_cpu_count(); c++) {
+            console_puts(c == 0 ? " [" : " ");
+            print_u32(g_counts[i][c]);
+        }
+        console_puts("]\n");
+    }
+}
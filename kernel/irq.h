@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+
+#define IRQ_LEGACY_COUNT 16
+
+// With I/O APIC routing, ISA IRQ n of priority p arrives on vector
+// IRQ_VECTOR_BASE + 16 * p + n; the local APIC delivers higher vectors
+// (priority classes) first when several are pending.
+#define IRQ_VECTOR_BASE  0x40
+#define IRQ_PRIO_LOW     0
+#define IRQ_PRIO_NORMAL  1
+#define IRQ_PRIO_HIGH    2
+#define IRQ_PRIOS        3
+#define IRQ_STUB_SIZE    16     // boot/isr.asm irq_apic_stubs
+
+void irq_init(void);
+int irq_apic_mode(void);
+int irq_pit_schedules(void);
+int irq_from_vector(uint32_t vector);
+void irq_eoi(int irq);
+int irq_route(int irq, int cpu, int prio);
+void irq_dump(void);
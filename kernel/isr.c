@@ -1,12 +1,17 @@
 #include <stdint.h>
 #include "isr.h"
 #include "port.h"
-#include "pic.h"
 #include "console.h"
 #include "pit.h"
 #include "keyboard.h"
 #include "panic.h"
 #include "syscall.h"
+#include "vmm.h"
+#include "proc.h"
+#include "lapic.h"
+#include "irq.h"
+#include "ring.h"
+#include "serial.h"
 
 volatile uint32_t g_ticks = 0;
 
@@ -18,6 +23,20 @@ static void print_hex32(uint32_t v) {
     }
 }
 
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
 static const char* exception_name(uint32_t vec) {
     static const char* names[32] = {
         "Divide Error", "Debug", "NMI", "Breakpoint", "Overflow", "BOUND", "Invalid Opcode", "Device Not Available",
@@ -35,6 +54,31 @@ void isr_default_handler_c(void) {
 }
 
 void isr_exception_handler_c(interrupt_frame_t* frame) {
+    uint32_t cr2 = 0;
+    if (frame->vector == 14) {
+        __asm__ __volatile__("mov %%cr2, %0" : "=r"(cr2));
+        uint32_t err = frame->error;
+        if (!(frame->eflags & 0x200)) err |= VMM_FAULT_NOSLEEP;
+        if (vmm_handle_fault(cr2, err) == 0) return;
+    }
+
+    // A fault in ring 3 ends the process, not the kernel.
+    proc_t* p = proc_current();
+    if ((frame->cs & 3) == 3 && p) {
+        console_puts("\n[proc] pid ");
+        print_u32(p->pid);
+        console_puts(" killed: ");
+        console_puts(exception_name(frame->vector));
+        console_puts(" eip=");
+        print_hex32(frame->eip);
+        if (frame->vector == 14) {
+            console_puts(" cr2=");
+            print_hex32(cr2);
+        }
+        console_putc('\n');
+        proc_exit(-1);
+    }
+
     console_puts("\n[exc] vector=");
     print_hex32(frame->vector);
     console_puts(" (");
@@ -43,6 +87,10 @@ void isr_exception_handler_c(interrupt_frame_t* frame) {
     print_hex32(frame->error);
     console_puts(" eip=");
     print_hex32(frame->eip);
+    if (frame->vector == 14) {
+        console_puts(" cr2=");
+        print_hex32(cr2);
+    }
     console_putc('\n');
 
     if (frame->vector == 3) {
@@ -54,25 +102,53 @@ void isr_exception_handler_c(interrupt_frame_t* frame) {
 
 void irq_handler_c(interrupt_frame_t* frame) {
     uint32_t vec = frame->vector;
-    if (vec == 0x20) {
+    if (vec == LAPIC_TIMER_VECTOR) {
+        lapic_eoi();
+        proc_tick((frame->cs & 3) == 3);
+        return;
+    }
+
+    // Only brings a halted CPU out of hlt.
+    if (vec == LAPIC_WAKE_VECTOR) {
+        lapic_eoi();
+        return;
+    }
+
+    int irq = irq_from_vector(vec);
+    if (irq == 0) {
         pit_irq_tick();
-        pic_send_eoi(0);
+        ring_tick();
+        irq_eoi(0);
+        if (irq_pit_schedules()) proc_tick((frame->cs & 3) == 3);
         return;
     }
 
-    if (vec == 0x21) {
+    if (irq == 1) {
         uint8_t sc = inb(0x60);
         keyboard_handler(sc);
-        pic_send_eoi(1);
+        irq_eoi(1);
+        if ((frame->cs & 3) == 3) proc_preempt();   // run a woken reader now
         return;
     }
 
-    if (vec >= 0x20 && vec <= 0x2F) {
-        pic_send_eoi((uint8_t)(vec - 0x20));
+    if (irq == SERIAL_IRQ) {
+        serial_irq();
+        irq_eoi(SERIAL_IRQ);
+        if ((frame->cs & 3) == 3) proc_preempt();
+        return;
     }
+
+    if (irq >= 0) irq_eoi(irq);
 }
 
 void syscall_handler_c(interrupt_frame_t* frame) {
     uint32_t ret = syscall_dispatch(frame->eax, frame->ebx, frame->ecx, frame->edx);
     frame->eax = ret;
+    proc_preempt();
+}
+
+uint32_t sysenter_handler_c(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3) {
+    uint32_t ret = syscall_dispatch(num, a1, a2, a3);
+    proc_preempt();
+    return ret;
 }
@@ -2,6 +2,7 @@
 #include <stdint.h>
 
 typedef struct interrupt_frame {
+    uint32_t ds;
     uint32_t edi;
     uint32_t esi;
     uint32_t ebp;
@@ -15,9 +16,12 @@ typedef struct interrupt_frame {
     uint32_t eip;
     uint32_t cs;
     uint32_t eflags;
+    uint32_t user_esp;  // only present when entered from ring 3
+    uint32_t user_ss;
 } interrupt_frame_t;
 
 void isr_exception_handler_c(interrupt_frame_t* frame);
 void irq_handler_c(interrupt_frame_t* frame);
 void isr_default_handler_c(void);
 void syscall_handler_c(interrupt_frame_t* frame);
+uint32_t sysenter_handler_c(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3);
@@ -0,0 +1,273 @@
+#include <stdint.h>
+#include "job.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "console.h"
+
+#define JOB_DEQUE_SIZE  64
+#define JOB_HELP_DEPTH  2      // nested steals while joining; bounds stack use
+#define JOB_ZERO_GRAIN  (16 * 1024)
+#define JOB_SUM_CHUNK   (16 * 1024)
+#define JOB_SUM_PARTS   64
+#define ADLER_MOD       65521
+#define ADLER_NMAX      5552   // bytes before the sums can overflow 32 bits
+
+// Fork/join over index ranges. Every CPU is a worker with its own deque. A
+// range larger than its grain is split in half: the upper half is pushed on
+// the worker's deque and the lower half is run at once, recursively. When
+// the lower half is done the worker pops the upper half back unless another
+// worker stole it meanwhile, in which case it helps with other stolen work
+// until the thief finishes. The owner works at the bottom of its deque,
+// thieves take from the top, so thieves get the largest pending halves.
+//
+// The CPU calling parallel_for() is always a worker, so a uniprocessor boot
+// runs the same code with one worker. Other CPUs steal from their idle
+// loop; they are woken when a parallel_for() starts and keep looking while
+// any is in flight.
+typedef struct {
+    job_fn_t fn;
+    void* arg;
+    uint32_t grain;
+} pfor_t;
+
+typedef struct {
+    const pfor_t* pf;
+    uint32_t begin;
+    uint32_t end;
+    volatile int done;
+} job_t;
+
+typedef struct {
+    spinlock_t lock;
+    job_t* slot[JOB_DEQUE_SIZE];
+    uint32_t top;          // next to steal
+    uint32_t bottom;       // next free slot
+    int help_depth;
+    uint32_t ranges;       // ranges run by this worker
+    uint32_t steals;       // ranges it took from another worker
+} worker_t;
+
+static worker_t g_workers[SMP_MAX_CPUS];
+static int g_ready = 0;
+static volatile int g_active = 0;
+static uint32_t g_calls = 0;
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+static int push(worker_t* w, job_t* j) {
+    uint32_t flags = spin_lock_irqsave(&w->lock);
+    int ok = w->bottom - w->top < JOB_DEQUE_SIZE;
+    if (ok) w->slot[w->bottom++ % JOB_DEQUE_SIZE] = j;
+    spin_unlock_irqrestore(&w->lock, flags);
+    return ok ? 0 : -1;
+}
+
+// Takes `j` back if it is still the newest entry, i.e. nobody stole it.
+// Everything pushed after it has been popped or stolen by now, and thieves
+// take the oldest entries first.
+static int pop(worker_t* w, job_t* j) {
+    uint32_t flags = spin_lock_irqsave(&w->lock);
+    int ok = w->bottom != w->top && w->slot[(w->bottom - 1) % JOB_DEQUE_SIZE] == j;
+    if (ok) w->bottom--;
+    spin_unlock_irqrestore(&w->lock, flags);
+    return ok;
+}
+
+static job_t* steal(worker_t* self) {
+    int n = smp_cpu_count();
+    int me = (int)(self - g_workers);
+    for (int k = 1; k < n; k++) {
+        worker_t* v = &g_workers[(me + k) % n];
+        if (v->bottom == v->top) continue;
+
+        job_t* j = 0;
+        uint32_t flags = spin_lock_irqsave(&v->lock);
+        if (v->bottom != v->top) j = v->slot[v->top++ % JOB_DEQUE_SIZE];
+        spin_unlock_irqrestore(&v->lock, flags);
+        if (j) {
+            self->steals++;
+            return j;
+        }
+    }
+    return 0;
+}
+
+static void run_job(worker_t* w, job_t* j);
+
+// Waits for a stolen half, running other stolen work in the meantime.
+static void join(worker_t* w, job_t* j) {
+    while (!__atomic_load_n(&j->done, __ATOMIC_ACQUIRE)) {
+        job_t* other = w->help_depth < JOB_HELP_DEPTH ? steal(w) : 0;
+        if (!other) {
+            __asm__ __volatile__("pause");
+            continue;
+        }
+        w->help_depth++;
+        run_job(w, other);
+        w->help_depth--;
+    }
+}
+
+static void run_range(worker_t* w, const pfor_t* pf, uint32_t begin, uint32_t end) {
+    while (end - begin > pf->grain) {
+        job_t upper = { pf, begin + (end - begin) / 2, end, 0 };
+        if (push(w, &upper) < 0) break;
+
+        run_range(w, pf, begin, upper.begin);
+        if (!pop(w, &upper)) {
+            join(w, &upper);
+            return;
+        }
+        begin = upper.begin;
+    }
+    pf->fn(pf->arg, begin, end);
+    w->ranges++;
+}
+
+static void run_job(worker_t* w, job_t* j) {
+    run_range(w, j->pf, j->begin, j->end);
+    __atomic_store_n(&j->done, 1, __ATOMIC_RELEASE);
+}
+
+// Once the CPUs are up. Until then parallel_for() runs ranges inline.
+void job_init(void) {
+    for (int i = 0; i < SMP_MAX_CPUS; i++) {
+        worker_t* w = &g_workers[i];
+        w->lock = (spinlock_t)SPINLOCK_INIT;
+        w->top = w->bottom = 0;
+        w->help_depth = 0;
+        w->ranges = w->steals = 0;
+    }
+    g_ready = 1;
+
+    console_puts("[job] workers=");
+    print_u32((uint32_t)smp_cpu_count());
+    console_putc('\n');
+}
+
+// Runs fn over [begin, end) in pieces of at most `grain` indices, spread
+// over every CPU that is idle, and returns once all of them are done.
+void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, job_fn_t fn, void* arg) {
+    if (begin >= end) return;
+    if (grain == 0) grain = 1;
+    if (!g_ready || end - begin <= grain) {
+        fn(arg, begin, end);
+        return;
+    }
+
+    pfor_t pf = { fn, arg, grain };
+    worker_t* w = &g_workers[cpu_this()->index];
+
+    __atomic_fetch_add(&g_calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_active, 1, __ATOMIC_RELEASE);
+    smp_wake_idle();
+    run_range(w, &pf, begin, end);
+    __atomic_fetch_sub(&g_active, 1, __ATOMIC_RELEASE);
+}
+
+// Idle loop of the other CPUs.
+void job_poll(void) {
+    if (!g_ready) return;
+
+    worker_t* w = &g_workers[cpu_this()->index];
+    while (__atomic_load_n(&g_active, __ATOMIC_ACQUIRE)) {
+        job_t* j = steal(w);
+        if (j) run_job(w, j);
+        else __asm__ __volatile__("pause");
+    }
+}
+
+void job_dump(void) {
+    console_puts("[job] workers=");
+    print_u32((uint32_t)smp_cpu_count());
+    console_puts(" calls=");
+    print_u32(g_calls);
+    console_putc('\n');
+
+    for (int i = 0; i < smp_cpu_count(); i++) {
+        console_puts("worker=");
+        print_u32((uint32_t)i);
+        console_puts(" ranges=");
+        print_u32(g_workers[i].ranges);
+        console_puts(" steals=");
+        print_u32(g_workers[i].steals);
+        console_putc('\n');
+    }
+}
+
+static void zero_range(void* arg, uint32_t begin, uint32_t end) {
+    uint8_t* p = (uint8_t*)arg;
+    for (uint32_t i = begin; i < end; i++) p[i] = 0;
+}
+
+void job_zero(void* dst, uint32_t n) {
+    parallel_for(0, n, JOB_ZERO_GRAIN, zero_range, dst);
+}
+
+typedef struct {
+    const uint8_t* buf;
+    uint32_t n;
+    uint32_t chunk;
+    uint32_t a[JOB_SUM_PARTS];
+    uint32_t b[JOB_SUM_PARTS];
+} adler_t;
+
+// Adler-32 sums of each part taken from a = 0, b = 0; job_adler32() chains
+// them, so the parts can be summed in any order.
+static void adler_parts(void* arg, uint32_t begin, uint32_t end) {
+    adler_t* s = (adler_t*)arg;
+    for (uint32_t i = begin; i < end; i++) {
+        const uint8_t* p = s->buf + i * s->chunk;
+        uint32_t left = s->n - i * s->chunk;
+        if (left > s->chunk) left = s->chunk;
+
+        uint32_t a = 0, b = 0;
+        while (left) {
+            uint32_t k = left < ADLER_NMAX ? left : ADLER_NMAX;
+            left -= k;
+            while (k--) {
+                a += *p++;
+                b += a;
+            }
+            a %= ADLER_MOD;
+            b %= ADLER_MOD;
+        }
+        s->a[i] = a;
+        s->b[i] = b;
+    }
+}
+
+// Continues the Adler-32 checksum `adler` (1 for an empty message) over
+// `buf`, as zlib's adler32() does.
+uint32_t job_adler32(uint32_t adler, const void* buf, uint32_t n) {
+    adler_t s;
+    s.buf = (const uint8_t*)buf;
+    s.n = n;
+    s.chunk = JOB_SUM_CHUNK;
+    if (n / s.chunk >= JOB_SUM_PARTS) s.chunk = n / JOB_SUM_PARTS + 1;
+    uint32_t parts = (n + s.chunk - 1) / s.chunk;
+
+    parallel_for(0, parts, 1, adler_parts, &s);
+
+    // Appending L bytes to (a0, b0) gives (a0 + a, b0 + L * a0 + b).
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    for (uint32_t i = 0; i < parts; i++) {
+        uint32_t len = (i + 1 < parts) ? s.chunk : n - i * s.chunk;
+        b = (b + (len % ADLER_MOD) * a + s.b[i]) % ADLER_MOD;
+        a = (a + s.a[i]) % ADLER_MOD;
+    }
+    return (b << 16) | a;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+
+// Handles indices [begin, end) of a parallel_for() range.
+typedef void (*job_fn_t)(void* arg, uint32_t begin, uint32_t end);
+
+void job_init(void);
+void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, job_fn_t fn, void* arg);
+void job_poll(void);
+void job_dump(void);
+
+void job_zero(void* dst, uint32_t n);
+uint32_t job_adler32(uint32_t adler, const void* buf, uint32_t n);
@@ -4,19 +4,39 @@
 #include "idt.h"
 #include "pic.h"
 #include "pit.h"
-#include "port.h"
 #include "shell.h"
 #include "pmm.h"
 #include "kheap.h"
 #include "fs.h"
+#include "vfs.h"
+#include "tmpfs.h"
+#include "bcache.h"
+#include "ata.h"
+#include "ramdisk.h"
+#include "vmm.h"
+#include "exec.h"
+#include "proc.h"
+#include "syscall.h"
+#include "acpi.h"
+#include "lapic.h"
+#include "smp.h"
+#include "job.h"
+#include "ioapic.h"
+#include "irq.h"
+#include "vdso.h"
+#include "serial.h"
 
 extern uint32_t end;
 
 void kmain(uint32_t mb2_info_addr) {
+    // First, so the whole boot log reaches the serial port.
+    int serial = serial_init();
     console_clear();
     console_puts("[init] Boot OK\n");
+    if (serial == 0) console_puts("[serial] COM1 115200 8N1, FIFO, IRQ4\n");
 
     gdt_init();
+    syscall_init_cpu(0);
     console_puts("[init] GDT ready\n");
 
     pic_remap(0x20, 0x28);
@@ -25,9 +45,9 @@ void kmain(uint32_t mb2_info_addr) {
     uint32_t kernel_end = (uint32_t)&end;
     pmm_init(mb2_info_addr, kernel_end);
     kheap_init();
+    if (console_init_fb(mb2_info_addr) == 0) console_puts("[con] framebuffer console\n");
 
-    outb(0x21, 0xFC);
-    outb(0xA1, 0xFF);
+    pic_set_mask(PIC_MASK_BOOT);
 
     pit_set_frequency(100);
     console_puts("[irq] PIT 100Hz\n");
@@ -36,16 +56,49 @@ void kmain(uint32_t mb2_info_addr) {
     __asm__ __volatile__("sti");
     console_puts("[irq] IDT loaded, interrupts enabled\n");
 
+    // ACPI tables are read through the identity map paging is about to
+    // narrow; the APICs must be mapped before any address space exists.
+    acpi_init(mb2_info_addr);
+    vmm_init(mb2_info_addr);
+    const acpi_madt_t* madt = acpi_madt();
+    lapic_init(madt ? madt->lapic_addr : LAPIC_DEFAULT_BASE);
+    ioapic_init(madt);
+    proc_init();
+    smp_init(mb2_info_addr);
+    irq_init();
+    job_init();
+    vdso_init();
+
     console_enable_cursor(14, 15);
 
-    if (fs_init() < 0) {
-        console_puts("[fs] init skipped (no ATA/FAT media)\n");
+    vfs_init();
+
+    // The IDE disk is preferred: what is written there survives a reboot.
+    // A rootfs module lives in RAM, so it is only the root without a disk.
+    int root_ok = ata_init() == 0 && fs_init(ata_device()) == 0;
+    if (!root_ok && ramdisk_init(mb2_info_addr) == 0) {
+        root_ok = fs_init(ramdisk_device()) == 0;
+        if (root_ok) console_puts("[fs] root is the rootfs module, writes are lost at reboot\n");
+    }
+
+    if (root_ok) {
+        vfs_mount("/", "fat", fs_root(), fs_sync);
+    } else {
+        console_puts("[fs] init skipped (no ATA/FAT media or rootfs module), root is tmpfs\n");
+        vfs_mount("/", "tmpfs", tmpfs_create_root(), 0);
+    }
+    if (vfs_mount("/tmp", "tmpfs", tmpfs_create_root(), 0) < 0) {
+        console_puts("[vfs] /tmp mount failed\n");
     }
+    exec_init();
 
     shell_init();
 
     while (1) {
         shell_tick();
-        __asm__ __volatile__("hlt");
+        vfs_lock();
+        bcache_poll();
+        vfs_unlock();
+        proc_idle();
     }
 }
@@ -1,6 +1,8 @@
 #include <stdint.h>
 #include "keyboard.h"
 #include "console.h"
+#include "spinlock.h"
+#include "wait.h"
 
 #define BUF_SIZE 128
 #define KEYQ_SIZE 64
@@ -12,62 +14,95 @@ static int line_ready = 0;
 static char keyq[KEYQ_SIZE];
 static int keyq_r = 0;
 static int keyq_w = 0;
+static spinlock_t g_keyq_lock = SPINLOCK_INIT;
+static wait_queue_t g_keyq_wait = WAIT_QUEUE_INIT;
 
 static const char keymap[128] = {
     [0x02]='1',[0x03]='2',[0x04]='3',[0x05]='4',[0x06]='5',[0x07]='6',[0x08]='7',[0x09]='8',[0x0A]='9',[0x0B]='0',
     [0x10]='q',[0x11]='w',[0x12]='e',[0x13]='r',[0x14]='t',[0x15]='y',[0x16]='u',[0x17]='i',[0x18]='o',[0x19]='p',
     [0x1E]='a',[0x1F]='s',[0x20]='d',[0x21]='f',[0x22]='g',[0x23]='h',[0x24]='j',[0x25]='k',[0x26]='l',
-    [0x2C]='z',[0x2D]='x',[0x2E]='c',[0x2F]='v',[0x30]='b',[0x31]='n',[0x32]='m',[0x34]='.',
+    [0x2C]='z',[0x2D]='x',[0x2E]='c',[0x2F]='v',[0x30]='b',[0x31]='n',[0x32]='m',[0x34]='.',[0x35]='/',
+    [0x0C]='-',
     [0x39]=' ',
     [0x1C]='\n',
     [0x0E]='\b'
 };
 
+// g_keyq_lock held.
 static void keyq_push(char c) {
     int next = (keyq_w + 1) % KEYQ_SIZE;
-    if (next == keyq_r) return;
-    keyq[keyq_w] = c;
-    keyq_w = next;
+    if (next != keyq_r) {
+        keyq[keyq_w] = c;
+        keyq_w = next;
+    }
 }
 
+// Programs on any CPU may read keys; the IRQ1 handler fills the queue.
 int keyboard_read_char(void) {
-    if (keyq_r == keyq_w) return -1;
-    char c = keyq[keyq_r];
-    keyq_r = (keyq_r + 1) % KEYQ_SIZE;
-    return (int)(unsigned char)c;
+    int c = -1;
+    uint32_t flags = spin_lock_irqsave(&g_keyq_lock);
+    if (keyq_r != keyq_w) {
+        c = (int)(unsigned char)keyq[keyq_r];
+        keyq_r = (keyq_r + 1) % KEYQ_SIZE;
+    }
+    spin_unlock_irqrestore(&g_keyq_lock, flags);
+    return c;
+}
+
+static int take_key(void* out) {
+    int c = keyboard_read_char();
+    if (c < 0) return 0;
+    *(int*)out = c;
+    return 1;
+}
+
+// Like keyboard_read_char(), but blocks up to `timeout_ticks` (WAIT_FOREVER
+// for no limit) for a key to be typed.
+int keyboard_wait_char(uint32_t timeout_ticks) {
+    int c = -1;
+    if (wait_event(&g_keyq_wait, take_key, &c, timeout_ticks) < 0) return -1;
+    return c;
 }
 
 void keyboard_handler(uint8_t sc) {
     if (sc & 0x80) return;
 
     char ch = keymap[sc];
-    if (!ch) return;
+    if (ch) keyboard_input(ch);
+}
 
+// A typed character, from the keyboard or the serial line: queued for
+// readers and applied to the shell's line. IRQ1 and IRQ4 may run on
+// different CPUs, so the line is edited under g_keyq_lock (the console lock
+// nests inside it). Waiters are woken after it is dropped: they take it
+// under the wait queue's lock.
+void keyboard_input(char ch) {
+    uint32_t flags = spin_lock_irqsave(&g_keyq_lock);
     keyq_push(ch);
 
     if (ch == '\n') {
         console_putc('\n');
         input_buf[input_len] = 0;
         line_ready = 1;
-        return;
-    }
-
-    if (ch == '\b') {
+    } else if (ch == '\b') {
         if (input_len > 0) {
             input_len--;
             console_backspace();
         }
-        return;
-    }
-
-    if (input_len < BUF_SIZE - 1) {
+    } else if (input_len < BUF_SIZE - 1) {
         input_buf[input_len++] = ch;
         console_putc(ch);
     }
+    spin_unlock_irqrestore(&g_keyq_lock, flags);
+    wait_wake(&g_keyq_wait);
 }
 
 int keyboard_getline(char* buffer, int maxlen) {
-    if (!line_ready) return 0;
+    uint32_t flags = spin_lock_irqsave(&g_keyq_lock);
+    if (!line_ready) {
+        spin_unlock_irqrestore(&g_keyq_lock, flags);
+        return 0;
+    }
 
     int n = input_len;
     if (n > maxlen - 1) n = maxlen - 1;
@@ -77,5 +112,6 @@ int keyboard_getline(char* buffer, int maxlen) {
 
     input_len = 0;
     line_ready = 0;
+    spin_unlock_irqrestore(&g_keyq_lock, flags);
     return 1;
 }
@@ -2,5 +2,7 @@
 #include <stdint.h>
 
 void keyboard_handler(uint8_t scancode);
+void keyboard_input(char ch);
 int keyboard_getline(char* buffer, int maxlen);
 int keyboard_read_char(void);
+int keyboard_wait_char(uint32_t timeout_ticks);
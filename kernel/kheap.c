@@ -2,6 +2,7 @@
 #include "kheap.h"
 #include "pmm.h"
 #include "console.h"
+#include "spinlock.h"
 
 #define PAGE_SIZE 4096
 #define ALIGN 16
@@ -17,6 +18,7 @@ typedef struct block_header {
 static block_header_t* head = 0;
 static uint32_t heap_total = 0;
 static uint32_t heap_used = 0;
+static spinlock_t g_lock = SPINLOCK_INIT;
 
 static inline uint32_t align_up(uint32_t x, uint32_t a) {
     return (x + a - 1) & ~(a - 1);
@@ -110,10 +112,7 @@ void kheap_init(void) {
     heap_extend(PAGE_SIZE);
 }
 
-void* kmalloc(uint32_t size) {
-    if (size == 0) return 0;
-    uint32_t need = align_up(size, ALIGN);
-
+static void* alloc_locked(uint32_t need) {
     for (int attempt = 0; attempt < 32; attempt++) {
         block_header_t* cur = head;
         while (cur) {
@@ -136,18 +135,28 @@ void* kmalloc(uint32_t size) {
     return 0;
 }
 
+void* kmalloc(uint32_t size) {
+    if (size == 0) return 0;
+
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    void* p = alloc_locked(align_up(size, ALIGN));
+    spin_unlock_irqrestore(&g_lock, flags);
+    return p;
+}
+
 void kfree(void* ptr) {
     if (!ptr) return;
 
     block_header_t* b = (block_header_t*)((uint8_t*)ptr - sizeof(block_header_t));
-    if (!block_valid(b)) return;
-    if (b->free) return;
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    if (block_valid(b) && !b->free) {
+        b->free = 1;
+        if (heap_used >= b->size) heap_used -= b->size;
+        else heap_used = 0;
 
-    b->free = 1;
-    if (heap_used >= b->size) heap_used -= b->size;
-    else heap_used = 0;
-
-    coalesce();
+        coalesce();
+    }
+    spin_unlock_irqrestore(&g_lock, flags);
 }
 
 uint32_t kheap_total_bytes(void) { return heap_total; }
@@ -155,12 +164,16 @@ uint32_t kheap_used_bytes(void) { return heap_used; }
 uint32_t kheap_free_bytes(void) { return (heap_total >= heap_used) ? (heap_total - heap_used) : 0; }
 
 int kheap_check(void) {
-    block_header_t* cur = head;
-    while (cur) {
-        if (!block_valid(cur)) return 0;
-        cur = cur->next;
+    int ok = 1;
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    for (block_header_t* cur = head; cur; cur = cur->next) {
+        if (!block_valid(cur)) {
+            ok = 0;
+            break;
+        }
     }
-    return 1;
+    spin_unlock_irqrestore(&g_lock, flags);
+    return ok;
 }
 
 void kheap_dump(void) {
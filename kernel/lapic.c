@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include "lapic.h"
+#include "vmm.h"
+#include "pit.h"
+#include "console.h"
+
+#define LAPIC_ID        0x020
+#define LAPIC_TPR       0x080
+#define LAPIC_EOI       0x0B0
+#define LAPIC_SVR       0x0F0
+#define LAPIC_ICR_LO    0x300
+#define LAPIC_ICR_HI    0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CUR 0x390
+#define LAPIC_TIMER_DIV 0x3E0
+
+#define ICR_INIT        0x00000500u
+#define ICR_STARTUP     0x00000600u
+#define ICR_LEVEL       0x00008000u
+#define ICR_ASSERT      0x00004000u
+#define ICR_PENDING     0x00001000u
+
+#define TIMER_PERIODIC  0x00020000u
+#define TIMER_DIV_16    0x3
+
+static volatile uint32_t* g_lapic = 0;
+static uint32_t g_timer_count = 0;
+
+static inline uint32_t rd(uint32_t reg) { return g_lapic[reg / 4]; }
+static inline void wr(uint32_t reg, uint32_t v) { g_lapic[reg / 4] = v; }
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+static int cpu_has_apic(void) {
+    uint32_t a, b, c, d;
+    __asm__ __volatile__("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(1));
+    return (d >> 9) & 1;
+}
+
+// Maps the register page (uncached) and enables the BSP's local APIC.
+// Must run before the first address space is created.
+int lapic_init(uint32_t phys) {
+    if (!phys || !cpu_has_apic()) return -1;
+    if (vmm_map_mmio(phys, VMM_PAGE_SIZE) < 0) return -1;
+
+    g_lapic = (volatile uint32_t*)phys;
+    lapic_enable();
+    return 0;
+}
+
+int lapic_present(void) {
+    return g_lapic != 0;
+}
+
+// Per CPU: software-enable with the spurious vector and accept every priority.
+void lapic_enable(void) {
+    wr(LAPIC_TPR, 0);
+    wr(LAPIC_SVR, 0x100 | LAPIC_SPURIOUS_VECTOR);
+}
+
+uint32_t lapic_id(void) {
+    return rd(LAPIC_ID) >> 24;
+}
+
+void lapic_eoi(void) {
+    wr(LAPIC_EOI, 0);
+}
+
+static void send_ipi(uint8_t apic_id, uint32_t lo) {
+    wr(LAPIC_ICR_HI, (uint32_t)apic_id << 24);
+    wr(LAPIC_ICR_LO, lo);
+    while (rd(LAPIC_ICR_LO) & ICR_PENDING) __asm__ __volatile__("pause");
+}
+
+void lapic_send_init(uint8_t apic_id) {
+    send_ipi(apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+}
+
+// The AP starts in real mode at page * 4096.
+void lapic_send_startup(uint8_t apic_id, uint32_t page) {
+    send_ipi(apic_id, ICR_STARTUP | (page & 0xFF));
+}
+
+// Fixed delivery of `vector` to one CPU.
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector) {
+    send_ipi(apic_id, vector);
+}
+
+// Counts timer decrements across PIT ticks; all CPUs share the bus clock,
+// so one measurement on the BSP serves every local APIC timer.
+void lapic_timer_calibrate(uint32_t hz) {
+    if (!g_lapic || g_timer_count) return;
+
+    const uint32_t ticks = 10;
+    wr(LAPIC_TIMER_DIV, TIMER_DIV_16);
+    wr(LAPIC_LVT_TIMER, 0x10000 | LAPIC_TIMER_VECTOR); // masked one-shot
+
+    uint32_t t = pit_get_ticks();
+    while (pit_get_ticks() == t) __asm__ __volatile__("hlt");
+
+    wr(LAPIC_TIMER_INIT, 0xFFFFFFFFu);
+    t = pit_get_ticks();
+    while (pit_get_ticks() - t < ticks) __asm__ __volatile__("hlt");
+    uint32_t elapsed = 0xFFFFFFFFu - rd(LAPIC_TIMER_CUR);
+    wr(LAPIC_TIMER_INIT, 0);
+
+    g_timer_count = elapsed / ticks * pit_get_hz() / hz;
+    console_puts("[lapic] timer count/tick=");
+    print_u32(g_timer_count);
+    console_putc('\n');
+}
+
+// Periodic LAPIC_TIMER_VECTOR at the calibrated rate on this CPU.
+int lapic_timer_start(void) {
+    if (!g_lapic || !g_timer_count) return -1;
+
+    wr(LAPIC_TIMER_DIV, TIMER_DIV_16);
+    wr(LAPIC_LVT_TIMER, TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+    wr(LAPIC_TIMER_INIT, g_timer_count);
+    return 0;
+}
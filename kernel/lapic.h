@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+#define LAPIC_DEFAULT_BASE    0xFEE00000u
+#define LAPIC_TIMER_VECTOR    0x30
+#define LAPIC_WAKE_VECTOR     0x31
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+int lapic_init(uint32_t phys);
+int lapic_present(void);
+void lapic_enable(void);
+uint32_t lapic_id(void);
+void lapic_eoi(void);
+
+void lapic_send_init(uint8_t apic_id);
+void lapic_send_startup(uint8_t apic_id, uint32_t page);
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector);
+
+void lapic_timer_calibrate(uint32_t hz);
+int lapic_timer_start(void);
@@ -3,15 +3,44 @@
 
 static inline uint32_t align8(uint32_t x) { return (x + 7) & ~7u; }
 
-const mb2_mmap_tag_t* mb2_find_mmap(uint32_t mb2_info_addr) {
+const mb2_tag_t* mb2_find_tag(uint32_t mb2_info_addr, uint32_t type) {
     const mb2_info_t* info = (const mb2_info_t*)mb2_info_addr;
 
     uint32_t off = 8; // skip total_size/reserved
     while (off < info->total_size) {
         const mb2_tag_t* tag = (const mb2_tag_t*)(mb2_info_addr + off);
         if (tag->type == MB2_TAG_END) break;
-        if (tag->type == MB2_TAG_MMAP) return (const mb2_mmap_tag_t*)tag;
+        if (tag->type == type) return tag;
+        off += align8(tag->size);
+    }
+    return 0;
+}
+
+const mb2_mmap_tag_t* mb2_find_mmap(uint32_t mb2_info_addr) {
+    return (const mb2_mmap_tag_t*)mb2_find_tag(mb2_info_addr, MB2_TAG_MMAP);
+}
+
+const mb2_framebuffer_tag_t* mb2_find_framebuffer(uint32_t mb2_info_addr) {
+    const mb2_framebuffer_tag_t* fb = (const mb2_framebuffer_tag_t*)mb2_find_tag(mb2_info_addr, MB2_TAG_FRAMEBUFFER);
+    if (!fb || fb->fb_type != MB2_FB_RGB) return 0;
+    if (fb->addr >> 32 || fb->addr + (uint64_t)fb->pitch * fb->height >= 0x100000000ull) return 0;
+    return fb;
+}
+
+const mb2_module_tag_t* mb2_next_module(uint32_t mb2_info_addr, const mb2_module_tag_t* prev) {
+    const mb2_info_t* info = (const mb2_info_t*)mb2_info_addr;
+
+    uint32_t off = 8;
+    if (prev) off = (uint32_t)prev - mb2_info_addr + align8(prev->size);
+    while (off < info->total_size) {
+        const mb2_tag_t* tag = (const mb2_tag_t*)(mb2_info_addr + off);
+        if (tag->type == MB2_TAG_END) break;
+        if (tag->type == MB2_TAG_MODULE) return (const mb2_module_tag_t*)tag;
         off += align8(tag->size);
     }
     return 0;
-}
\ No newline at end of file
+}
+
+uint32_t mb2_info_size(uint32_t mb2_info_addr) {
+    return ((const mb2_info_t*)mb2_info_addr)->total_size;
+}
@@ -2,7 +2,11 @@
 #include <stdint.h>
 
 #define MB2_TAG_END      0
+#define MB2_TAG_MODULE   3
 #define MB2_TAG_MMAP     6
+#define MB2_TAG_FRAMEBUFFER 8
+#define MB2_TAG_ACPI_OLD 14
+#define MB2_TAG_ACPI_NEW 15
 
 typedef struct {
     uint32_t total_size;
@@ -29,4 +33,40 @@ typedef struct {
     mb2_mmap_entry_t entries[];
 } mb2_mmap_tag_t;
 
-const mb2_mmap_tag_t* mb2_find_mmap(uint32_t mb2_info_addr);
\ No newline at end of file
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint32_t mod_start;
+    uint32_t mod_end;
+    char cmdline[];
+} mb2_module_tag_t;
+
+#define MB2_FB_RGB  1
+#define MB2_FB_TEXT 2
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint64_t addr;
+    uint32_t pitch;       // bytes per scanline
+    uint32_t width;
+    uint32_t height;
+    uint8_t bpp;
+    uint8_t fb_type;
+    uint16_t reserved;
+    // MB2_FB_RGB only: bit position and width of each channel.
+    uint8_t red_pos;
+    uint8_t red_size;
+    uint8_t green_pos;
+    uint8_t green_size;
+    uint8_t blue_pos;
+    uint8_t blue_size;
+} __attribute__((packed)) mb2_framebuffer_tag_t;
+
+const mb2_tag_t* mb2_find_tag(uint32_t mb2_info_addr, uint32_t type);
+const mb2_mmap_tag_t* mb2_find_mmap(uint32_t mb2_info_addr);
+// 0 unless the loader set up a linear RGB framebuffer the CPU can reach.
+const mb2_framebuffer_tag_t* mb2_find_framebuffer(uint32_t mb2_info_addr);
+// Pass prev = 0 for the first module; returns 0 after the last one.
+const mb2_module_tag_t* mb2_next_module(uint32_t mb2_info_addr, const mb2_module_tag_t* prev);
+uint32_t mb2_info_size(uint32_t mb2_info_addr);
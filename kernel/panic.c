@@ -1,5 +1,6 @@
 #include "panic.h"
 #include "console.h"
+#include "serial.h"
 
 void panic(const char* msg) {
     console_puts("\n[panic] ");
@@ -11,6 +12,7 @@ void panic(const char* msg) {
     console_putc('\n');
 
     __asm__ __volatile__("cli");
+    serial_flush();
     while (1) {
         __asm__ __volatile__("hlt");
     }
@@ -0,0 +1,276 @@
+#include <stdint.h>
+#include "pcache.h"
+#include "vfs.h"
+#include "pmm.h"
+#include "kheap.h"
+#include "console.h"
+
+#define PCACHE_HASH      256
+#define PCACHE_MAX_PAGES 2048
+
+// File pages keyed by (mount, ino, page index). The same page serves
+// vfs_read() and every mapping of the file, so file data is resident once.
+// Pages are identity-mapped PMM pages; mapped pages are pinned.
+typedef struct pc_page {
+    uint32_t mnt;
+    uint32_t ino;
+    uint32_t index;
+    uint32_t page;
+    uint32_t lru;
+    uint32_t pins;
+    struct pc_page* hnext;
+} pc_page_t;
+
+static pc_page_t* g_hash[PCACHE_HASH];
+static pc_page_t* g_orphans = 0;   // dropped while pinned, through hnext
+static uint32_t g_pages = 0;
+static uint32_t g_clock = 0;
+
+static uint32_t g_stat_hits = 0;
+static uint32_t g_stat_misses = 0;
+static uint32_t g_stat_evictions = 0;
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+static void mem_copy(uint8_t* dst, const uint8_t* src, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) dst[i] = src[i];
+}
+
+static void mem_zero(uint8_t* dst, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) dst[i] = 0;
+}
+
+static inline uint32_t mount_of(const vnode_t* vn) {
+    return vn->mnt ? vn->mnt->id : 0;
+}
+
+static inline uint32_t hash_key(uint32_t mnt, uint32_t ino, uint32_t index) {
+    return (ino * 31u + index + mnt * 7u) & (PCACHE_HASH - 1);
+}
+
+static pc_page_t* find(uint32_t mnt, uint32_t ino, uint32_t index) {
+    for (pc_page_t* p = g_hash[hash_key(mnt, ino, index)]; p; p = p->hnext) {
+        if (p->mnt == mnt && p->ino == ino && p->index == index) return p;
+    }
+    return 0;
+}
+
+static void unlink_page(pc_page_t* p) {
+    pc_page_t** link = &g_hash[hash_key(p->mnt, p->ino, p->index)];
+    while (*link && *link != p) link = &(*link)->hnext;
+    if (*link) *link = p->hnext;
+}
+
+static void free_page(pc_page_t* p) {
+    unlink_page(p);
+    pmm_free_page(p->page);
+    kfree(p);
+    g_pages--;
+}
+
+static int evict_one(void) {
+    pc_page_t* victim = 0;
+    for (int b = 0; b < PCACHE_HASH; b++) {
+        for (pc_page_t* p = g_hash[b]; p; p = p->hnext) {
+            if (p->pins) continue;
+            if (!victim || (int32_t)(p->lru - victim->lru) < 0) victim = p;
+        }
+    }
+    if (!victim) return -1;
+
+    free_page(victim);
+    g_stat_evictions++;
+    return 0;
+}
+
+void pcache_init(void) {
+    for (int i = 0; i < PCACHE_HASH; i++) g_hash[i] = 0;
+    g_orphans = 0;
+    g_pages = 0;
+    g_clock = 0;
+}
+
+uint8_t* pcache_get(vnode_t* vn, uint32_t index, int pin) {
+    uint32_t mnt = mount_of(vn);
+    pc_page_t* p = find(mnt, vn->ino, index);
+    if (p) {
+        g_stat_hits++;
+        p->lru = ++g_clock;
+        if (pin) p->pins++;
+        return (uint8_t*)p->page;
+    }
+
+    g_stat_misses++;
+    if (g_pages >= PCACHE_MAX_PAGES && evict_one() < 0) return 0;
+
+    uint32_t page = pmm_alloc_page();
+    while (!page && evict_one() == 0) page = pmm_alloc_page();
+    if (!page) return 0;
+
+    p = (pc_page_t*)kmalloc(sizeof(pc_page_t));
+    if (!p) {
+        pmm_free_page(page);
+        return 0;
+    }
+
+    uint32_t off = index * PCACHE_PAGE_SIZE;
+    uint32_t want = 0;
+    if (off < vn->size) {
+        want = vn->size - off;
+        if (want > PCACHE_PAGE_SIZE) want = PCACHE_PAGE_SIZE;
+    }
+
+    int got = want ? vn->ops->read(vn, off, (void*)page, want) : 0;
+    if (got < 0) {
+        pmm_free_page(page);
+        kfree(p);
+        return 0;
+    }
+    mem_zero((uint8_t*)page + got, PCACHE_PAGE_SIZE - (uint32_t)got);
+
+    p->mnt = mnt;
+    p->ino = vn->ino;
+    p->index = index;
+    p->page = page;
+    p->lru = ++g_clock;
+    p->pins = pin ? 1 : 0;
+
+    uint32_t h = hash_key(mnt, vn->ino, index);
+    p->hnext = g_hash[h];
+    g_hash[h] = p;
+    g_pages++;
+    return (uint8_t*)page;
+}
+
+// `page` is the copy that was pinned: the key may since belong to a new
+// file if this one was dropped.
+void pcache_unpin(vnode_t* vn, uint32_t index, const void* page) {
+    pc_page_t* p = find(mount_of(vn), vn->ino, index);
+    if (p && p->page == (uint32_t)page) {
+        if (p->pins) p->pins--;
+        return;
+    }
+
+    for (pc_page_t** link = &g_orphans; *link; link = &(*link)->hnext) {
+        p = *link;
+        if (p->page != (uint32_t)page) continue;
+        if (--p->pins == 0) {
+            *link = p->hnext;
+            pmm_free_page(p->page);
+            kfree(p);
+            g_pages--;
+        }
+        return;
+    }
+}
+
+int pcache_read(vnode_t* vn, uint32_t off, void* buf, uint32_t n) {
+    if (off >= vn->size) return 0;
+    if (n > vn->size - off) n = vn->size - off;
+
+    uint8_t* out = (uint8_t*)buf;
+    uint32_t done = 0;
+    while (done < n) {
+        uint32_t pos = off + done;
+        uint32_t in_page = pos % PCACHE_PAGE_SIZE;
+        uint32_t chunk = PCACHE_PAGE_SIZE - in_page;
+        if (chunk > n - done) chunk = n - done;
+
+        uint8_t* page = pcache_get(vn, pos / PCACHE_PAGE_SIZE, 0);
+        if (!page) return done ? (int)done : -1;
+        mem_copy(out + done, page + in_page, chunk);
+        done += chunk;
+    }
+    return (int)done;
+}
+
+// Applies bytes the backend has just written to any cached copies, so
+// readers and mappings see them without a refill.
+void pcache_update(vnode_t* vn, uint32_t off, const void* buf, uint32_t n) {
+    uint32_t mnt = mount_of(vn);
+    const uint8_t* in = (const uint8_t*)buf;
+    uint32_t done = 0;
+
+    while (done < n) {
+        uint32_t pos = off + done;
+        uint32_t in_page = pos % PCACHE_PAGE_SIZE;
+        uint32_t chunk = PCACHE_PAGE_SIZE - in_page;
+        if (chunk > n - done) chunk = n - done;
+
+        pc_page_t* p = find(mnt, vn->ino, pos / PCACHE_PAGE_SIZE);
+        if (p) mem_copy((uint8_t*)p->page + in_page, in + done, chunk);
+        done += chunk;
+    }
+}
+
+// Drops pages wholly past `len` and zeroes the tail of the last one. Pinned
+// pages past EOF are zeroed instead so existing mappings stay valid.
+void pcache_truncate(vnode_t* vn, uint32_t len) {
+    uint32_t mnt = mount_of(vn);
+    uint32_t keep = (len + PCACHE_PAGE_SIZE - 1) / PCACHE_PAGE_SIZE;
+
+    for (int b = 0; b < PCACHE_HASH; b++) {
+        pc_page_t* p = g_hash[b];
+        while (p) {
+            pc_page_t* next = p->hnext;
+            if (p->mnt == mnt && p->ino == vn->ino) {
+                if (p->index >= keep) {
+                    if (p->pins) mem_zero((uint8_t*)p->page, PCACHE_PAGE_SIZE);
+                    else free_page(p);
+                } else if (p->index == keep - 1 && (len % PCACHE_PAGE_SIZE)) {
+                    uint32_t tail = len % PCACHE_PAGE_SIZE;
+                    mem_zero((uint8_t*)p->page + tail, PCACHE_PAGE_SIZE - tail);
+                }
+            }
+            p = next;
+        }
+    }
+}
+
+// The file is gone; its ino may be reused by a new file, so none of its
+// pages may stay findable. Pages still mapped are orphaned until their last
+// pcache_unpin().
+void pcache_drop(uint32_t mount_id, uint32_t ino) {
+    for (int b = 0; b < PCACHE_HASH; b++) {
+        pc_page_t* p = g_hash[b];
+        while (p) {
+            pc_page_t* next = p->hnext;
+            if (p->mnt == mount_id && p->ino == ino) {
+                if (p->pins) {
+                    unlink_page(p);
+                    p->hnext = g_orphans;
+                    g_orphans = p;
+                } else {
+                    free_page(p);
+                }
+            }
+            p = next;
+        }
+    }
+}
+
+void pcache_dump(void) {
+    console_puts("[pc] pages=");
+    print_u32(g_pages);
+    console_putc('/');
+    print_u32(PCACHE_MAX_PAGES);
+    console_puts(" hits/misses=");
+    print_u32(g_stat_hits);
+    console_putc('/');
+    print_u32(g_stat_misses);
+    console_puts(" evictions=");
+    print_u32(g_stat_evictions);
+    console_putc('\n');
+}
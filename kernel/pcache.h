@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include "vfs.h"
+
+#define PCACHE_PAGE_SIZE 4096
+
+void pcache_init(void);
+
+// Returns the cached page holding file page `index`, reading it in on a
+// miss. Bytes past EOF read as zero. A pinned page is never evicted.
+uint8_t* pcache_get(vnode_t* vn, uint32_t index, int pin);
+void pcache_unpin(vnode_t* vn, uint32_t index, const void* page);
+
+int pcache_read(vnode_t* vn, uint32_t off, void* buf, uint32_t n);
+void pcache_update(vnode_t* vn, uint32_t off, const void* buf, uint32_t n);
+void pcache_truncate(vnode_t* vn, uint32_t len);
+void pcache_drop(uint32_t mount_id, uint32_t ino);
+
+void pcache_dump(void);
@@ -35,4 +35,10 @@ void pic_remap(int offset1, int offset2) {
 void pic_send_eoi(uint8_t irq) {
     if (irq >= 8) outb(PIC2_CMD, 0x20);
     outb(PIC1_CMD, 0x20);
-}
\ No newline at end of file
+}
+
+// Bit n masks IRQ n.
+void pic_set_mask(uint16_t mask) {
+    outb(PIC1_DATA, (uint8_t)mask);
+    outb(PIC2_DATA, (uint8_t)(mask >> 8));
+}
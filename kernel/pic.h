@@ -2,4 +2,9 @@
 #include <stdint.h>
 
 void pic_remap(int offset1, int offset2);
-void pic_send_eoi(uint8_t irq);
\ No newline at end of file
+void pic_send_eoi(uint8_t irq);
+
+// IRQ0 (PIT), IRQ1 (keyboard) and IRQ4 (COM1) only.
+#define PIC_MASK_BOOT 0xFFEC
+
+void pic_set_mask(uint16_t mask);
@@ -1,10 +1,15 @@
 #include <stdint.h>
 #include "port.h"
 #include "pit.h"
+#include "bcache.h"
+#include "wait.h"
+#include "vdso.h"
+#include "console.h"
 
 extern volatile uint32_t g_ticks;
 
 static uint32_t pit_hz = 100;
+static wait_queue_t g_sleep_q = WAIT_QUEUE_INIT;   // never woken: sleepers time out
 
 void pit_set_frequency(uint32_t hz) {
     if (hz < 19) hz = 19;
@@ -26,18 +31,20 @@ uint32_t pit_get_ticks(void) {
     return g_ticks;
 }
 
+// Rounds up, so a nonzero wait is at least one tick.
+uint32_t pit_ms_to_ticks(uint32_t ms) {
+    return ms / 1000 * pit_hz + (ms % 1000 * pit_hz + 999) / 1000;
+}
+
+// Blocks the calling task; other tasks run meanwhile.
 void pit_sleep(uint32_t ms) {
     if (ms == 0) return;
-
-    uint32_t start = g_ticks;
-    uint32_t wait_ticks = (ms * pit_hz + 999) / 1000;
-    if (wait_ticks == 0) wait_ticks = 1;
-
-    while ((g_ticks - start) < wait_ticks) {
-        __asm__ __volatile__("hlt");
-    }
+    wait_event(&g_sleep_q, 0, 0, pit_ms_to_ticks(ms));
 }
 
 void pit_irq_tick(void) {
     g_ticks++;
+    vdso_tick(g_ticks);
+    bcache_tick(g_ticks);
+    console_tick();
 }
@@ -4,5 +4,6 @@
 void pit_set_frequency(uint32_t hz);
 uint32_t pit_get_hz(void);
 uint32_t pit_get_ticks(void);
+uint32_t pit_ms_to_ticks(uint32_t ms);
 void pit_sleep(uint32_t ms);
 void pit_irq_tick(void);
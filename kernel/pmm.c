@@ -2,6 +2,8 @@
 #include "pmm.h"
 #include "mb2.h"
 #include "console.h"
+#include "spinlock.h"
+#include "job.h"
 
 #define PAGE_SIZE 4096
 #define MAX_MEM   (128 * 1024 * 1024)
@@ -12,6 +14,7 @@ static uint32_t total_pages = MAX_PAGES;
 static uint32_t free_pages = 0;
 static uint32_t first_page = 0;
 static uint32_t double_free_cnt = 0;
+static spinlock_t g_lock = SPINLOCK_INIT;
 
 static inline void set_bit(uint32_t i) { bitmap[i >> 5] |= (1u << (i & 31)); }
 static inline void clear_bit(uint32_t i) { bitmap[i >> 5] &= ~(1u << (i & 31)); }
@@ -45,17 +48,47 @@ static void mark_all_used(void) {
     free_pages = 0;
 }
 
-static void mark_range_free(uint32_t start, uint32_t end) {
-    uint32_t p0 = (start + PAGE_SIZE - 1) / PAGE_SIZE;
-    uint32_t p1 = end / PAGE_SIZE;
-    if (p1 > MAX_PAGES) p1 = MAX_PAGES;
+static uint32_t bit_count(uint32_t v) {
+    v = v - ((v >> 1) & 0x55555555u);
+    v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+    return (((v + (v >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+}
 
-    for (uint32_t p = p0; p < p1; p++) {
-        if (test_bit(p)) {
-            clear_bit(p);
-            free_pages++;
+// Bits [lo, hi) of a bitmap word.
+static uint32_t bit_span(uint32_t lo, uint32_t hi) {
+    uint32_t below_hi = (hi >= 32) ? 0xFFFFFFFFu : ((1u << hi) - 1);
+    return below_hi & ~((1u << lo) - 1);
+}
+
+// Builds bitmap words [begin, end) from the available ranges of the memory
+// map. Each word is written once, so ranges of words can be built in
+// parallel; overlapping map entries are harmless.
+static void scan_words(void* arg, uint32_t begin, uint32_t end) {
+    const mb2_mmap_tag_t* mmap = (const mb2_mmap_tag_t*)arg;
+    uint32_t freed = 0;
+
+    for (uint32_t w = begin; w < end; w++) {
+        const uint32_t w0 = w * 32;
+        uint32_t free_mask = 0;
+
+        for (uint32_t off = 0; off < mmap->size - sizeof(*mmap); off += mmap->entry_size) {
+            const mb2_mmap_entry_t* e = (const mb2_mmap_entry_t*)((uint8_t*)mmap->entries + off);
+            if (e->type != 1 || e->addr >= MAX_MEM) continue;
+
+            uint64_t e_end = e->addr + e->len;
+            if (e_end > MAX_MEM) e_end = MAX_MEM;
+            uint32_t p0 = ((uint32_t)e->addr + PAGE_SIZE - 1) / PAGE_SIZE;
+            uint32_t p1 = (uint32_t)e_end / PAGE_SIZE;
+
+            uint32_t lo = p0 > w0 ? p0 : w0;
+            uint32_t hi = p1 < w0 + 32 ? p1 : w0 + 32;
+            if (lo < hi) free_mask |= bit_span(lo - w0, hi - w0);
         }
+
+        bitmap[w] = ~free_mask;
+        freed += bit_count(free_mask);
     }
+    __atomic_fetch_add(&free_pages, freed, __ATOMIC_RELAXED);
 }
 
 static void mark_range_used(uint32_t start, uint32_t end) {
@@ -78,22 +111,21 @@ void pmm_init(uint32_t mb2_info_addr, uint32_t kernel_end_phys) {
     const mb2_mmap_tag_t* mmap = mb2_find_mmap(mb2_info_addr);
     if (!mmap) return;
 
-    for (uint32_t off = 0; off < mmap->size - sizeof(*mmap); off += mmap->entry_size) {
-        const mb2_mmap_entry_t* e = (const mb2_mmap_entry_t*)((uint8_t*)mmap->entries + off);
-        if (e->type != 1) continue;
-
-        uint64_t start = e->addr;
-        uint64_t end = e->addr + e->len;
-
-        if (start >= MAX_MEM) continue;
-        if (end > MAX_MEM) end = MAX_MEM;
-
-        mark_range_free((uint32_t)start, (uint32_t)end);
-    }
+    // Runs before the other CPUs are up, so parallel_for() runs it inline;
+    // the word-at-a-time scan is what makes it cheap either way.
+    free_pages = 0;
+    parallel_for(0, MAX_PAGES / 32, 128, scan_words, (void*)mmap);
 
     uint32_t kend = (kernel_end_phys + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
     mark_range_used(0, kend);
 
+    // GRUB leaves the boot information and any modules in memory the map
+    // reports as available; keep them out of the allocator.
+    mark_range_used(mb2_info_addr, mb2_info_addr + mb2_info_size(mb2_info_addr));
+    for (const mb2_module_tag_t* m = mb2_next_module(mb2_info_addr, 0); m; m = mb2_next_module(mb2_info_addr, m)) {
+        if (m->mod_end > m->mod_start) mark_range_used(m->mod_start, m->mod_end);
+    }
+
     uint32_t b0 = (uint32_t)bitmap & ~(PAGE_SIZE - 1);
     uint32_t b1 = ((uint32_t)bitmap + sizeof(bitmap) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
     mark_range_used(b0, b1);
@@ -110,13 +142,16 @@ void pmm_init(uint32_t mb2_info_addr, uint32_t kernel_end_phys) {
 }
 
 uint32_t pmm_alloc_page(void) {
+    uint32_t flags = spin_lock_irqsave(&g_lock);
     for (uint32_t p = first_page; p < MAX_PAGES; p++) {
         if (!test_bit(p)) {
             set_bit(p);
             if (free_pages > 0) free_pages--;
+            spin_unlock_irqrestore(&g_lock, flags);
             return p * PAGE_SIZE;
         }
     }
+    spin_unlock_irqrestore(&g_lock, flags);
     return 0;
 }
 
@@ -124,13 +159,14 @@ void pmm_free_page(uint32_t addr) {
     uint32_t p = addr / PAGE_SIZE;
     if (p >= MAX_PAGES || p < first_page) return;
 
+    uint32_t flags = spin_lock_irqsave(&g_lock);
     if (!test_bit(p)) {
         double_free_cnt++;
-        return;
+    } else {
+        clear_bit(p);
+        free_pages++;
     }
-
-    clear_bit(p);
-    free_pages++;
+    spin_unlock_irqrestore(&g_lock, flags);
 }
 
 uint32_t pmm_alloc_contiguous(uint32_t pages) {
@@ -139,6 +175,7 @@ uint32_t pmm_alloc_contiguous(uint32_t pages) {
     uint32_t run = 0;
     uint32_t start = 0;
 
+    uint32_t flags = spin_lock_irqsave(&g_lock);
     for (uint32_t p = first_page; p < MAX_PAGES; p++) {
         if (!test_bit(p)) {
             if (run == 0) start = p;
@@ -147,6 +184,7 @@ uint32_t pmm_alloc_contiguous(uint32_t pages) {
                 for (uint32_t i = 0; i < pages; i++) set_bit(start + i);
                 if (free_pages >= pages) free_pages -= pages;
                 else free_pages = 0;
+                spin_unlock_irqrestore(&g_lock, flags);
                 return start * PAGE_SIZE;
             }
         } else {
@@ -154,6 +192,7 @@ uint32_t pmm_alloc_contiguous(uint32_t pages) {
         }
     }
 
+    spin_unlock_irqrestore(&g_lock, flags);
     return 0;
 }
 
@@ -163,6 +202,7 @@ void pmm_free_contiguous(uint32_t addr, uint32_t pages) {
     uint32_t start = addr / PAGE_SIZE;
     if (start + pages > MAX_PAGES) return;
 
+    uint32_t flags = spin_lock_irqsave(&g_lock);
     for (uint32_t i = 0; i < pages; i++) {
         uint32_t p = start + i;
         if (p < first_page) continue;
@@ -175,6 +215,7 @@ void pmm_free_contiguous(uint32_t addr, uint32_t pages) {
         clear_bit(p);
         free_pages++;
     }
+    spin_unlock_irqrestore(&g_lock, flags);
 }
 
 uint32_t pmm_total_pages(void) { return total_pages; }
@@ -0,0 +1,663 @@
+#include <stdint.h>
+#include "proc.h"
+#include "vmm.h"
+#include "pmm.h"
+#include "gdt.h"
+#include "kheap.h"
+#include "pit.h"
+#include "ring.h"
+#include "vdso.h"
+#include "vfs.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "wait.h"
+#include "console.h"
+
+#define PAGE_SIZE      4096
+#define PROC_ARGS_MAX  1024   // bytes of argv strings and pointers on the user stack
+#define PROC_MAX_ARGC  16
+
+extern void ctx_switch(uint32_t* save_esp, uint32_t next_esp);
+extern void proc_enter_user(void);
+
+// Every CPU has a run queue: the tasks whose `cpu` is its index. A task is
+// placed on the least loaded CPU when it starts and stays there, so only
+// its own CPU ever switches to or from it. Each CPU's boot context is its
+// idle task (pid 0 on the BSP is also the kernel main loop and shell); it
+// never exits, so a run queue is never empty. User processes run in ring 3
+// in their own address space and enter the kernel on their own kernel
+// stack (TSS esp0 of their CPU).
+//
+// Kernel code is not preempted: the timer switches tasks only when it
+// interrupts ring 3, and otherwise at syscall exit or when a kernel task
+// calls proc_yield()/proc_idle(). Kernel threads must therefore yield.
+static proc_t g_procs[PROC_MAX];
+static uint32_t g_next_pid = 1;
+static uint32_t g_switches = 0;
+static spinlock_t g_lock = SPINLOCK_INIT;
+static wait_queue_t g_exit_wq = WAIT_QUEUE_INIT;   // tasks becoming zombies
+
+// Return address of the program's entry function: passes its return value
+// to SYS_EXIT. mov ebx, eax; mov eax, 2; int 0x80; jmp $
+static const uint8_t g_exit_stub[] = { 0x89, 0xC3, 0xB8, 0x02, 0x00, 0x00, 0x00, 0xCD, 0x80, 0xEB, 0xFE };
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    __asm__ __volatile__("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    if (flags & 0x200) __asm__ __volatile__("sti" : : : "memory");
+}
+
+static uint32_t ticks_to_ms(uint32_t ticks) {
+    uint32_t hz = pit_get_hz();
+    return (ticks / hz) * 1000 + (ticks % hz) * 1000 / hz;
+}
+
+// g_lock held.
+static proc_t* alloc_slot(void) {
+    for (int i = 0; i < PROC_MAX; i++) {
+        proc_t* p = &g_procs[i];
+        if (p->state != PROC_UNUSED) continue;
+
+        p->state = PROC_NEW;
+        p->pid = g_next_pid++;
+        p->kernel = 0;
+        p->idle = 0;
+        p->cpu = 0;
+        p->detached = 0;
+        p->prio = PROC_PRIO_NORMAL;
+        p->slice = 0;
+        p->ticks = 0;
+        p->space = 0;
+        p->kstack = 0;
+        p->kesp = 0;
+        p->ustack = 0;
+        p->image = 0;
+        p->image_pages = 0;
+        p->wait_next = 0;
+        p->wait_timed = 0;
+        p->wake_at = 0;
+        p->ring = 0;
+        p->out = 0;
+        p->out_len = 0;
+        for (int f = 0; f < PROC_MAX_FILES; f++) p->files[f] = -1;
+        p->fn = 0;
+        p->arg = 0;
+        p->exit_code = 0;
+        return p;
+    }
+    return 0;
+}
+
+static proc_t* new_slot(void) {
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    proc_t* p = alloc_slot();
+    spin_unlock_irqrestore(&g_lock, flags);
+    return p;
+}
+
+static void set_name(proc_t* p, const char* name) {
+    int i = 0;
+    for (; name[i] && i < PROC_NAME_MAX; i++) p->name[i] = name[i];
+    p->name[i] = 0;
+}
+
+static void proc_free(proc_t* p) {
+    if (p->space) vmm_space_destroy(p->space);
+    if (p->kstack) pmm_free_contiguous(p->kstack, PROC_KSTACK_PAGES);
+    if (p->ustack) pmm_free_contiguous(p->ustack, PROC_USTACK_PAGES);
+    if (p->image) pmm_free_contiguous(p->image, p->image_pages);
+    if (p->out) kfree(p->out);
+    p->out = 0;
+    __atomic_store_n(&p->state, PROC_UNUSED, __ATOMIC_RELEASE);
+}
+
+// Frees detached tasks that have exited. A task is claimed under the lock
+// (by clearing `detached`) so two CPUs never free the same one.
+static void reap(void) {
+    for (int i = 0; i < PROC_MAX; i++) {
+        proc_t* p = &g_procs[i];
+
+        uint32_t flags = spin_lock_irqsave(&g_lock);
+        int mine = p->state == PROC_ZOMBIE && p->detached;
+        if (mine) p->detached = 0;
+        spin_unlock_irqrestore(&g_lock, flags);
+        if (!mine) continue;
+
+        if (!p->kernel) {
+            console_puts("[proc] pid ");
+            print_u32(p->pid);
+            console_puts(" exit=");
+            print_u32((uint32_t)p->exit_code);
+            console_putc('\n');
+        }
+        proc_free(p);
+    }
+}
+
+// Highest priority ready task on `c`'s run queue, round-robin within a
+// priority level: the scan starts after `prev`, so `prev` is the last
+// candidate of its level. g_lock held.
+static proc_t* pick_next(cpu_t* c, proc_t* prev) {
+    int idx = (int)(prev - g_procs);
+    for (int prio = 0; prio < PROC_PRIOS; prio++) {
+        for (int k = 1; k <= PROC_MAX; k++) {
+            proc_t* p = &g_procs[(idx + k) % PROC_MAX];
+            if (p->state == PROC_READY && p->cpu == c->index && p->prio == prio) return p;
+        }
+    }
+    return c->idle;
+}
+
+// Runs on the new task's stack right after every switch, including the
+// first one into a new task. Only now is the previous task's stack free.
+void proc_switch_done(void) {
+    cpu_t* c = cpu_this();
+    proc_t* dead = c->exiting;
+    if (dead) {
+        c->exiting = 0;
+        __atomic_store_n(&dead->state, PROC_ZOMBIE, __ATOMIC_RELEASE);
+        wait_wake(&g_exit_wq);
+    }
+    reap();
+}
+
+// Interrupts off.
+static void schedule(void) {
+    cpu_t* c = cpu_this();
+    proc_t* prev = c->current;
+    c->need_resched = 0;
+
+    spin_lock(&g_lock);
+    if (prev->state == PROC_RUNNING) prev->state = PROC_READY;
+    proc_t* next = pick_next(c, prev);
+    next->state = PROC_RUNNING;
+    next->slice = PROC_SLICE_TICKS;
+    if (next != prev) g_switches++;
+    spin_unlock(&g_lock);
+
+    if (next == prev) return;
+
+    c->current = next;
+    if (prev->state == PROC_EXITING) c->exiting = prev;
+    if (!next->kernel) gdt_set_kernel_stack(c->index, next->kstack + PROC_KSTACK_PAGES * PAGE_SIZE);
+    vmm_space_switch(next->space);
+
+    ctx_switch(&prev->kesp, next->kesp);
+
+    // Back on prev's stack, switched to by some later schedule() on this CPU.
+    proc_switch_done();
+}
+
+static void init_idle(proc_t* p, cpu_t* c) {
+    p->state = PROC_RUNNING;
+    p->kernel = 1;
+    p->idle = 1;
+    p->cpu = c->index;
+    p->slice = PROC_SLICE_TICKS;
+    c->current = p;
+    c->idle = p;
+}
+
+// Adopts the BSP's boot context as pid 0.
+void proc_init(void) {
+    for (int i = 0; i < PROC_MAX; i++) g_procs[i].state = PROC_UNUSED;
+    g_next_pid = 0;
+
+    proc_t* k = alloc_slot();
+    set_name(k, "kernel");
+    init_idle(k, cpu_get(0));
+}
+
+// Adopts an application processor's boot context as its idle task.
+void proc_init_cpu(cpu_t* c) {
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    proc_t* p = alloc_slot();
+    spin_unlock_irqrestore(&g_lock, flags);
+    if (!p) return;
+
+    char name[] = "idle0";
+    name[4] = (char)('0' + c->index);
+    set_name(p, name);
+    init_idle(p, c);
+}
+
+// Lays out a cdecl call frame for entry(argc, argv) at the top of the user
+// stack, writing through the stack's kernel (identity) mapping. Returns the
+// initial user esp, or 0 if the arguments do not fit.
+static uint32_t build_user_stack(proc_t* p, int argc, char** argv) {
+    if (argc < 0 || argc > PROC_MAX_ARGC) return 0;
+
+    uint32_t top = p->ustack + PROC_USTACK_PAGES * PAGE_SIZE;
+    uint32_t sp = top - 16;
+    const uint32_t delta = VMM_USER_TOP - top;
+
+    for (uint32_t i = 0; i < sizeof(g_exit_stub); i++) ((uint8_t*)sp)[i] = g_exit_stub[i];
+    uint32_t stub = sp + delta;
+
+    uint32_t uargv[PROC_MAX_ARGC + 1];
+    for (int i = argc - 1; i >= 0; i--) {
+        uint32_t len = 0;
+        while (argv[i][len]) len++;
+        if (top - sp + len + 1 > PROC_ARGS_MAX) return 0;
+
+        sp -= len + 1;
+        for (uint32_t j = 0; j <= len; j++) ((char*)sp)[j] = argv[i][j];
+        uargv[i] = sp + delta;
+    }
+    uargv[argc] = 0;
+
+    sp &= ~3u;
+    sp -= (uint32_t)(argc + 1) * 4;
+    for (int i = 0; i <= argc; i++) ((uint32_t*)sp)[i] = uargv[i];
+    uint32_t uargv_ptr = sp + delta;
+
+    sp -= 12;
+    ((uint32_t*)sp)[0] = stub;
+    ((uint32_t*)sp)[1] = (uint32_t)argc;
+    ((uint32_t*)sp)[2] = uargv_ptr;
+    return sp + delta;
+}
+
+// Pushes the frame the first ctx_switch() into `p` pops: callee-saved
+// registers and flags, then the address it "returns" to.
+static uint32_t* push_switch_frame(uint32_t* sp, uint32_t ret) {
+    *--sp = ret;
+    *--sp = 0;                               // ebp
+    *--sp = 0;                               // ebx
+    *--sp = 0;                               // esi
+    *--sp = 0;                               // edi
+    *--sp = 0x002;                           // eflags: IF off until the task enables it
+    return sp;
+}
+
+// proc_enter_user irets to `entry` in ring 3.
+static void build_kernel_stack(proc_t* p, uint32_t entry, uint32_t usp) {
+    uint32_t* sp = (uint32_t*)(p->kstack + PROC_KSTACK_PAGES * PAGE_SIZE);
+
+    *--sp = GDT_USER_DATA;                   // ss
+    *--sp = usp;                             // esp
+    *--sp = 0x202;                           // eflags: IF
+    *--sp = GDT_USER_CODE;                   // cs
+    *--sp = entry;                           // eip
+    p->kesp = (uint32_t)push_switch_frame(sp, (uint32_t)proc_enter_user);
+}
+
+// Builds a process around an already loaded and relocated image of
+// `image_pages` physical pages at `image`; `entry` is a user address. On
+// success the process owns the image pages. The process stays PROC_NEW
+// until proc_start().
+proc_t* proc_create(const char* name, uint32_t image, uint32_t image_pages, uint32_t entry, int argc, char** argv) {
+    const uint32_t ustack_base = VMM_USER_TOP - PROC_USTACK_PAGES * PAGE_SIZE;
+    if (image_pages == 0 || image_pages > (PROC_RING_BASE - PROC_IMAGE_BASE) / PAGE_SIZE) return 0;
+
+    proc_t* p = new_slot();
+    if (!p) return 0;
+
+    p->space = vmm_space_create();
+    p->kstack = pmm_alloc_contiguous(PROC_KSTACK_PAGES);
+    p->ustack = pmm_alloc_contiguous(PROC_USTACK_PAGES);
+    if (!p->space || !p->kstack || !p->ustack) {
+        proc_free(p);
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < image_pages; i++) {
+        if (vmm_space_map(p->space, PROC_IMAGE_BASE + i * PAGE_SIZE, image + i * PAGE_SIZE, VMM_USER | VMM_WRITE) < 0) {
+            proc_free(p);
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < PROC_USTACK_PAGES; i++) {
+        if (vmm_space_map(p->space, ustack_base + i * PAGE_SIZE, p->ustack + i * PAGE_SIZE, VMM_USER | VMM_WRITE) < 0) {
+            proc_free(p);
+            return 0;
+        }
+    }
+    if (vdso_page() && vmm_space_map(p->space, PROC_VDSO_BASE, vdso_page(), VMM_USER) < 0) {
+        proc_free(p);
+        return 0;
+    }
+
+    uint32_t usp = build_user_stack(p, argc, argv);
+    if (!usp) {
+        proc_free(p);
+        return 0;
+    }
+    build_kernel_stack(p, entry, usp);
+
+    set_name(p, name);
+    p->image = image;
+    p->image_pages = image_pages;
+    return p;
+}
+
+static void kthread_entry(void) {
+    proc_switch_done();
+    __asm__ __volatile__("sti");
+
+    proc_t* p = cpu_this()->current;
+    p->fn(p->arg);
+    proc_exit(0);
+}
+
+// Starts a detached kernel thread running fn(arg) on CPU `cpu`, or on the
+// least loaded CPU when `cpu` is -1.
+proc_t* proc_spawn(const char* name, void (*fn)(void*), void* arg, int prio, int cpu) {
+    proc_t* p = new_slot();
+    if (!p) return 0;
+
+    p->kstack = pmm_alloc_contiguous(PROC_KSTACK_PAGES);
+    if (!p->kstack) {
+        proc_free(p);
+        return 0;
+    }
+
+    uint32_t* sp = (uint32_t*)(p->kstack + PROC_KSTACK_PAGES * PAGE_SIZE);
+    *--sp = 0;                               // kthread_entry never returns
+    p->kesp = (uint32_t)push_switch_frame(sp, (uint32_t)kthread_entry);
+
+    set_name(p, name);
+    p->kernel = 1;
+    p->fn = fn;
+    p->arg = arg;
+    p->cpu = (cpu >= 0 && cpu < smp_cpu_count()) ? cpu : -1;
+    proc_start(p, prio, 1);
+    return p;
+}
+
+// g_lock held.
+static int least_loaded_cpu(void) {
+    int best = 0;
+    uint32_t best_load = 0xFFFFFFFFu;
+    for (int c = 0; c < smp_cpu_count(); c++) {
+        uint32_t load = 0;
+        for (int i = 0; i < PROC_MAX; i++) {
+            proc_t* p = &g_procs[i];
+            if (!p->idle && p->cpu == c && (p->state == PROC_READY || p->state == PROC_RUNNING)) load++;
+        }
+        if (load < best_load) {
+            best = c;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+// Makes a PROC_NEW task runnable. A detached task is freed by the scheduler
+// when it exits; otherwise proc_wait() must collect it. User processes and
+// kernel threads without a fixed CPU go to the least loaded run queue.
+void proc_start(proc_t* p, int prio, int detached) {
+    if (prio < 0 || prio >= PROC_PRIOS) prio = PROC_PRIO_NORMAL;
+
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    if (!p->kernel || p->cpu < 0) p->cpu = least_loaded_cpu();
+    p->prio = prio;
+    p->detached = detached;
+    p->state = PROC_READY;
+    spin_unlock_irqrestore(&g_lock, flags);
+}
+
+static int is_zombie(void* arg) {
+    return __atomic_load_n(&((proc_t*)arg)->state, __ATOMIC_ACQUIRE) == PROC_ZOMBIE;
+}
+
+// Blocks until `p` exits, then frees it. Returns its exit code.
+int proc_wait(proc_t* p) {
+    wait_event(&g_exit_wq, is_zombie, p, WAIT_FOREVER);
+
+    int code = p->exit_code;
+    proc_free(p);
+    return code;
+}
+
+// Ends the current task; called on its own kernel stack (syscall, fault or
+// kernel thread return). Does not return, except for idle tasks, which
+// cannot exit.
+void proc_exit(int code) {
+    proc_t* p = proc_current();
+    if (p->idle) return;
+
+    // What takes sleeping locks is released here, while the task can still
+    // block; the ring goes before proc_free() destroys the address space.
+    proc_out_flush(p);
+    ring_release(p);
+    for (int fd = 0; fd < PROC_MAX_FILES; fd++) proc_file_close(p, fd);
+
+    irq_save();
+    p->exit_code = code;
+    p->state = PROC_EXITING;
+    schedule();
+}
+
+void proc_yield(void) {
+    uint32_t flags = irq_save();
+    schedule();
+    irq_restore(flags);
+}
+
+// Gives the CPU to any other task on this run queue, or halts until the
+// next interrupt when there is none. Time spent halted is accounted as idle.
+void proc_idle(void) {
+    uint32_t flags = irq_save();
+    cpu_t* c = cpu_this();
+
+    int others = 0;
+    spin_lock(&g_lock);
+    for (int i = 0; i < PROC_MAX; i++) {
+        proc_t* p = &g_procs[i];
+        if (p != c->current && p->cpu == c->index && p->state == PROC_READY) others = 1;
+    }
+    spin_unlock(&g_lock);
+
+    if (others) {
+        schedule();
+        irq_restore(flags);
+        return;
+    }
+
+    c->halted = 1;
+    __asm__ __volatile__("sti; hlt" : : : "memory");
+    __asm__ __volatile__("cli");
+    c->halted = 0;
+    irq_restore(flags);
+}
+
+// Marks the current task blocked; the caller queues it somewhere proc_wake()
+// will find it, then calls proc_yield(). A timed block also ends at PIT
+// tick `deadline`. Interrupts off.
+void proc_block(int timed, uint32_t deadline) {
+    proc_t* p = cpu_this()->current;
+    spin_lock(&g_lock);
+    p->wait_timed = timed;
+    p->wake_at = deadline;
+    p->state = PROC_BLOCKED;
+    spin_unlock(&g_lock);
+}
+
+// g_lock held. Returns the task's CPU.
+static cpu_t* make_ready(proc_t* p) {
+    p->state = PROC_READY;
+    p->wait_timed = 0;
+    return cpu_get(p->cpu);
+}
+
+// Makes a blocked task runnable. Its CPU reschedules at its next chance, or
+// at once if it is halted.
+void proc_wake(proc_t* p) {
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    cpu_t* c = p->state == PROC_BLOCKED ? make_ready(p) : 0;
+    spin_unlock_irqrestore(&g_lock, flags);
+    if (!c) return;
+
+    if (c == cpu_this()) c->need_resched = 1;
+    else smp_wake_cpu(c);
+}
+
+int proc_set_prio(uint32_t pid, int prio) {
+    if (prio < 0 || prio >= PROC_PRIOS) return -1;
+
+    int rc = -1;
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    for (int i = 0; i < PROC_MAX; i++) {
+        proc_t* p = &g_procs[i];
+        if (p->state == PROC_UNUSED || p->pid != pid) continue;
+        p->prio = prio;
+        rc = 0;
+        break;
+    }
+    spin_unlock_irqrestore(&g_lock, flags);
+    return rc;
+}
+
+proc_t* proc_current(void) {
+    uint32_t flags = irq_save();
+    proc_t* p = cpu_this()->current;
+    irq_restore(flags);
+    return p;
+}
+
+// Buffered output of `p`: collected in p->out and written to the console in
+// one piece when the buffer fills, on proc_out_flush() and at exit. Writes
+// that do not fit an empty buffer go straight through.
+void proc_out_write(proc_t* p, const char* s, uint32_t len) {
+    if (p && !p->out) p->out = (char*)kmalloc(PROC_OUT_SIZE);
+    if (!p || !p->out) {
+        console_write(s, len);
+        return;
+    }
+
+    if (p->out_len + len > PROC_OUT_SIZE) proc_out_flush(p);
+    if (len >= PROC_OUT_SIZE) {
+        console_write(s, len);
+        return;
+    }
+    for (uint32_t i = 0; i < len; i++) p->out[p->out_len + i] = s[i];
+    p->out_len += len;
+}
+
+void proc_out_flush(proc_t* p) {
+    if (!p || !p->out_len) return;
+    console_write(p->out, p->out_len);
+    p->out_len = 0;
+}
+
+// Gives VFS descriptor `vfd` a slot in `p`'s file table. Returns the
+// process's descriptor, or -1 when the table is full.
+int proc_file_add(proc_t* p, int vfd) {
+    for (int fd = 0; fd < PROC_MAX_FILES; fd++) {
+        if (p->files[fd] >= 0) continue;
+        p->files[fd] = vfd;
+        return fd;
+    }
+    return -1;
+}
+
+// VFS descriptor behind `p`'s descriptor `fd`, or -1.
+int proc_file(proc_t* p, int fd) {
+    if (!p || fd < 0 || fd >= PROC_MAX_FILES) return -1;
+    return p->files[fd];
+}
+
+int proc_file_close(proc_t* p, int fd) {
+    int vfd = proc_file(p, fd);
+    if (vfd < 0) return -1;
+    p->files[fd] = -1;
+    return vfs_close(vfd);
+}
+
+// Timer interrupt on this CPU: its local APIC timer, or the PIT on the BSP
+// while interrupts are routed through the 8259s.
+// Charges the tick and switches when the slice is used up and the
+// interrupted code was in ring 3.
+void proc_tick(int from_user) {
+    cpu_t* c = cpu_this();
+    proc_t* p = c->current;
+    if (!p) return;
+
+    if (c->halted) c->idle_ticks++;
+    else p->ticks++;
+
+    uint32_t now = pit_get_ticks();
+    spin_lock(&g_lock);
+    for (int i = 0; i < PROC_MAX; i++) {
+        proc_t* q = &g_procs[i];
+        if (q->state != PROC_BLOCKED || q->cpu != c->index || !q->wait_timed) continue;
+        if ((int32_t)(now - q->wake_at) < 0) continue;
+        make_ready(q);
+        c->need_resched = 1;
+    }
+    spin_unlock(&g_lock);
+
+    if (--p->slice <= 0) c->need_resched = 1;
+    if (from_user && c->need_resched) schedule();
+}
+
+// Syscall exit: the other point where a pending switch is taken.
+void proc_preempt(void) {
+    cpu_t* c = cpu_this();
+    if (c->current && c->need_resched) schedule();
+}
+
+static const char* state_name(int state) {
+    switch (state) {
+        case PROC_NEW: return "new";
+        case PROC_READY: return "ready";
+        case PROC_RUNNING: return "running";
+        case PROC_BLOCKED: return "blocked";
+        case PROC_EXITING:
+        case PROC_ZOMBIE: return "zombie";
+        default: return "?";
+    }
+}
+
+void proc_dump(void) {
+    for (int i = 0; i < PROC_MAX; i++) {
+        proc_t* p = &g_procs[i];
+        if (p->state == PROC_UNUSED) continue;
+
+        console_puts("pid=");
+        print_u32(p->pid);
+        console_puts(" cpu=");
+        print_u32((uint32_t)p->cpu);
+        console_puts(" prio=");
+        print_u32((uint32_t)p->prio);
+        console_puts(" state=");
+        console_puts(state_name(p->state));
+        console_puts(" cpu_ms=");
+        print_u32(ticks_to_ms(p->ticks));
+        console_puts(p->kernel ? " kthread " : " user ");
+        console_puts(p->name);
+        console_putc('\n');
+    }
+
+    uint32_t idle = 0;
+    for (int i = 0; i < smp_cpu_count(); i++) idle += cpu_get(i)->idle_ticks;
+
+    console_puts("[proc] cpus=");
+    print_u32((uint32_t)smp_cpu_count());
+    console_puts(" uptime_ms=");
+    print_u32(ticks_to_ms(pit_get_ticks()));
+    console_puts(" idle_ms=");
+    print_u32(ticks_to_ms(idle));
+    console_puts(" switches=");
+    print_u32(g_switches);
+    console_putc('\n');
+}
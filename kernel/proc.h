@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include "vmm.h"
+#include "smp.h"
+
+#define PROC_MAX          16
+#define PROC_NAME_MAX     15
+#define PROC_KSTACK_PAGES 2
+#define PROC_USTACK_PAGES 16
+#define PROC_OUT_SIZE     1024   // buffered console output per process
+#define PROC_MAX_FILES    8
+
+// A program image is mapped here in its process's address space; its user
+// stack ends at VMM_USER_TOP. A syscall ring (ring.h), if the program sets
+// one up, sits 1 MB below the top, past the end of the largest image, and
+// the read-only time page (vdso.h) follows it.
+#define PROC_IMAGE_BASE VMM_USER_BASE
+#define PROC_RING_BASE  (VMM_USER_TOP - 0x100000u)
+#define PROC_VDSO_BASE  (PROC_RING_BASE + VMM_PAGE_SIZE)
+
+// Lower value runs first; tasks of equal priority share the CPU round-robin.
+#define PROC_PRIO_HIGH   0
+#define PROC_PRIO_NORMAL 1
+#define PROC_PRIO_LOW    2
+#define PROC_PRIOS       3
+
+#define PROC_SLICE_TICKS 5
+
+enum {
+    PROC_UNUSED = 0,
+    PROC_NEW,       // created, not yet runnable
+    PROC_READY,
+    PROC_RUNNING,
+    PROC_BLOCKED,   // on a wait queue (wait.h) until woken or timed out
+    PROC_EXITING,   // exited, its CPU may still be on its kernel stack
+    PROC_ZOMBIE,    // exited, waiting to be reaped
+};
+
+typedef struct proc {
+    int state;
+    uint32_t pid;
+    char name[PROC_NAME_MAX + 1];
+    int kernel;           // kernel thread: ring 0, no address space of its own
+    int idle;             // a CPU's boot context; never exits
+    int cpu;              // run queue (CPU index) the task belongs to
+    int detached;         // reaped by the scheduler instead of proc_wait()
+    int prio;
+    int slice;            // ticks left before preemption
+    uint32_t ticks;       // CPU time in scheduler ticks
+    uint32_t space;       // page directory from vmm_space_create()
+    uint32_t kstack;      // PROC_KSTACK_PAGES contiguous PMM pages, 0 for idle tasks
+    uint32_t kesp;        // saved kernel stack pointer while switched out
+    uint32_t ustack;      // PROC_USTACK_PAGES contiguous PMM pages
+    uint32_t image;       // program image pages, owned by the process
+    uint32_t image_pages;
+    struct proc* wait_next;   // wait queue link
+    int wait_timed;       // blocked with a deadline
+    uint32_t wake_at;     // PIT tick the deadline expires at
+    struct ring* ring;    // syscall ring from ring_setup(), or 0
+    char* out;            // PROC_OUT_SIZE bytes of buffered output, allocated on first use
+    uint32_t out_len;
+    int files[PROC_MAX_FILES];   // VFS descriptors, -1 when free
+    void (*fn)(void*);    // kernel thread body
+    void* arg;
+    int exit_code;
+} proc_t;
+
+void proc_init(void);
+void proc_init_cpu(cpu_t* c);
+void proc_switch_done(void);
+proc_t* proc_create(const char* name, uint32_t image, uint32_t image_pages, uint32_t entry, int argc, char** argv);
+proc_t* proc_spawn(const char* name, void (*fn)(void*), void* arg, int prio, int cpu);
+void proc_start(proc_t* p, int prio, int detached);
+int proc_wait(proc_t* p);
+void proc_exit(int code);
+void proc_yield(void);
+void proc_idle(void);
+void proc_block(int timed, uint32_t deadline);
+void proc_wake(proc_t* p);
+int proc_set_prio(uint32_t pid, int prio);
+proc_t* proc_current(void);
+void proc_out_write(proc_t* p, const char* s, uint32_t len);
+void proc_out_flush(proc_t* p);
+int proc_file_add(proc_t* p, int vfd);
+int proc_file(proc_t* p, int fd);
+int proc_file_close(proc_t* p, int fd);
+
+void proc_tick(int from_user);
+void proc_preempt(void);
+void proc_dump(void);
@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include "ramdisk.h"
+#include "mb2.h"
+#include "console.h"
+
+#define RAMDISK_CMDLINE "rootfs"
+
+static blkdev_t g_dev;
+static int g_ready = 0;
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+static void print_hex32(uint32_t v) {
+    const char* hex = "0123456789ABCDEF";
+    console_puts("0x");
+    for (int i = 7; i >= 0; i--) console_putc(hex[(v >> (i * 4)) & 0xF]);
+}
+
+static int cmdline_is(const char* s, const char* want) {
+    while (*s && *want) {
+        if (*s != *want) return 0;
+        s++;
+        want++;
+    }
+    return *s == 0 && *want == 0;
+}
+
+// Uses the module GRUB loaded with the "rootfs" command line, or the first
+// module if none is tagged. The pages stay where GRUB put them; the PMM has
+// already reserved them.
+int ramdisk_init(uint32_t mb2_info_addr) {
+    g_ready = 0;
+
+    const mb2_module_tag_t* pick = 0;
+    for (const mb2_module_tag_t* m = mb2_next_module(mb2_info_addr, 0); m; m = mb2_next_module(mb2_info_addr, m)) {
+        if (!pick) pick = m;
+        if (cmdline_is(m->cmdline, RAMDISK_CMDLINE)) {
+            pick = m;
+            break;
+        }
+    }
+    if (!pick || pick->mod_end <= pick->mod_start) return -1;
+
+    uint32_t sectors = (pick->mod_end - pick->mod_start) / 512;
+    if (sectors == 0) return -1;
+
+    g_dev.name = "ramdisk";
+    g_dev.sectors = sectors;
+    g_dev.base = (uint8_t*)(uintptr_t)pick->mod_start;
+    g_dev.read = 0;
+    g_dev.write_gather = 0;
+    g_dev.flush = 0;
+    g_ready = 1;
+
+    console_puts("[rd] module at ");
+    print_hex32(pick->mod_start);
+    console_puts(" sectors=");
+    print_u32(sectors);
+    console_putc('\n');
+    return 0;
+}
+
+const blkdev_t* ramdisk_device(void) {
+    return g_ready ? &g_dev : 0;
+}
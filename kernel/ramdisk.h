@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+#include "blkdev.h"
+
+int ramdisk_init(uint32_t mb2_info_addr);
+const blkdev_t* ramdisk_device(void);
@@ -0,0 +1,352 @@
+#include <stdint.h>
+#include "ring.h"
+#include "proc.h"
+#include "vmm.h"
+#include "pmm.h"
+#include "pit.h"
+#include "keyboard.h"
+#include "spinlock.h"
+#include "wait.h"
+#include "vfs.h"
+#include "console.h"
+
+#define RING_MASK        (RING_ENTRIES - 1)
+#define RING_POLL_IDLE   10   // ticks without work before the poller sleeps
+
+// Kernel side of a ring. The shared page and the buffers entries name are
+// reached through the identity map, so work can run in any context: the
+// submitting process, its poller thread or the timer interrupt. A ring
+// lives until both its process and its poller (if any) have let go of it.
+typedef struct ring {
+    int used;
+    int refs;
+    int dead;                 // owner gone; its address space is no longer valid
+    int sqpoll;
+    ring_shared_t* sh;
+    proc_t* owner;            // for its address space and files; valid until dead
+    uint32_t space;
+    mutex_t sq_lock;          // one SQ consumer at a time; entries may block
+    spinlock_t cq_lock;       // CQ tail, in-flight count and pending ops
+    uint32_t inflight;        // consumed entries not yet completed
+    wait_queue_t cq_wait;     // ring_enter() waiting for completions
+    wait_queue_t poll_wait;   // idle poller waiting for entries
+    struct {
+        int used;
+        uint32_t op;
+        uint32_t user_data;
+        uint32_t deadline;
+    } pending[RING_ENTRIES];
+} ring_t;
+
+static ring_t g_rings[PROC_MAX];
+static spinlock_t g_lock = SPINLOCK_INIT;
+
+static uint32_t cq_used(const ring_t* r) {
+    uint32_t used = r->sh->cq_tail - r->sh->cq_head;
+    return used > RING_ENTRIES ? RING_ENTRIES : used;
+}
+
+// cq_lock held.
+static void post(ring_t* r, uint32_t user_data, int32_t res) {
+    ring_shared_t* sh = r->sh;
+    uint32_t tail = sh->cq_tail;
+    sh->cq[tail & RING_MASK].user_data = user_data;
+    sh->cq[tail & RING_MASK].res = res;
+    __atomic_store_n(&sh->cq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->inflight--;
+}
+
+static void complete(ring_t* r, uint32_t user_data, int32_t res) {
+    uint32_t flags = spin_lock_irqsave(&r->cq_lock);
+    post(r, user_data, res);
+    spin_unlock_irqrestore(&r->cq_lock, flags);
+}
+
+static void add_pending(ring_t* r, uint32_t op, uint32_t user_data, uint32_t deadline) {
+    uint32_t flags = spin_lock_irqsave(&r->cq_lock);
+    for (int i = 0; i < RING_ENTRIES; i++) {
+        if (r->pending[i].used) continue;
+        r->pending[i].used = 1;
+        r->pending[i].op = op;
+        r->pending[i].user_data = user_data;
+        r->pending[i].deadline = deadline;
+        break;
+    }
+    spin_unlock_irqrestore(&r->cq_lock, flags);
+}
+
+// Writes user bytes [addr, addr + len) of the ring's space to the console,
+// a page at a time through the identity map. Checks the whole range first.
+static int32_t op_write(ring_t* r, uint32_t addr, uint32_t len) {
+    if (len > 0x7FFFFFFFu || addr + len < addr) return -1;
+    for (uint32_t a = addr & ~0xFFFu; a < addr + len; a += VMM_PAGE_SIZE) {
+        if (!vmm_space_user_phys(r->space, a, 0)) return -1;
+    }
+
+    uint32_t done = 0;
+    while (done < len) {
+        uint32_t va = addr + done;
+        uint32_t chunk = VMM_PAGE_SIZE - (va & 0xFFFu);
+        if (chunk > len - done) chunk = len - done;
+
+        const char* s = (const char*)vmm_space_user_phys(r->space, va, 0);
+        console_write(s, chunk);
+        done += chunk;
+    }
+    return (int32_t)done;
+}
+
+// pread() of the owner's file `fd` at `off` into user bytes [addr, addr + len),
+// a page at a time. Returns the bytes read, short at end of file.
+static int32_t op_read(ring_t* r, int fd, uint32_t addr, uint32_t len, uint32_t off) {
+    int vfd = proc_file(r->owner, fd);
+    if (vfd < 0 || len > 0x7FFFFFFFu || addr + len < addr) return -1;
+    for (uint32_t a = addr & ~0xFFFu; a < addr + len; a += VMM_PAGE_SIZE) {
+        if (!vmm_space_user_phys(r->space, a, 1)) return -1;
+    }
+
+    uint32_t done = 0;
+    while (done < len) {
+        uint32_t va = addr + done;
+        uint32_t chunk = VMM_PAGE_SIZE - (va & 0xFFFu);
+        if (chunk > len - done) chunk = len - done;
+
+        void* dst = (void*)vmm_space_user_phys(r->space, va, 1);
+        int n = vfs_pread(vfd, dst, chunk, off + done);
+        if (n < 0) return done ? (int32_t)done : -1;
+        done += (uint32_t)n;
+        if ((uint32_t)n < chunk) break;
+    }
+    return (int32_t)done;
+}
+
+static void run_sqe(ring_t* r, const ring_sqe_t* e) {
+    switch (e->op) {
+        case RING_OP_NOP:
+            complete(r, e->user_data, 0);
+            break;
+        case RING_OP_WRITE:
+            complete(r, e->user_data, op_write(r, e->addr, e->len));
+            break;
+        case RING_OP_READ_KEY: {
+            int c = keyboard_read_char();
+            if (c >= 0) complete(r, e->user_data, c);
+            else add_pending(r, RING_OP_READ_KEY, e->user_data, 0);
+            break;
+        }
+        case RING_OP_TIMEOUT:
+            add_pending(r, RING_OP_TIMEOUT, e->user_data, pit_get_ticks() + e->len);
+            break;
+        case RING_OP_GET_TICKS:
+            complete(r, e->user_data, (int32_t)pit_get_ticks());
+            break;
+        case RING_OP_READ:
+            complete(r, e->user_data, op_read(r, e->fd, e->addr, e->len, e->off));
+            break;
+        default:
+            complete(r, e->user_data, -1);
+            break;
+    }
+}
+
+// Consumes up to `max` entries, as long as the CQ has room for every
+// completion they can produce. Returns how many were consumed.
+static uint32_t submit(ring_t* r, uint32_t max) {
+    uint32_t n = 0;
+    mutex_lock(&r->sq_lock);
+    while (!r->dead && n < max) {
+        ring_shared_t* sh = r->sh;
+        uint32_t head = sh->sq_head;
+        if (head == __atomic_load_n(&sh->sq_tail, __ATOMIC_ACQUIRE)) break;
+
+        uint32_t flags = spin_lock_irqsave(&r->cq_lock);
+        int room = r->inflight + cq_used(r) < RING_ENTRIES;
+        if (room) r->inflight++;
+        spin_unlock_irqrestore(&r->cq_lock, flags);
+        if (!room) break;
+
+        // The program may rewrite the slot at any time: work on a copy.
+        ring_sqe_t e = sh->sq[head & RING_MASK];
+        __atomic_store_n(&sh->sq_head, head + 1, __ATOMIC_RELEASE);
+        run_sqe(r, &e);
+        n++;
+    }
+    mutex_unlock(&r->sq_lock);
+    if (n) wait_wake(&r->cq_wait);
+    return n;
+}
+
+static void ring_put(ring_t* r) {
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    int last = --r->refs == 0;
+    spin_unlock_irqrestore(&g_lock, flags);
+    if (!last) return;
+
+    // ring_tick() checks `used` under cq_lock before touching the page.
+    flags = spin_lock_irqsave(&r->cq_lock);
+    uint32_t page = (uint32_t)r->sh;
+    r->sh = 0;
+    r->used = 0;
+    spin_unlock_irqrestore(&r->cq_lock, flags);
+    pmm_free_page(page);
+}
+
+static int sq_pending(void* arg) {
+    ring_t* r = (ring_t*)arg;
+    return r->dead || r->sh->sq_head != r->sh->sq_tail;
+}
+
+// SQPOLL thread: drains the SQ as the program fills it, so the program
+// needs no syscall to submit. After RING_POLL_IDLE ticks without work it
+// sets RING_SQ_NEED_WAKEUP and sleeps until ring_enter() wakes it.
+static void poller(void* arg) {
+    ring_t* r = (ring_t*)arg;
+    uint32_t last_work = pit_get_ticks();
+
+    while (!r->dead) {
+        if (submit(r, RING_ENTRIES)) {
+            last_work = pit_get_ticks();
+            proc_yield();
+        } else if (pit_get_ticks() - last_work > RING_POLL_IDLE) {
+            // Set before the final look at the SQ, so a program that
+            // misses the flag has its entries seen here.
+            __atomic_or_fetch(&r->sh->flags, RING_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+            wait_event(&r->poll_wait, sq_pending, r, WAIT_FOREVER);
+            __atomic_and_fetch(&r->sh->flags, ~RING_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+            last_work = pit_get_ticks();
+        } else {
+            proc_yield();
+        }
+    }
+    ring_put(r);
+}
+
+// Maps a new ring into `p` at PROC_RING_BASE. Returns that address, or -1.
+int ring_setup(proc_t* p, uint32_t flags) {
+    if (!p || p->kernel || p->ring) return -1;
+
+    uint32_t page = pmm_alloc_page();
+    if (!page) return -1;
+
+    uint32_t lflags = spin_lock_irqsave(&g_lock);
+    ring_t* r = 0;
+    for (int i = 0; i < PROC_MAX; i++) {
+        if (!g_rings[i].used) {
+            r = &g_rings[i];
+            r->used = 1;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&g_lock, lflags);
+    if (!r) {
+        pmm_free_page(page);
+        return -1;
+    }
+
+    uint8_t* b = (uint8_t*)page;
+    for (uint32_t i = 0; i < VMM_PAGE_SIZE; i++) b[i] = 0;
+    r->sh = (ring_shared_t*)page;
+    r->sh->entries = RING_ENTRIES;
+    r->owner = p;
+    r->space = p->space;
+    r->dead = 0;
+    r->refs = 1;
+    r->inflight = 0;
+    r->sqpoll = (flags & RING_SETUP_SQPOLL) != 0;
+    mutex_init(&r->sq_lock);
+    r->cq_lock = (spinlock_t)SPINLOCK_INIT;
+    for (int i = 0; i < RING_ENTRIES; i++) r->pending[i].used = 0;
+    wait_init(&r->cq_wait);
+    wait_init(&r->poll_wait);
+
+    if (vmm_space_map(p->space, PROC_RING_BASE, page, VMM_USER | VMM_WRITE) < 0) {
+        ring_put(r);
+        return -1;
+    }
+    if (r->sqpoll) {
+        r->refs++;
+        if (!proc_spawn("ringpoll", poller, r, PROC_PRIO_NORMAL, -1)) {
+            r->refs--;
+            r->sqpoll = 0;
+        }
+    }
+
+    p->ring = r;
+    return (int)PROC_RING_BASE;
+}
+
+typedef struct {
+    ring_t* r;
+    uint32_t min;
+} enter_wait_t;
+
+// Enough completions, or none coming.
+static int enter_done(void* arg) {
+    enter_wait_t* w = (enter_wait_t*)arg;
+    ring_t* r = w->r;
+    if (cq_used(r) >= w->min) return 1;
+    return !r->inflight && !(r->sqpoll && r->sh->sq_head != r->sh->sq_tail);
+}
+
+// Submits up to `to_submit` entries, or wakes the poller to do it, then
+// blocks until `min_complete` completions are ready or nothing more can
+// complete. Returns the number of entries this call consumed.
+int ring_enter(proc_t* p, uint32_t to_submit, uint32_t min_complete) {
+    ring_t* r = p ? p->ring : 0;
+    if (!r) return -1;
+
+    uint32_t n = 0;
+    if (!r->sqpoll) n = submit(r, to_submit);
+    else if (r->sh->flags & RING_SQ_NEED_WAKEUP) wait_wake(&r->poll_wait);
+
+    enter_wait_t w = { r, min_complete > RING_ENTRIES ? RING_ENTRIES : min_complete };
+    wait_event(&r->cq_wait, enter_done, &w, WAIT_FOREVER);
+    return (int)n;
+}
+
+// The process is exiting: called from proc_exit(), before its files are
+// closed and its address space is destroyed.
+void ring_release(proc_t* p) {
+    ring_t* r = p->ring;
+    if (!r) return;
+
+    // Wait out a poller that may be working on an entry right now.
+    mutex_lock(&r->sq_lock);
+    r->dead = 1;
+    mutex_unlock(&r->sq_lock);
+    wait_wake(&r->poll_wait);
+
+    p->ring = 0;
+    ring_put(r);
+}
+
+// Timer interrupt: completes expired timeouts and key reads that now have
+// a key, whether or not the program is in the kernel.
+void ring_tick(void) {
+    uint32_t now = pit_get_ticks();
+    for (int i = 0; i < PROC_MAX; i++) {
+        ring_t* r = &g_rings[i];
+        if (!r->used) continue;
+
+        uint32_t flags = spin_lock_irqsave(&r->cq_lock);
+        int posted = 0;
+        for (int k = 0; r->used && k < RING_ENTRIES && r->inflight; k++) {
+            if (!r->pending[k].used) continue;
+
+            int32_t res = -1;
+            if (r->pending[k].op == RING_OP_TIMEOUT) {
+                if ((int32_t)(now - r->pending[k].deadline) < 0) continue;
+                res = 0;
+            } else {
+                int c = keyboard_read_char();
+                if (c < 0) continue;
+                res = c;
+            }
+            r->pending[k].used = 0;
+            post(r, r->pending[k].user_data, res);
+            posted = 1;
+        }
+        spin_unlock_irqrestore(&r->cq_lock, flags);
+        if (posted) wait_wake(&r->cq_wait);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+
+// Submission/completion ring pair shared with a process (one page mapped at
+// PROC_RING_BASE). The program fills sq[sq_tail % RING_ENTRIES] and bumps
+// sq_tail; the kernel consumes entries, bumps sq_head, and posts results to
+// cq[cq_tail % RING_ENTRIES]; the program reads them and bumps cq_head.
+// Offsets are part of the user ABI.
+#define RING_ENTRIES 64
+
+#define RING_OP_NOP       0
+#define RING_OP_WRITE     1   // console: addr, len; res = bytes written
+#define RING_OP_READ_KEY  2   // res = next key, once one is typed
+#define RING_OP_TIMEOUT   3   // res = 0 after len timer ticks
+#define RING_OP_GET_TICKS 4   // res = timer ticks since boot
+#define RING_OP_READ      5   // file fd at off into addr, len; res = bytes read
+
+#define RING_SETUP_SQPOLL   0x1   // a kernel thread consumes the SQ
+#define RING_SQ_NEED_WAKEUP 0x1   // shared flags: the poller sleeps, ring_enter wakes it
+
+typedef struct {
+    uint32_t op;
+    int32_t fd;
+    uint32_t addr;
+    uint32_t len;
+    uint32_t off;
+    uint32_t user_data;       // copied to the completion
+    uint32_t reserved[2];
+} ring_sqe_t;
+
+typedef struct {
+    uint32_t user_data;
+    int32_t res;              // negative on error
+} ring_cqe_t;
+
+typedef struct {
+    volatile uint32_t sq_head;    // 0x000
+    volatile uint32_t sq_tail;    // 0x004
+    volatile uint32_t cq_head;    // 0x008
+    volatile uint32_t cq_tail;    // 0x00C
+    volatile uint32_t flags;      // 0x010
+    uint32_t entries;             // 0x014
+    uint32_t reserved[2];
+    ring_sqe_t sq[RING_ENTRIES];  // 0x020
+    ring_cqe_t cq[RING_ENTRIES];  // 0x820
+} ring_shared_t;
+
+struct proc;
+
+int ring_setup(struct proc* p, uint32_t flags);
+int ring_enter(struct proc* p, uint32_t to_submit, uint32_t min_complete);
+void ring_release(struct proc* p);
+void ring_tick(void);
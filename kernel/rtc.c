@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include "rtc.h"
+#include "port.h"
+#include "spinlock.h"
+
+#define CMOS_INDEX 0x70
+#define CMOS_DATA  0x71
+
+#define REG_SECONDS 0x00
+#define REG_MINUTES 0x02
+#define REG_HOURS   0x04
+#define REG_DAY     0x07
+#define REG_MONTH   0x08
+#define REG_YEAR    0x09
+#define REG_STATUS_A 0x0A
+#define REG_STATUS_B 0x0B
+
+#define STATUS_A_UPDATING 0x80
+#define STATUS_B_24H      0x02
+#define STATUS_B_BINARY   0x04
+
+static spinlock_t g_lock = SPINLOCK_INIT;
+
+static uint8_t cmos_read(uint8_t reg) {
+    outb(CMOS_INDEX, reg);
+    return inb(CMOS_DATA);
+}
+
+static void read_raw(rtc_time_t* t) {
+    while (cmos_read(REG_STATUS_A) & STATUS_A_UPDATING) __asm__ __volatile__("pause");
+    t->second = cmos_read(REG_SECONDS);
+    t->minute = cmos_read(REG_MINUTES);
+    t->hour = cmos_read(REG_HOURS);
+    t->day = cmos_read(REG_DAY);
+    t->month = cmos_read(REG_MONTH);
+    t->year = cmos_read(REG_YEAR);
+}
+
+static uint8_t from_bcd(uint8_t v) {
+    return (uint8_t)((v >> 4) * 10 + (v & 0xF));
+}
+
+// Wall-clock time from the CMOS clock. The registers are read until two
+// passes agree, so an update in between cannot tear the result. Returns -1
+// if the clock holds no valid date.
+int rtc_read(rtc_time_t* t) {
+    rtc_time_t a, b;
+    uint32_t flags = spin_lock_irqsave(&g_lock);
+    read_raw(&a);
+    for (int i = 0; i < 4; i++) {
+        read_raw(&b);
+        if (a.second == b.second && a.minute == b.minute && a.hour == b.hour &&
+            a.day == b.day && a.month == b.month && a.year == b.year) break;
+        a = b;
+    }
+    uint8_t status = cmos_read(REG_STATUS_B);
+    spin_unlock_irqrestore(&g_lock, flags);
+
+    int pm = (b.hour & 0x80) != 0;
+    b.hour &= 0x7F;
+    if (!(status & STATUS_B_BINARY)) {
+        b.second = from_bcd(b.second);
+        b.minute = from_bcd(b.minute);
+        b.hour = from_bcd(b.hour);
+        b.day = from_bcd(b.day);
+        b.month = from_bcd(b.month);
+        b.year = from_bcd((uint8_t)b.year);
+    }
+    if (!(status & STATUS_B_24H)) b.hour = (uint8_t)(b.hour % 12 + (pm ? 12 : 0));
+    b.year = (uint16_t)(b.year + (b.year < 80 ? 2000 : 1900));   // no century register
+
+    if (b.month < 1 || b.month > 12 || b.day < 1 || b.day > 31 ||
+        b.hour > 23 || b.minute > 59 || b.second > 59) return -1;
+    *t = b;
+    return 0;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+
+typedef struct {
+    uint16_t year;
+    uint8_t month;     // 1-12
+    uint8_t day;       // 1-31
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+} rtc_time_t;
+
+int rtc_read(rtc_time_t* t);
@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include "serial.h"
+#include "port.h"
+#include "keyboard.h"
+
+#define COM1 0x3F8
+
+#define REG_DATA 0
+#define REG_IER  1
+#define REG_FCR  2      // IIR when read
+#define REG_LCR  3
+#define REG_MCR  4
+#define REG_LSR  5
+
+#define IER_RX   0x01
+#define IER_TX   0x02
+#define IIR_NONE 0x01
+#define LSR_DR   0x01
+#define LSR_THRE 0x20
+
+#define FIFO_DEPTH 16
+#define TX_SIZE    8192    // power of two
+
+// COM1 mirrors the console. Output is queued in g_tx and sent by the IRQ4
+// handler, a FIFO's worth per transmitter-empty interrupt, so logging never
+// waits on the UART; if the ring is full, bytes are dropped. There is one
+// producer (the console, under its lock) and one consumer (the handler, on
+// the CPU IRQ4 is routed to), and each only writes its own index, so the
+// ring takes no lock. Received bytes are typed into the keyboard queue.
+static char g_tx[TX_SIZE];
+static volatile uint32_t g_tx_head = 0;
+static volatile uint32_t g_tx_tail = 0;
+static int g_present = 0;
+
+// 115200 8N1, FIFOs on with a 14-byte receive trigger. A loopback echo
+// tells whether there is a UART at all.
+int serial_init(void) {
+    outb(COM1 + REG_IER, 0);
+    outb(COM1 + REG_LCR, 0x80);
+    outb(COM1 + REG_DATA, 1);
+    outb(COM1 + REG_IER, 0);
+    outb(COM1 + REG_LCR, 0x03);
+    outb(COM1 + REG_FCR, 0xC7);
+
+    outb(COM1 + REG_MCR, 0x1E);
+    outb(COM1 + REG_DATA, 0xAE);
+    if (inb(COM1 + REG_DATA) != 0xAE) return -1;
+
+    // DTR, RTS and OUT2, which connects the UART to its IRQ line.
+    outb(COM1 + REG_MCR, 0x0B);
+    outb(COM1 + REG_IER, IER_RX);
+    g_present = 1;
+    return 0;
+}
+
+int serial_present(void) {
+    return g_present;
+}
+
+static void push(char c) {
+    uint32_t head = g_tx_head;
+    if (head - __atomic_load_n(&g_tx_tail, __ATOMIC_ACQUIRE) >= TX_SIZE) return;
+    g_tx[head % TX_SIZE] = c;
+    __atomic_store_n(&g_tx_head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Queues only; serial_kick() starts the transmitter.
+void serial_putc(char c) {
+    if (!g_present) return;
+    if (c == '\n') push('\r');
+    push(c);
+}
+
+void serial_write(const char* s, uint32_t len) {
+    if (!g_present) return;
+    for (uint32_t i = 0; i < len; i++) {
+        if (s[i] == '\n') push('\r');
+        push(s[i]);
+    }
+}
+
+// Enabling the transmitter-empty interrupt while the transmitter is idle
+// raises it at once.
+void serial_kick(void) {
+    if (g_present && g_tx_head != g_tx_tail) outb(COM1 + REG_IER, IER_RX | IER_TX);
+}
+
+static void tx_drain(void) {
+    if (!(inb(COM1 + REG_LSR) & LSR_THRE)) return;
+
+    uint32_t tail = g_tx_tail;
+    uint32_t head = __atomic_load_n(&g_tx_head, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < FIFO_DEPTH && tail != head; i++) outb(COM1 + REG_DATA, g_tx[tail++ % TX_SIZE]);
+    __atomic_store_n(&g_tx_tail, tail, __ATOMIC_RELEASE);
+    if (tail != head) return;
+
+    // A kick from another CPU may land between the check and this write;
+    // look again so its bytes are not left waiting.
+    outb(COM1 + REG_IER, IER_RX);
+    if (__atomic_load_n(&g_tx_head, __ATOMIC_ACQUIRE) != tail) outb(COM1 + REG_IER, IER_RX | IER_TX);
+}
+
+static void rx_drain(void) {
+    while (inb(COM1 + REG_LSR) & LSR_DR) {
+        char c = (char)inb(COM1 + REG_DATA);
+        if (c == '\r') c = '\n';
+        if (c == 0x7F) c = '\b';
+        if (c == '\n' || c == '\b' || (c >= 0x20 && c < 0x7F)) keyboard_input(c);
+    }
+}
+
+// IRQ4, with interrupts off. Loops until the UART has nothing pending, so
+// the line drops and the next event is a fresh edge.
+void serial_irq(void) {
+    if (!g_present) return;
+    for (int i = 0; i < FIFO_DEPTH && !(inb(COM1 + REG_FCR) & IIR_NONE); i++) {
+        rx_drain();
+        tx_drain();
+    }
+}
+
+// Polled: sends everything queued, for when no interrupt will come again.
+void serial_flush(void) {
+    if (!g_present) return;
+    uint32_t tail = g_tx_tail;
+    while (tail != g_tx_head) {
+        while (!(inb(COM1 + REG_LSR) & LSR_THRE)) __asm__ __volatile__("pause");
+        outb(COM1 + REG_DATA, g_tx[tail++ % TX_SIZE]);
+        g_tx_tail = tail;
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+
+#define SERIAL_IRQ 4
+
+int serial_init(void);
+int serial_present(void);
+void serial_putc(char c);
+void serial_write(const char* s, uint32_t len);
+void serial_kick(void);
+void serial_irq(void);
+void serial_flush(void);
@@ -5,14 +5,35 @@
 #include "pmm.h"
 #include "kheap.h"
 #include "pit.h"
-#include "fs.h"
+#include "vfs.h"
+#include "tmpfs.h"
 #include "exec.h"
+#include "bcache.h"
+#include "vmm.h"
+#include "pcache.h"
+#include "proc.h"
+#include "job.h"
+#include "irq.h"
+#include "syscall.h"
 
 #define MAX_ARGS 8
+#define CAT_WINDOW (64 * 1024)
+#define HEXDUMP_MAX 4096
+#define HEX_LINE 61   // "0xXXXXXXXX: " then 16 * "XX " and '\n'
+#define STAGE_SIZE (16 * 1024)
 
 static char line[128];
 static void* last_ptr = 0;
-static uint8_t file_buf[4096];
+static uint8_t file_buf[512];
+static char hex_buf[HEXDUMP_MAX / 16 * HEX_LINE + 1];
+// parallel_for() workers only get kernel memory: other CPUs may hold stale
+// TLB entries for the file mapping window (there is no shootdown), so mapped
+// bytes are copied here on this CPU first.
+static uint8_t stage_buf[STAGE_SIZE];
+
+static void mem_copy(uint8_t* dst, const uint8_t* src, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) dst[i] = src[i];
+}
 
 static void print_u32(uint32_t v) {
     char buf[16];
@@ -30,12 +51,6 @@ static void print_u32(uint32_t v) {
     while (i--) console_putc(buf[i]);
 }
 
-static void print_hex8(uint8_t v) {
-    const char* hex = "0123456789ABCDEF";
-    console_putc(hex[(v >> 4) & 0xF]);
-    console_putc(hex[v & 0xF]);
-}
-
 static void print_hex32(uint32_t v) {
     const char* hex = "0123456789ABCDEF";
     console_puts("0x");
@@ -85,17 +100,68 @@ static void print_cmd_help(const char* cmd) {
         console_puts("usage: free\n");
         console_puts("free last pointer returned by alloc\n");
     } else if (streq(cmd, "hexdump")) {
-        console_puts("usage: hexdump <addr> <len>\n");
-        console_puts("len range is 1..256, addr accepts decimal or 0xHEX\n");
+        console_puts("usage: hexdump <addr|file> <len> [off]\n");
+        console_puts("len range is 1..4096, addr/off accept decimal or 0xHEX\n");
     } else if (streq(cmd, "ls")) {
-        console_puts("usage: ls\n");
-        console_puts("list FAT12 root directory entries\n");
+        console_puts("usage: ls [dir]\n");
+        console_puts("list directory entries and mount points, example: ls /docs\n");
     } else if (streq(cmd, "cat")) {
-        console_puts("usage: cat <file>\n");
-        console_puts("print text/binary bytes as-is, example: cat hello.txt\n");
+        console_puts("usage: cat [-s] <file>\n");
+        console_puts("print text/binary bytes as-is, example: cat docs/hello.txt\n");
+        console_puts("-s also prints the size and Adler-32 checksum\n");
+    } else if (streq(cmd, "write")) {
+        console_puts("usage: write <file> <text...>\n");
+        console_puts("create or replace file with text and a newline\n");
+    } else if (streq(cmd, "append")) {
+        console_puts("usage: append <file> <text...>\n");
+        console_puts("append text and a newline, creating the file if needed\n");
+    } else if (streq(cmd, "truncate")) {
+        console_puts("usage: truncate <file> <len>\n");
+        console_puts("shrink or zero-extend file to len bytes\n");
+    } else if (streq(cmd, "rm")) {
+        console_puts("usage: rm <file>\n");
+        console_puts("delete file and release its storage\n");
+    } else if (streq(cmd, "mkdir")) {
+        console_puts("usage: mkdir <dir>\n");
+        console_puts("create a directory, example: mkdir /tmp/out\n");
+    } else if (streq(cmd, "mount")) {
+        console_puts("usage: mount [tmpfs <dir>]\n");
+        console_puts("list mounts, or mount a new empty tmpfs on an existing directory\n");
+    } else if (streq(cmd, "sync")) {
+        console_puts("usage: sync\n");
+        console_puts("write back every mounted file system and flush the drive cache\n");
+    } else if (streq(cmd, "blkstat")) {
+        console_puts("usage: blkstat\n");
+        console_puts("show block cache hits/misses and write-back counters\n");
+    } else if (streq(cmd, "vmstat")) {
+        console_puts("usage: vmstat\n");
+        console_puts("show paging, file mapping and page cache counters\n");
     } else if (streq(cmd, "run")) {
-        console_puts("usage: run <file>\n");
+        console_puts("usage: run [-t] [-v] [-b] [-l] <file>\n");
         console_puts("execute checked binary (.bin with MBIN header, or verified .elf)\n");
+        console_puts("-t reports cold (loaded) or warm (cached image) launch latency\n");
+        console_puts("-v checks a cached image against its checksum before launch\n");
+        console_puts("-b runs it in the background, -l at low priority\n");
+    } else if (streq(cmd, "ps")) {
+        console_puts("usage: ps\n");
+        console_puts("list tasks with priority, state and CPU time\n");
+    } else if (streq(cmd, "nice")) {
+        console_puts("usage: nice <pid> <prio>\n");
+        console_puts("set task priority: 0 high, 1 normal, 2 low\n");
+    } else if (streq(cmd, "execcache")) {
+        console_puts("usage: execcache [flush]\n");
+        console_puts("show program image cache usage, or drop every cached image\n");
+    } else if (streq(cmd, "jobstat")) {
+        console_puts("usage: jobstat\n");
+        console_puts("show parallel job workers and per-worker ranges/steals\n");
+    } else if (streq(cmd, "sysstat")) {
+        console_puts("usage: sysstat [trace on|off|show]\n");
+        console_puts("show per-syscall calls, errors and log2 cycle histograms, then reset;\n");
+        console_puts("or switch call tracing, or list the most recent traced calls\n");
+    } else if (streq(cmd, "irq")) {
+        console_puts("usage: irq [<irq> <cpu> [prio]]\n");
+        console_puts("list IRQ routing and per-CPU counts, or route an ISA IRQ\n");
+        console_puts("to a CPU at priority 0 low, 1 normal, 2 high (I/O APIC only)\n");
     } else {
         console_puts("no help for command: ");
         console_puts(cmd);
@@ -172,10 +238,25 @@ static void cmd_help(int argc, char** argv) {
     console_puts("  heapstat\n");
     console_puts("  alloc <bytes>\n");
     console_puts("  free\n");
-    console_puts("  hexdump <addr> <len>\n");
-    console_puts("  ls\n");
-    console_puts("  cat <file>\n");
-    console_puts("  run <file>\n");
+    console_puts("  hexdump <addr|file> <len> [off]\n");
+    console_puts("  ls [dir]\n");
+    console_puts("  cat [-s] <file>\n");
+    console_puts("  write <file> <text...>\n");
+    console_puts("  append <file> <text...>\n");
+    console_puts("  truncate <file> <len>\n");
+    console_puts("  rm <file>\n");
+    console_puts("  mkdir <dir>\n");
+    console_puts("  mount [tmpfs <dir>]\n");
+    console_puts("  sync\n");
+    console_puts("  blkstat\n");
+    console_puts("  vmstat\n");
+    console_puts("  run [-t] [-v] [-b] [-l] <file>\n");
+    console_puts("  ps\n");
+    console_puts("  nice <pid> <prio>\n");
+    console_puts("  execcache [flush]\n");
+    console_puts("  jobstat\n");
+    console_puts("  irq [<irq> <cpu> [prio]]\n");
+    console_puts("  sysstat [trace on|off|show]\n");
     console_puts("Use: help <command> for details\n");
 }
 
@@ -230,31 +311,96 @@ static void cmd_free(void) {
     console_puts("freed\n");
 }
 
+typedef struct {
+    const uint8_t* p;
+    uint32_t label;
+    uint32_t len;
+} hexdump_t;
+
+// Every line but the last has the same width, so lines are formatted in
+// parallel straight into their place in hex_buf.
+static void hex_lines(void* arg, uint32_t begin, uint32_t end) {
+    const hexdump_t* d = (const hexdump_t*)arg;
+    const char* hex = "0123456789ABCDEF";
+    for (uint32_t line_no = begin; line_no < end; line_no++) {
+        char* out = hex_buf + line_no * HEX_LINE;
+        uint32_t off = line_no * 16;
+        uint32_t addr = d->label + off;
+
+        *out++ = '0';
+        *out++ = 'x';
+        for (int i = 7; i >= 0; i--) *out++ = hex[(addr >> (i * 4)) & 0xF];
+        *out++ = ':';
+        *out++ = ' ';
+        for (uint32_t i = off; i < off + 16 && i < d->len; i++) {
+            *out++ = hex[d->p[i] >> 4];
+            *out++ = hex[d->p[i] & 0xF];
+            *out++ = ' ';
+        }
+        *out = '\n';
+    }
+}
+
+static void dump_bytes(const uint8_t* p, uint32_t label, uint32_t len) {
+    mem_copy(stage_buf, p, len);
+    hexdump_t d = { stage_buf, label, len };
+    uint32_t lines = (len + 15) / 16;
+    parallel_for(0, lines, 16, hex_lines, &d);
+
+    uint32_t tail = len - (lines - 1) * 16;
+    hex_buf[(lines - 1) * HEX_LINE + 12 + tail * 3 + 1] = 0;
+    console_puts(hex_buf);
+}
+
+// File bytes are read through a mapping, straight out of the page cache.
+static void hexdump_file(const char* path, uint32_t len, uint32_t off) {
+    int fd = vfs_open(path, VFS_O_READ);
+    if (fd < 0) {
+        console_puts("hexdump: file not found\n");
+        return;
+    }
+
+    vfs_stat_t st;
+    if (vfs_fstat(fd, &st) < 0 || off >= st.size) {
+        vfs_close(fd);
+        console_puts("hexdump: offset past end of file\n");
+        return;
+    }
+    if (len > st.size - off) len = st.size - off;
+
+    uint32_t base = off & ~(VMM_PAGE_SIZE - 1);
+    const uint8_t* map = (const uint8_t*)vfs_mmap(fd, base, off - base + len);
+    if (!map) {
+        vfs_close(fd);
+        console_puts("hexdump: mmap failed\n");
+        return;
+    }
+
+    dump_bytes(map + (off - base), off, len);
+    vfs_munmap((void*)map);
+    vfs_close(fd);
+}
+
 static void cmd_hexdump(int argc, char** argv) {
     if (argc < 3) {
-        console_puts("usage: hexdump <addr> <len>\n");
+        console_puts("usage: hexdump <addr|file> <len> [off]\n");
         return;
     }
 
-    int ok1 = 0, ok2 = 0;
+    int ok1 = 0, ok2 = 0, ok3 = 1;
     uint32_t addr = parse_u32(argv[1], &ok1);
     uint32_t len = parse_u32(argv[2], &ok2);
-    if (!ok1 || !ok2 || len == 0 || len > 256) {
-        console_puts("len must be 1..256\n");
+    uint32_t off = (argc >= 4) ? parse_u32(argv[3], &ok3) : 0;
+    if (!ok2 || !ok3 || len == 0 || len > HEXDUMP_MAX) {
+        console_puts("len must be 1..4096\n");
         return;
     }
 
-    uint8_t* p = (uint8_t*)(uintptr_t)addr;
-    for (uint32_t i = 0; i < len; i++) {
-        if ((i % 16) == 0) {
-            print_hex32((uint32_t)(uintptr_t)(p + i));
-            console_puts(": ");
-        }
-        print_hex8(p[i]);
-        console_putc(' ');
-        if ((i % 16) == 15) console_putc('\n');
+    if (!ok1) {
+        hexdump_file(argv[1], len, off);
+        return;
     }
-    if ((len % 16) != 0) console_putc('\n');
+    dump_bytes((const uint8_t*)(uintptr_t)addr, addr, len);
 }
 
 static void cmd_sleep(int argc, char** argv) {
@@ -274,36 +420,274 @@ static void cmd_sleep(int argc, char** argv) {
 }
 
 static void cmd_cat(int argc, char** argv) {
+    int sum = 0;
+    if (argc >= 2 && streq(argv[1], "-s")) {
+        sum = 1;
+        argc--;
+        argv++;
+    }
     if (argc < 2) {
-        console_puts("usage: cat <file>\n");
+        console_puts("usage: cat [-s] <file>\n");
         return;
     }
 
-    uint32_t out = 0;
-    if (fs_read_file(argv[1], file_buf, sizeof(file_buf) - 1, &out) < 0) {
+    int fd = vfs_open(argv[1], VFS_O_READ);
+    if (fd < 0) {
         console_puts("cat: file not found or read failed\n");
         return;
     }
 
-    file_buf[out] = 0;
-    for (uint32_t i = 0; i < out; i++) {
-        console_putc((char)file_buf[i]);
+    vfs_stat_t st;
+    char last = '\n';
+    int mapped = vfs_fstat(fd, &st) == 0 && st.size > 0;
+    uint32_t adler = 1;
+    uint32_t total = 0;
+    int complete = 1;
+
+    // Pages fault in from the page cache as they are copied to stage_buf,
+    // never under the console lock; mapping a window at a time keeps only
+    // that much of the file pinned.
+    for (uint32_t off = 0; mapped && off < st.size; off += CAT_WINDOW) {
+        uint32_t n = st.size - off;
+        if (n > CAT_WINDOW) n = CAT_WINDOW;
+
+        const uint8_t* map = (const uint8_t*)vfs_mmap(fd, off, n);
+        if (!map) {
+            if (off == 0) mapped = 0;
+            else console_puts("\ncat: mmap failed\n");
+            complete = mapped == 0;
+            break;
+        }
+        for (uint32_t done = 0; done < n; done += STAGE_SIZE) {
+            uint32_t chunk = n - done < STAGE_SIZE ? n - done : STAGE_SIZE;
+            mem_copy(stage_buf, map + done, chunk);
+            console_write((const char*)stage_buf, chunk);
+            if (sum) adler = job_adler32(adler, stage_buf, chunk);
+        }
+        last = (char)stage_buf[(n - 1) % STAGE_SIZE];
+        total += n;
+        vfs_munmap((void*)map);
+    }
+
+    if (!mapped) {
+        for (;;) {
+            int n = vfs_read(fd, file_buf, sizeof(file_buf));
+            if (n < 0) {
+                console_puts("\ncat: read failed\n");
+                last = '\n';
+                complete = 0;
+                break;
+            }
+            if (n == 0) break;
+
+            console_write((const char*)file_buf, (uint32_t)n);
+            last = (char)file_buf[n - 1];
+            if (sum) adler = job_adler32(adler, file_buf, (uint32_t)n);
+            total += (uint32_t)n;
+        }
+    }
+    vfs_close(fd);
+
+    if (last != '\n') console_putc('\n');
+    if (sum && complete) {
+        console_puts("[cat] bytes=");
+        print_u32(total);
+        console_puts(" adler32=");
+        print_hex32(adler);
+        console_putc('\n');
+    }
+}
+
+static uint32_t str_len(const char* s) {
+    uint32_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+static void cmd_write(int argc, char** argv, int append) {
+    const char* name = append ? "append" : "write";
+    if (argc < 3) {
+        console_puts("usage: ");
+        console_puts(name);
+        console_puts(" <file> <text...>\n");
+        return;
+    }
+
+    int flags = VFS_O_WRITE | VFS_O_CREATE | (append ? VFS_O_APPEND : VFS_O_TRUNC);
+    int fd = vfs_open(argv[1], flags);
+    if (fd < 0) {
+        console_puts(name);
+        console_puts(": open failed\n");
+        return;
+    }
+
+    int ok = 1;
+    for (int i = 2; i < argc && ok; i++) {
+        uint32_t n = str_len(argv[i]);
+        if (vfs_write(fd, argv[i], n) != (int)n) ok = 0;
+        const char* sep = (i + 1 < argc) ? " " : "\n";
+        if (ok && vfs_write(fd, sep, 1) != 1) ok = 0;
+    }
+
+    if (vfs_close(fd) < 0) ok = 0;
+    if (!ok) {
+        console_puts(name);
+        console_puts(": write failed\n");
+    }
+}
+
+static void cmd_truncate(int argc, char** argv) {
+    if (argc < 3) {
+        console_puts("usage: truncate <file> <len>\n");
+        return;
+    }
+
+    int ok = 0;
+    uint32_t len = parse_u32(argv[2], &ok);
+    if (!ok) {
+        console_puts("usage: truncate <file> <len>\n");
+        return;
+    }
+
+    int fd = vfs_open(argv[1], VFS_O_WRITE);
+    if (fd < 0) {
+        console_puts("truncate: open failed\n");
+        return;
+    }
+
+    int rc = vfs_truncate(fd, len);
+    if (vfs_close(fd) < 0) rc = -1;
+    if (rc < 0) console_puts("truncate: failed\n");
+}
+
+static void cmd_rm(int argc, char** argv) {
+    if (argc < 2) {
+        console_puts("usage: rm <file>\n");
+        return;
+    }
+
+    if (vfs_unlink(argv[1]) < 0) {
+        console_puts("rm: failed\n");
+    }
+}
+
+static int ls_entry(void* ctx, const char* name, uint32_t type, uint32_t size) {
+    (void)ctx;
+    console_puts(name);
+    if (type == VFS_DIR) {
+        console_puts(" <DIR>");
+    } else {
+        console_puts(" ");
+        print_u32(size);
+    }
+    console_putc('\n');
+    return 0;
+}
+
+static void cmd_mkdir(int argc, char** argv) {
+    if (argc < 2) {
+        console_puts("usage: mkdir <dir>\n");
+        return;
+    }
+
+    if (vfs_mkdir(argv[1]) < 0) {
+        console_puts("mkdir: failed\n");
+    }
+}
+
+static void cmd_mount(int argc, char** argv) {
+    if (argc < 2) {
+        vfs_list_mounts();
+        return;
+    }
+    if (argc < 3 || !streq(argv[1], "tmpfs")) {
+        console_puts("usage: mount [tmpfs <dir>]\n");
+        return;
+    }
+
+    vfs_stat_t st;
+    if (vfs_stat(argv[2], &st) < 0 || st.type != VFS_DIR) {
+        console_puts("mount: no such directory\n");
+        return;
+    }
+
+    vnode_t* root = tmpfs_create_root();
+    if (!root || vfs_mount(argv[2], "tmpfs", root, 0) < 0) {
+        console_puts("mount: failed\n");
     }
-    if (out == 0 || file_buf[out - 1] != '\n') console_putc('\n');
 }
 
 static void cmd_run(int argc, char** argv) {
+    int flags = 0;
+    while (argc >= 2 && argv[1][0] == '-') {
+        if (streq(argv[1], "-t")) flags |= EXEC_F_TIMING;
+        else if (streq(argv[1], "-v")) flags |= EXEC_F_VERIFY;
+        else if (streq(argv[1], "-b")) flags |= EXEC_F_BACKGROUND;
+        else if (streq(argv[1], "-l")) flags |= EXEC_F_LOW_PRIO;
+        else break;
+        argc--;
+        argv++;
+    }
     if (argc < 2) {
-        console_puts("usage: run <file>\n");
+        console_puts("usage: run [-t] [-v] [-b] [-l] <file>\n");
         return;
     }
 
-    int rc = exec_run(argv[1], argc - 1, &argv[1]);
+    int rc = exec_run(argv[1], argc - 1, &argv[1], flags);
     if (rc < 0) {
         console_puts("run failed\n");
     }
 }
 
+static void cmd_nice(int argc, char** argv) {
+    if (argc < 3) {
+        console_puts("usage: nice <pid> <prio>\n");
+        return;
+    }
+
+    int ok1 = 0, ok2 = 0;
+    uint32_t pid = parse_u32(argv[1], &ok1);
+    uint32_t prio = parse_u32(argv[2], &ok2);
+    if (!ok1 || !ok2 || prio >= PROC_PRIOS || proc_set_prio(pid, (int)prio) < 0) {
+        console_puts("nice: no such task or bad priority\n");
+    }
+}
+
+static void cmd_irq(int argc, char** argv) {
+    if (argc < 2) {
+        irq_dump();
+        return;
+    }
+    if (argc < 3) {
+        console_puts("usage: irq [<irq> <cpu> [prio]]\n");
+        return;
+    }
+
+    int ok1 = 0, ok2 = 0, ok3 = 1;
+    uint32_t irq = parse_u32(argv[1], &ok1);
+    uint32_t cpu = parse_u32(argv[2], &ok2);
+    uint32_t prio = (argc >= 4) ? parse_u32(argv[3], &ok3) : IRQ_PRIO_NORMAL;
+    if (!ok1 || !ok2 || !ok3 || irq_route((int)irq, (int)cpu, (int)prio) < 0) {
+        console_puts("irq: bad irq, cpu or priority, or no I/O APIC\n");
+    }
+}
+
+static void cmd_sysstat(int argc, char** argv) {
+    if (argc < 2) {
+        syscall_stat_dump();
+        return;
+    }
+    if (argc >= 3 && streq(argv[1], "trace") && streq(argv[2], "on")) {
+        syscall_trace(1);
+    } else if (argc >= 3 && streq(argv[1], "trace") && streq(argv[2], "off")) {
+        syscall_trace(0);
+    } else if (argc >= 3 && streq(argv[1], "trace") && streq(argv[2], "show")) {
+        syscall_trace_dump();
+    } else {
+        console_puts("usage: sysstat [trace on|off|show]\n");
+    }
+}
+
 static void execute(char* cmdline) {
     char* argv[MAX_ARGS];
     int argc = split_args(cmdline, argv, MAX_ARGS);
@@ -333,11 +717,43 @@ static void execute(char* cmdline) {
     } else if (streq(argv[0], "hexdump")) {
         cmd_hexdump(argc, argv);
     } else if (streq(argv[0], "ls")) {
-        if (fs_list() < 0) console_puts("ls failed\n");
+        if (vfs_readdir(argc >= 2 ? argv[1] : "/", ls_entry, 0) < 0) console_puts("ls failed\n");
     } else if (streq(argv[0], "cat")) {
         cmd_cat(argc, argv);
+    } else if (streq(argv[0], "write")) {
+        cmd_write(argc, argv, 0);
+    } else if (streq(argv[0], "append")) {
+        cmd_write(argc, argv, 1);
+    } else if (streq(argv[0], "truncate")) {
+        cmd_truncate(argc, argv);
+    } else if (streq(argv[0], "rm")) {
+        cmd_rm(argc, argv);
+    } else if (streq(argv[0], "mkdir")) {
+        cmd_mkdir(argc, argv);
+    } else if (streq(argv[0], "mount")) {
+        cmd_mount(argc, argv);
+    } else if (streq(argv[0], "sync")) {
+        if (vfs_sync() < 0) console_puts("sync failed\n");
+    } else if (streq(argv[0], "blkstat")) {
+        bcache_dump();
+    } else if (streq(argv[0], "vmstat")) {
+        vmm_dump();
+        pcache_dump();
     } else if (streq(argv[0], "run")) {
         cmd_run(argc, argv);
+    } else if (streq(argv[0], "ps")) {
+        proc_dump();
+    } else if (streq(argv[0], "nice")) {
+        cmd_nice(argc, argv);
+    } else if (streq(argv[0], "execcache")) {
+        if (argc >= 2 && streq(argv[1], "flush")) exec_cache_flush();
+        exec_cache_dump();
+    } else if (streq(argv[0], "jobstat")) {
+        job_dump();
+    } else if (streq(argv[0], "irq")) {
+        cmd_irq(argc, argv);
+    } else if (streq(argv[0], "sysstat")) {
+        cmd_sysstat(argc, argv);
     } else {
         console_puts("Unknown command\n");
     }
@@ -0,0 +1,193 @@
+#include <stdint.h>
+#include "smp.h"
+#include "acpi.h"
+#include "lapic.h"
+#include "gdt.h"
+#include "idt.h"
+#include "vmm.h"
+#include "pmm.h"
+#include "mb2.h"
+#include "pit.h"
+#include "proc.h"
+#include "job.h"
+#include "syscall.h"
+#include "console.h"
+
+#define AP_TRAMPOLINE_BASE  0x8000
+#define AP_STACK_PAGES      PROC_KSTACK_PAGES
+#define AP_START_TIMEOUT_MS 100
+
+typedef struct {
+    uint32_t cr3;
+    uint32_t stack;
+    uint32_t entry;
+    uint32_t cpu;
+} ap_params_t;
+
+extern const uint8_t ap_trampoline_start[];
+extern const uint8_t ap_trampoline_params[];
+extern const uint8_t ap_trampoline_end[];
+
+static cpu_t g_cpus[SMP_MAX_CPUS];
+static int g_cpu_count = 1;
+static int g_smp = 0;
+static uint8_t g_apic_to_cpu[256];
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+cpu_t* cpu_this(void) {
+    if (!g_smp) return &g_cpus[0];
+    return &g_cpus[g_apic_to_cpu[lapic_id() & 0xFF]];
+}
+
+cpu_t* cpu_get(int index) {
+    return &g_cpus[index];
+}
+
+int smp_cpu_count(void) {
+    return g_cpu_count;
+}
+
+// Kicks every other CPU that sits in hlt so it looks for work now rather
+// than at its next timer tick.
+void smp_wake_idle(void) {
+    if (!g_smp) return;
+    cpu_t* self = cpu_this();
+    for (int i = 0; i < g_cpu_count; i++) {
+        cpu_t* c = &g_cpus[i];
+        if (c != self && c->online && c->halted) lapic_send_ipi((uint8_t)c->apic_id, LAPIC_WAKE_VECTOR);
+    }
+}
+
+// Kicks CPU `c` out of hlt, if it is halted.
+void smp_wake_cpu(cpu_t* c) {
+    if (g_smp && c != cpu_this() && c->online && c->halted) lapic_send_ipi((uint8_t)c->apic_id, LAPIC_WAKE_VECTOR);
+}
+
+// First C code on an application processor, on the stack from smp_init().
+static void ap_main(uint32_t index) {
+    cpu_t* c = &g_cpus[index];
+
+    gdt_init_cpu((int)index);
+    syscall_init_cpu((int)index);
+    idt_load_cpu();
+    lapic_enable();
+    proc_init_cpu(c);
+    lapic_timer_start();
+
+    __atomic_store_n(&c->online, 1, __ATOMIC_RELEASE);
+    __asm__ __volatile__("sti");
+    for (;;) {
+        job_poll();
+        proc_idle();
+    }
+}
+
+static int range_overlaps(uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1) {
+    return a0 < b1 && b0 < a1;
+}
+
+// The trampoline page sits below the kernel and is never handed out by the
+// PMM, but GRUB may have put boot information or a module there.
+static int trampoline_free(uint32_t mb2_info_addr) {
+    const uint32_t t0 = AP_TRAMPOLINE_BASE;
+    const uint32_t t1 = AP_TRAMPOLINE_BASE + VMM_PAGE_SIZE;
+    if (range_overlaps(t0, t1, mb2_info_addr, mb2_info_addr + mb2_info_size(mb2_info_addr))) return 0;
+    for (const mb2_module_tag_t* m = mb2_next_module(mb2_info_addr, 0); m; m = mb2_next_module(mb2_info_addr, m)) {
+        if (range_overlaps(t0, t1, m->mod_start, m->mod_end)) return 0;
+    }
+    return 1;
+}
+
+static int start_ap(cpu_t* c) {
+    c->kstack = pmm_alloc_contiguous(AP_STACK_PAGES);
+    if (!c->kstack) return -1;
+
+    volatile ap_params_t* params = (volatile ap_params_t*)(AP_TRAMPOLINE_BASE + (ap_trampoline_params - ap_trampoline_start));
+    params->cr3 = vmm_kernel_space();
+    params->stack = c->kstack + AP_STACK_PAGES * VMM_PAGE_SIZE;
+    params->entry = (uint32_t)ap_main;
+    params->cpu = (uint32_t)c->index;
+
+    // INIT, then the start-up IPI twice as the MP specification asks.
+    lapic_send_init((uint8_t)c->apic_id);
+    pit_sleep(10);
+    for (int i = 0; i < 2 && !c->online; i++) {
+        lapic_send_startup((uint8_t)c->apic_id, AP_TRAMPOLINE_BASE >> 12);
+        pit_sleep(1);
+    }
+
+    uint32_t start = pit_get_ticks();
+    uint32_t timeout = AP_START_TIMEOUT_MS * pit_get_hz() / 1000;
+    while (!__atomic_load_n(&c->online, __ATOMIC_ACQUIRE) && pit_get_ticks() - start < timeout) {
+        __asm__ __volatile__("hlt");
+    }
+    if (c->online) return 0;
+
+    // Park it in wait-for-SIPI before the stack and this cpu_t slot go to
+    // the next CPU: a slow AP must not come up late on either.
+    lapic_send_init((uint8_t)c->apic_id);
+    pit_sleep(10);
+    __atomic_store_n(&c->online, 0, __ATOMIC_RELEASE);
+    pmm_free_contiguous(c->kstack, AP_STACK_PAGES);
+    c->kstack = 0;
+    return -1;
+}
+
+// Called on the BSP once the scheduler is up. Starts every enabled CPU in
+// the MADT; without a MADT or local APIC the machine stays uniprocessor.
+void smp_init(uint32_t mb2_info_addr) {
+    cpu_t* bsp = &g_cpus[0];
+    bsp->index = 0;
+    bsp->online = 1;
+    if (lapic_present()) bsp->apic_id = lapic_id();
+
+    const acpi_madt_t* m = acpi_madt();
+    if (!m || !lapic_present() || !vmm_kernel_space() || !trampoline_free(mb2_info_addr)) {
+        console_puts("[smp] uniprocessor\n");
+        return;
+    }
+
+    for (int i = 0; i < 256; i++) g_apic_to_cpu[i] = 0;
+    g_smp = 1;
+
+    lapic_timer_calibrate(pit_get_hz());
+
+    uint8_t* dst = (uint8_t*)AP_TRAMPOLINE_BASE;
+    for (uint32_t i = 0; i < (uint32_t)(ap_trampoline_end - ap_trampoline_start); i++) dst[i] = ap_trampoline_start[i];
+
+    for (uint32_t i = 0; i < m->cpu_count && g_cpu_count < SMP_MAX_CPUS; i++) {
+        if (m->cpu_apic_id[i] == bsp->apic_id) continue;
+
+        cpu_t* c = &g_cpus[g_cpu_count];
+        c->index = g_cpu_count;
+        c->apic_id = m->cpu_apic_id[i];
+        c->online = 0;
+        g_apic_to_cpu[c->apic_id] = (uint8_t)c->index;
+
+        if (start_ap(c) == 0) {
+            g_cpu_count++;
+        } else {
+            g_apic_to_cpu[c->apic_id] = 0;
+            console_puts("[smp] cpu with apic id ");
+            print_u32(c->apic_id);
+            console_puts(" did not start\n");
+        }
+    }
+
+    console_puts("[smp] cpus online=");
+    print_u32((uint32_t)g_cpu_count);
+    console_putc('\n');
+}
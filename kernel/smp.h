@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+#define SMP_MAX_CPUS 8
+
+struct proc;
+
+// Per-CPU state. Only the owning CPU writes it, except where noted.
+typedef struct cpu {
+    int index;
+    uint32_t apic_id;
+    volatile int online;          // set by the CPU itself once it schedules
+    struct proc* current;
+    struct proc* idle;            // boot context: never exits, always runnable
+    struct proc* exiting;         // task whose stack this CPU just left
+    int need_resched;
+    volatile int halted;          // inside proc_idle()'s hlt; read by smp_wake_*()
+    uint32_t idle_ticks;
+    uint32_t kstack;              // AP boot stack (PMM pages), 0 for the BSP
+} cpu_t;
+
+void smp_init(uint32_t mb2_info_addr);
+cpu_t* cpu_this(void);
+cpu_t* cpu_get(int index);
+int smp_cpu_count(void);
+void smp_wake_idle(void);
+void smp_wake_cpu(cpu_t* c);
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+
+// Ticket lock: CPUs acquire in arrival order, so none can starve. The
+// irqsave variants also keep interrupt handlers on this CPU from spinning
+// on a lock the interrupted code already holds.
+typedef struct {
+    volatile uint16_t next;
+    volatile uint16_t owner;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0, 0 }
+
+static inline void spin_lock(spinlock_t* l) {
+    uint16_t ticket = __atomic_fetch_add(&l->next, 1, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&l->owner, __ATOMIC_ACQUIRE) != ticket) {
+        __asm__ __volatile__("pause");
+    }
+}
+
+static inline void spin_unlock(spinlock_t* l) {
+    __atomic_store_n(&l->owner, (uint16_t)(l->owner + 1), __ATOMIC_RELEASE);
+}
+
+static inline uint32_t spin_lock_irqsave(spinlock_t* l) {
+    uint32_t flags;
+    __asm__ __volatile__("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    spin_lock(l);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* l, uint32_t flags) {
+    spin_unlock(l);
+    if (flags & 0x200) __asm__ __volatile__("sti" : : : "memory");
+}
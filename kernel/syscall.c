@@ -3,39 +3,372 @@
 #include "console.h"
 #include "pit.h"
 #include "keyboard.h"
+#include "proc.h"
+#include "vmm.h"
+#include "gdt.h"
+#include "ring.h"
+#include "wait.h"
+#include "vdso.h"
+#include "vfs.h"
+#include "smp.h"
+#include "spinlock.h"
 
 enum {
     SYS_WRITE = 1,
     SYS_EXIT = 2,
     SYS_GET_TICKS = 3,
     SYS_READ_KEY = 4,
+    SYS_FEATURES = 5,
+    SYS_RING_SETUP = 6,   // (flags) -> ring address
+    SYS_RING_ENTER = 7,   // (to_submit, min_complete) -> entries submitted
+    SYS_WRITEV = 8,       // (iov, count) -> bytes written
+    SYS_BWRITE = 9,       // (buf, len) into the process's output buffer
+    SYS_FLUSH = 10,
+    SYS_WAIT_KEY = 11,    // (timeout_ms, 0 = none) -> key, or -1 on timeout
+    SYS_SLEEP = 12,       // (ms)
+    SYS_OPEN = 13,        // (path, flags) -> fd; read-only
+    SYS_READ = 14,        // (fd, buf, len) -> bytes read, 0 at end of file
+    SYS_SEEK = 15,        // (fd, off, whence) -> new position
+    SYS_CLOSE = 16,       // (fd)
+    SYS_STAT = 17,        // (path, vfs_stat_t*)
+    SYS_COUNT
 };
 
-uint32_t syscall_dispatch(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3) {
-    (void)a3;
+static const char* const g_names[SYS_COUNT] = {
+    "?", "write", "exit", "get_ticks", "read_key", "features", "ring_setup", "ring_enter",
+    "writev", "bwrite", "flush", "wait_key", "sleep", "open", "read", "seek", "close", "stat",
+};
+
+// Per-CPU counters, so the hot path takes no lock: a CPU runs one syscall
+// at a time and interrupt handlers make none. Unknown numbers count as 0.
+#define SYS_HIST_BUCKETS 32   // bucket k: calls of 2^k to 2^(k+1) - 1 cycles
+#define SYS_TRACE_SIZE   64
+
+typedef struct {
+    uint32_t calls;
+    uint32_t errors;      // returned -1
+    uint32_t hist[SYS_HIST_BUCKETS];
+} sys_stat_t;
+
+typedef struct {
+    uint32_t pid;
+    int cpu;
+    uint32_t num;
+    uint32_t a1, a2, a3;
+    uint32_t ret;
+    uint32_t cycles;
+} sys_trace_t;
+
+static sys_stat_t g_stats[SMP_MAX_CPUS][SYS_COUNT];
+static sys_trace_t g_trace[SYS_TRACE_SIZE];
+static uint32_t g_trace_next = 0;
+static int g_trace_on = 0;
+static spinlock_t g_trace_lock = SPINLOCK_INIT;
+
+#define SYS_OPEN_FLAGS (VFS_O_READ | VFS_O_DIRECT)
+
+#define SYS_IOV_MAX 16
+
+typedef struct {
+    uint32_t base;
+    uint32_t len;
+} sys_iovec_t;
 
+#define SYS_FEAT_SYSENTER 0x1   // SYSENTER entry is set up (see sysenter_stub)
+#define SYS_FEAT_VDSO     0x2   // time page mapped at PROC_VDSO_BASE (vdso.h)
+
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+extern void sysenter_stub(void);
+
+static uint32_t g_features = 0;
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+static void print_hex32(uint32_t v) {
+    const char* hex = "0123456789ABCDEF";
+    console_puts("0x");
+    for (int i = 7; i >= 0; i--) console_putc(hex[(v >> (i * 4)) & 0xF]);
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint32_t lo) {
+    __asm__ __volatile__("wrmsr" : : "c"(msr), "a"(lo), "d"(0));
+}
+
+// CPUID reports SEP on the first Pentium Pro steppings, which lack it.
+static int cpu_has_sysenter(void) {
+    uint32_t a, b, c, d;
+    __asm__ __volatile__("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(1));
+    if (!((d >> 11) & 1)) return 0;
+    uint32_t family = (a >> 8) & 0xF, model = (a >> 4) & 0xF, stepping = a & 0xF;
+    return !(family == 6 && model < 3 && stepping < 3);
+}
+
+// Per CPU, after its GDT and TSS: SYSENTER lands in ring 0 on GDT_KERNEL_CODE
+// (SYSEXIT derives the user selectors from it) with esp pointing at the
+// TSS's esp0 slot.
+void syscall_init_cpu(int cpu) {
+    if (!cpu_has_sysenter()) return;
+
+    wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_CODE);
+    wrmsr(MSR_SYSENTER_ESP, gdt_kernel_stack_slot(cpu));
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_stub);
+    if (cpu == 0) g_features |= SYS_FEAT_SYSENTER;
+}
+
+// Pointers from ring 3 must lie in mapped user pages of the calling process.
+static int user_ok(uint32_t addr, uint32_t len, int write) {
+    if (!proc_current()) return 1;
+    return vmm_check_user(addr, len, write) == 0;
+}
+
+// Copies a NUL-terminated user path, checking each page as it is reached.
+static int copy_path(uint32_t addr, char out[VFS_PATH_MAX]) {
+    for (uint32_t i = 0; i < VFS_PATH_MAX; i++) {
+        if ((i == 0 || ((addr + i) & 0xFFFu) == 0) && !user_ok(addr + i, 1, 0)) return -1;
+        out[i] = ((const char*)addr)[i];
+        if (!out[i]) return 0;
+    }
+    return -1;
+}
+
+static uint32_t sys_open(uint32_t path_addr, uint32_t flags) {
+    char path[VFS_PATH_MAX];
+    proc_t* p = proc_current();
+    if (!p || copy_path(path_addr, path) < 0 || (flags & ~SYS_OPEN_FLAGS)) return (uint32_t)-1;
+
+    int vfd = vfs_open(path, (int)(flags | VFS_O_READ));
+    if (vfd < 0) return (uint32_t)-1;
+    int fd = proc_file_add(p, vfd);
+    if (fd < 0) vfs_close(vfd);
+    return (uint32_t)fd;
+}
+
+// Data lands in the caller's buffer straight from the page cache, or with
+// VFS_O_DIRECT from the block cache or the disk: no kernel bounce buffer.
+static uint32_t sys_read(uint32_t fd, uint32_t buf, uint32_t len) {
+    int vfd = proc_file(proc_current(), (int)fd);
+    if (vfd < 0 || !buf || !user_ok(buf, len, 1)) return (uint32_t)-1;
+    return (uint32_t)vfs_read(vfd, (void*)buf, len);
+}
+
+static uint32_t sys_stat(uint32_t path_addr, uint32_t st) {
+    char path[VFS_PATH_MAX];
+    if (copy_path(path_addr, path) < 0 || !st || !user_ok(st, sizeof(vfs_stat_t), 1)) return (uint32_t)-1;
+    return (uint32_t)vfs_stat(path, (vfs_stat_t*)st);
+}
+
+// Gathers a user iovec array into one console write.
+static uint32_t sys_writev(uint32_t iov_addr, uint32_t count) {
+    if (count > SYS_IOV_MAX || !user_ok(iov_addr, count * sizeof(sys_iovec_t), 0)) return (uint32_t)-1;
+
+    const sys_iovec_t* iov = (const sys_iovec_t*)iov_addr;
+    console_iov_t out[SYS_IOV_MAX];
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        out[i].base = (const char*)iov[i].base;
+        out[i].len = iov[i].len;
+        if (!user_ok(iov[i].base, out[i].len, 0)) return (uint32_t)-1;
+        total += out[i].len;
+    }
+
+    proc_out_flush(proc_current());
+    console_writev(out, count);
+    return total;
+}
+
+static uint32_t dispatch(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3) {
     switch (num) {
         case SYS_WRITE: {
             const char* s = (const char*)a1;
             uint32_t len = a2;
-            if (!s) return (uint32_t)-1;
-            for (uint32_t i = 0; i < len; i++) {
-                char c = s[i];
-                if (!c) break;
-                console_putc(c);
-            }
+            if (!s || !user_ok(a1, len, 0)) return (uint32_t)-1;
+            uint32_t n = 0;
+            while (n < len && s[n]) n++;
+            proc_out_flush(proc_current());
+            console_write(s, n);
             return len;
         }
         case SYS_EXIT:
+            proc_exit((int)a1);
             return a1;
         case SYS_GET_TICKS:
             return pit_get_ticks();
         case SYS_READ_KEY: {
+            proc_out_flush(proc_current());
             int c = keyboard_read_char();
             if (c < 0) return 0xFFFFFFFFu;
             return (uint32_t)c;
         }
+        case SYS_FEATURES:
+            return g_features | (vdso_page() ? SYS_FEAT_VDSO : 0);
+        case SYS_RING_SETUP:
+            return (uint32_t)ring_setup(proc_current(), a1);
+        case SYS_RING_ENTER:
+            return (uint32_t)ring_enter(proc_current(), a1, a2);
+        case SYS_WRITEV:
+            return sys_writev(a1, a2);
+        case SYS_BWRITE:
+            if (!a1 || !user_ok(a1, a2, 0)) return (uint32_t)-1;
+            proc_out_write(proc_current(), (const char*)a1, a2);
+            return a2;
+        case SYS_FLUSH:
+            proc_out_flush(proc_current());
+            return 0;
+        case SYS_WAIT_KEY: {
+            proc_out_flush(proc_current());
+            uint32_t timeout = a1 ? pit_ms_to_ticks(a1) : WAIT_FOREVER;
+            return (uint32_t)keyboard_wait_char(timeout);
+        }
+        case SYS_SLEEP:
+            pit_sleep(a1);
+            return 0;
+        case SYS_OPEN:
+            return sys_open(a1, a2);
+        case SYS_READ:
+            return sys_read(a1, a2, a3);
+        case SYS_SEEK: {
+            int vfd = proc_file(proc_current(), (int)a1);
+            if (vfd < 0) return (uint32_t)-1;
+            return (uint32_t)vfs_seek(vfd, (int32_t)a2, (int)a3);
+        }
+        case SYS_CLOSE:
+            return (uint32_t)proc_file_close(proc_current(), (int)a1);
+        case SYS_STAT:
+            return sys_stat(a1, a2);
         default:
             return 0xFFFFFFFFu;
     }
 }
+
+static void trace(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t ret, uint32_t cycles) {
+    proc_t* p = proc_current();
+    uint32_t flags = spin_lock_irqsave(&g_trace_lock);
+    sys_trace_t* t = &g_trace[g_trace_next++ % SYS_TRACE_SIZE];
+    t->pid = p ? p->pid : 0;
+    t->cpu = cpu_this()->index;
+    t->num = num;
+    t->a1 = a1;
+    t->a2 = a2;
+    t->a3 = a3;
+    t->ret = ret;
+    t->cycles = cycles;
+    spin_unlock_irqrestore(&g_trace_lock, flags);
+}
+
+// Entry from both int 0x80 and SYSENTER: counts the call, files its
+// latency in kernel cycles (including any time it blocked) under its log2
+// bucket, and logs it when tracing is on. SYS_EXIT does not return and is
+// logged before it runs.
+uint32_t syscall_dispatch(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3) {
+    sys_stat_t* st = &g_stats[cpu_this()->index][num < SYS_COUNT ? num : 0];
+    st->calls++;
+    if (num == SYS_EXIT && g_trace_on) trace(num, a1, a2, a3, a1, 0);
+
+    uint64_t t0 = rdtsc();
+    uint32_t ret = dispatch(num, a1, a2, a3);
+    uint64_t cycles = rdtsc() - t0;
+
+    // The task may have blocked; it is still on the same CPU.
+    uint32_t c = cycles >> 32 ? 0xFFFFFFFFu : (uint32_t)cycles;
+    st->hist[c ? 31 - __builtin_clz(c) : 0]++;
+    if (ret == 0xFFFFFFFFu) st->errors++;
+    if (g_trace_on) trace(num, a1, a2, a3, ret, c);
+    return ret;
+}
+
+void syscall_trace(int on) {
+    g_trace_on = on;
+}
+
+// Calls, errors and latency buckets per syscall, summed over CPUs; then
+// clears them.
+void syscall_stat_dump(void) {
+    uint32_t total = 0;
+    for (uint32_t n = 0; n < SYS_COUNT; n++) {
+        sys_stat_t sum = { 0, 0, { 0 } };
+        for (int c = 0; c < smp_cpu_count(); c++) {
+            sys_stat_t* st = &g_stats[c][n];
+            sum.calls += st->calls;
+            sum.errors += st->errors;
+            for (int b = 0; b < SYS_HIST_BUCKETS; b++) sum.hist[b] += st->hist[b];
+        }
+        if (!sum.calls) continue;
+        total += sum.calls;
+
+        console_puts(g_names[n]);
+        console_puts(" calls=");
+        print_u32(sum.calls);
+        console_puts(" errors=");
+        print_u32(sum.errors);
+        console_puts(" cycles");
+        for (int b = 0; b < SYS_HIST_BUCKETS; b++) {
+            if (!sum.hist[b]) continue;
+            console_puts(" 2^");
+            print_u32((uint32_t)b);
+            console_putc(':');
+            print_u32(sum.hist[b]);
+        }
+        console_putc('\n');
+    }
+    console_puts("[sys] total calls=");
+    print_u32(total);
+    console_puts(g_trace_on ? " trace=on\n" : " trace=off\n");
+
+    for (int c = 0; c < SMP_MAX_CPUS; c++) {
+        for (uint32_t n = 0; n < SYS_COUNT; n++) {
+            sys_stat_t* st = &g_stats[c][n];
+            st->calls = st->errors = 0;
+            for (int b = 0; b < SYS_HIST_BUCKETS; b++) st->hist[b] = 0;
+        }
+    }
+}
+
+// The traced calls still in the ring buffer, oldest first.
+void syscall_trace_dump(void) {
+    uint32_t flags = spin_lock_irqsave(&g_trace_lock);
+    uint32_t end = g_trace_next;
+    spin_unlock_irqrestore(&g_trace_lock, flags);
+    uint32_t start = end > SYS_TRACE_SIZE ? end - SYS_TRACE_SIZE : 0;
+
+    for (uint32_t i = start; i < end; i++) {
+        const sys_trace_t* t = &g_trace[i % SYS_TRACE_SIZE];
+        console_puts("pid=");
+        print_u32(t->pid);
+        console_puts(" cpu=");
+        print_u32((uint32_t)t->cpu);
+        console_putc(' ');
+        console_puts(t->num < SYS_COUNT ? g_names[t->num] : "?");
+        console_putc('(');
+        print_hex32(t->a1);
+        console_puts(", ");
+        print_hex32(t->a2);
+        console_puts(", ");
+        print_hex32(t->a3);
+        console_puts(") = ");
+        print_hex32(t->ret);
+        console_puts(" cycles=");
+        print_u32(t->cycles);
+        console_putc('\n');
+    }
+}
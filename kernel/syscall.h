@@ -1,4 +1,9 @@
 #pragma once
 #include <stdint.h>
 
+void syscall_init_cpu(int cpu);
 uint32_t syscall_dispatch(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3);
+
+void syscall_trace(int on);
+void syscall_stat_dump(void);
+void syscall_trace_dump(void);
@@ -0,0 +1,268 @@
+#include <stdint.h>
+#include "tmpfs.h"
+#include "vfs.h"
+#include "kheap.h"
+#include "pmm.h"
+#include "pit.h"
+
+#define PAGE_SIZE 4096
+
+// File data lives in whole PMM pages listed in a kheap-allocated array;
+// directories are singly linked child lists. Nodes stay resident until
+// unlinked, so vnode references need no bookkeeping beyond the VFS count.
+typedef struct tmpfs_node {
+    vnode_t vn;
+    char name[VFS_NAME_MAX + 1];
+    struct tmpfs_node* parent;
+    struct tmpfs_node* children;
+    struct tmpfs_node* next;
+    uint32_t* pages;
+    uint32_t page_cap;
+    uint32_t page_count;
+    int unlinked;
+} tmpfs_node_t;
+
+static uint32_t g_next_ino = 1;
+
+static const vnode_ops_t tmpfs_ops;
+
+static int name_eq(const char* a, const char* b) {
+    while (*a && *b) {
+        if (*a != *b) return 0;
+        a++;
+        b++;
+    }
+    return *a == 0 && *b == 0;
+}
+
+static void mem_copy(uint8_t* dst, const uint8_t* src, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) dst[i] = src[i];
+}
+
+static void mem_zero(uint8_t* dst, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) dst[i] = 0;
+}
+
+static tmpfs_node_t* new_node(tmpfs_node_t* parent, const char* name, uint32_t type) {
+    tmpfs_node_t* n = (tmpfs_node_t*)kmalloc(sizeof(tmpfs_node_t));
+    if (!n) return 0;
+
+    n->vn.ops = &tmpfs_ops;
+    n->vn.mnt = parent ? parent->vn.mnt : 0;
+    n->vn.type = type;
+    n->vn.size = 0;
+    n->vn.ino = g_next_ino++;
+    n->vn.mtime = pit_get_ticks();
+    n->vn.refs = 0;
+
+    int i = 0;
+    for (; name[i] && i < VFS_NAME_MAX; i++) n->name[i] = name[i];
+    n->name[i] = 0;
+
+    n->parent = parent;
+    n->children = 0;
+    n->next = 0;
+    n->pages = 0;
+    n->page_cap = 0;
+    n->page_count = 0;
+    n->unlinked = 0;
+
+    if (parent) {
+        n->next = parent->children;
+        parent->children = n;
+    }
+    return n;
+}
+
+static tmpfs_node_t* find_child(tmpfs_node_t* dir, const char* name) {
+    for (tmpfs_node_t* c = dir->children; c; c = c->next) {
+        if (name_eq(c->name, name)) return c;
+    }
+    return 0;
+}
+
+static void free_pages_from(tmpfs_node_t* n, uint32_t keep) {
+    while (n->page_count > keep) {
+        n->page_count--;
+        pmm_free_page(n->pages[n->page_count]);
+    }
+}
+
+static void destroy(tmpfs_node_t* n) {
+    free_pages_from(n, 0);
+    if (n->pages) kfree(n->pages);
+    kfree(n);
+}
+
+static int reserve_pages(tmpfs_node_t* n, uint32_t bytes) {
+    uint32_t need = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (need <= n->page_count) return 0;
+
+    if (need > n->page_cap) {
+        uint32_t cap = n->page_cap ? n->page_cap : 4;
+        while (cap < need) cap *= 2;
+
+        uint32_t* list = (uint32_t*)kmalloc(cap * sizeof(uint32_t));
+        if (!list) return -1;
+        for (uint32_t i = 0; i < n->page_count; i++) list[i] = n->pages[i];
+        if (n->pages) kfree(n->pages);
+        n->pages = list;
+        n->page_cap = cap;
+    }
+
+    while (n->page_count < need) {
+        uint32_t page = pmm_alloc_page();
+        if (!page) return -1;
+        mem_zero((uint8_t*)page, PAGE_SIZE);
+        n->pages[n->page_count++] = page;
+    }
+    return 0;
+}
+
+static int tmpfs_lookup(vnode_t* dir, const char* name, vnode_t** out) {
+    tmpfs_node_t* c = find_child((tmpfs_node_t*)dir, name);
+    if (!c) return -1;
+    vfs_ref(&c->vn);
+    *out = &c->vn;
+    return 0;
+}
+
+static int tmpfs_create(vnode_t* dir, const char* name, vnode_t** out) {
+    tmpfs_node_t* d = (tmpfs_node_t*)dir;
+    if (find_child(d, name)) return -1;
+
+    tmpfs_node_t* n = new_node(d, name, VFS_FILE);
+    if (!n) return -1;
+    d->vn.mtime = pit_get_ticks();
+    vfs_ref(&n->vn);
+    *out = &n->vn;
+    return 0;
+}
+
+static int tmpfs_mkdir(vnode_t* dir, const char* name) {
+    tmpfs_node_t* d = (tmpfs_node_t*)dir;
+    if (find_child(d, name)) return -1;
+    if (!new_node(d, name, VFS_DIR)) return -1;
+    d->vn.mtime = pit_get_ticks();
+    return 0;
+}
+
+static int tmpfs_unlink(vnode_t* dir, const char* name) {
+    tmpfs_node_t* d = (tmpfs_node_t*)dir;
+
+    tmpfs_node_t** link = &d->children;
+    while (*link && !name_eq((*link)->name, name)) link = &(*link)->next;
+
+    tmpfs_node_t* n = *link;
+    if (!n) return -1;
+    if (n->vn.type == VFS_DIR && n->children) return -1;
+
+    *link = n->next;
+    n->parent = 0;
+    n->unlinked = 1;
+    d->vn.mtime = pit_get_ticks();
+
+    // Open files keep their data until the last reference goes away.
+    if (n->vn.refs == 0) destroy(n);
+    return 0;
+}
+
+static int tmpfs_readdir(vnode_t* dir, vfs_filldir_t fn, void* ctx) {
+    for (tmpfs_node_t* c = ((tmpfs_node_t*)dir)->children; c; c = c->next) {
+        if (fn(ctx, c->name, c->vn.type, c->vn.size)) break;
+    }
+    return 0;
+}
+
+static int tmpfs_read(vnode_t* vn, uint32_t off, void* buf, uint32_t n) {
+    tmpfs_node_t* f = (tmpfs_node_t*)vn;
+    if (off >= vn->size) return 0;
+    if (n > vn->size - off) n = vn->size - off;
+
+    uint8_t* out = (uint8_t*)buf;
+    uint32_t done = 0;
+    while (done < n) {
+        uint32_t pos = off + done;
+        uint32_t in_page = pos % PAGE_SIZE;
+        uint32_t chunk = PAGE_SIZE - in_page;
+        if (chunk > n - done) chunk = n - done;
+
+        mem_copy(out + done, (const uint8_t*)(f->pages[pos / PAGE_SIZE] + in_page), chunk);
+        done += chunk;
+    }
+    return (int)done;
+}
+
+static int tmpfs_write(vnode_t* vn, uint32_t off, const void* buf, uint32_t n) {
+    tmpfs_node_t* f = (tmpfs_node_t*)vn;
+    if (n == 0) return 0;
+    if (off + n < off) return -1;
+    if (reserve_pages(f, off + n) < 0) return -1;
+
+    const uint8_t* in = (const uint8_t*)buf;
+    uint32_t done = 0;
+    while (done < n) {
+        uint32_t pos = off + done;
+        uint32_t in_page = pos % PAGE_SIZE;
+        uint32_t chunk = PAGE_SIZE - in_page;
+        if (chunk > n - done) chunk = n - done;
+
+        mem_copy((uint8_t*)(f->pages[pos / PAGE_SIZE] + in_page), in + done, chunk);
+        done += chunk;
+    }
+
+    if (off + n > vn->size) vn->size = off + n;
+    vn->mtime = pit_get_ticks();
+    return (int)n;
+}
+
+static int tmpfs_truncate(vnode_t* vn, uint32_t len) {
+    tmpfs_node_t* f = (tmpfs_node_t*)vn;
+
+    if (len > vn->size) {
+        if (reserve_pages(f, len) < 0) return -1;
+    } else {
+        uint32_t keep = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+        free_pages_from(f, keep);
+        // Bytes past the new end must read back as zero if the file regrows.
+        if (len % PAGE_SIZE) {
+            uint32_t tail = len % PAGE_SIZE;
+            mem_zero((uint8_t*)(f->pages[keep - 1] + tail), PAGE_SIZE - tail);
+        }
+    }
+
+    vn->size = len;
+    vn->mtime = pit_get_ticks();
+    return 0;
+}
+
+// Only ranges inside one data page are contiguous in memory.
+static const void* tmpfs_map(vnode_t* vn, uint32_t off, uint32_t len) {
+    tmpfs_node_t* f = (tmpfs_node_t*)vn;
+    if (len == 0 || off + len < off || off + len > vn->size) return 0;
+    if (off / PAGE_SIZE != (off + len - 1) / PAGE_SIZE) return 0;
+    return (const void*)(f->pages[off / PAGE_SIZE] + off % PAGE_SIZE);
+}
+
+static void tmpfs_release(vnode_t* vn) {
+    tmpfs_node_t* n = (tmpfs_node_t*)vn;
+    if (n->unlinked) destroy(n);
+}
+
+static const vnode_ops_t tmpfs_ops = {
+    .lookup = tmpfs_lookup,
+    .create = tmpfs_create,
+    .mkdir = tmpfs_mkdir,
+    .unlink = tmpfs_unlink,
+    .readdir = tmpfs_readdir,
+    .read = tmpfs_read,
+    .write = tmpfs_write,
+    .truncate = tmpfs_truncate,
+    .map = tmpfs_map,
+    .release = tmpfs_release,
+};
+
+vnode_t* tmpfs_create_root(void) {
+    tmpfs_node_t* root = new_node(0, "/", VFS_DIR);
+    return root ? &root->vn : 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+#include "vfs.h"
+
+// Each call returns the root of a new, empty RAM-backed file system.
+vnode_t* tmpfs_create_root(void);
@@ -0,0 +1,115 @@
+#include <stdint.h>
+#include "vdso.h"
+#include "pmm.h"
+#include "pit.h"
+#include "console.h"
+
+#define VDSO_CAL_TICKS 5
+
+static vdso_data_t* g_data = 0;
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+static int has_tsc(void) {
+    uint32_t a, b, c, d;
+    __asm__ __volatile__("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(1));
+    return (d >> 4) & 1;
+}
+
+static inline void rdtsc(uint32_t* lo, uint32_t* hi) {
+    __asm__ __volatile__("rdtsc" : "=a"(*lo), "=d"(*hi));
+}
+
+// floor(num * 2^32 / den) for num < den, by long division.
+static uint32_t frac32(uint32_t num, uint32_t den) {
+    uint32_t q = 0;
+    for (int i = 0; i < 32; i++) {
+        int carry = num >> 31;
+        num <<= 1;
+        q <<= 1;
+        if (carry || num >= den) {
+            num -= den;
+            q |= 1;
+        }
+    }
+    return q;
+}
+
+// TSC cycles across VDSO_CAL_TICKS PIT ticks. Interrupts on.
+static uint32_t calibrate(void) {
+    uint32_t lo0, hi0, lo1, hi1;
+    uint32_t t = pit_get_ticks();
+    while (pit_get_ticks() == t) __asm__ __volatile__("hlt");
+    rdtsc(&lo0, &hi0);
+
+    t = pit_get_ticks();
+    while (pit_get_ticks() - t < VDSO_CAL_TICKS) __asm__ __volatile__("hlt");
+    rdtsc(&lo1, &hi1);
+
+    if (hi1 - hi0 - (lo1 < lo0) != 0) return 0;   // does not fit 32 bits
+    return (lo1 - lo0) / VDSO_CAL_TICKS;
+}
+
+// Once the PIT is ticking and interrupts are on.
+void vdso_init(void) {
+    uint32_t page = pmm_alloc_page();
+    if (!page) {
+        console_puts("[vdso] no memory\n");
+        return;
+    }
+
+    uint8_t* b = (uint8_t*)page;
+    for (uint32_t i = 0; i < 4096; i++) b[i] = 0;
+    vdso_data_t* d = (vdso_data_t*)page;
+    d->hz = pit_get_hz();
+    d->us_per_tick = 1000000 / d->hz;
+
+    uint32_t tpt = has_tsc() ? calibrate() : 0;
+    if (tpt > d->us_per_tick) {
+        d->tsc_per_tick = tpt;
+        d->tsc_us_mult = frac32(d->us_per_tick, tpt);
+    }
+    __atomic_store_n(&g_data, d, __ATOMIC_RELEASE);
+
+    console_puts("[vdso] hz=");
+    print_u32(d->hz);
+    console_puts(" tsc/tick=");
+    print_u32(d->tsc_per_tick);
+    console_putc('\n');
+}
+
+// PIT tick on the BSP, the only writer. x86 keeps the stores in program
+// order, so only the compiler needs fencing.
+void vdso_tick(uint32_t ticks) {
+    vdso_data_t* d = g_data;
+    if (!d) return;
+
+    uint32_t lo, hi;
+    if (d->tsc_per_tick) rdtsc(&lo, &hi);
+    else lo = hi = 0;
+
+    d->seq++;
+    __asm__ __volatile__("" : : : "memory");
+    d->ticks = ticks;
+    d->tsc_lo = lo;
+    d->tsc_hi = hi;
+    __asm__ __volatile__("" : : : "memory");
+    d->seq++;
+}
+
+// Physical page to map into processes, or 0 before vdso_init().
+uint32_t vdso_page(void) {
+    return (uint32_t)g_data;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+
+// Time data the kernel publishes in one read-only page mapped at
+// PROC_VDSO_BASE in every process, so programs read the clock without a
+// trap. The BSP rewrites it on every PIT tick under a seqlock: `seq` is odd
+// while an update is in progress, and a reader retries unless it saw the
+// same even value before and after reading. Offsets are part of the user
+// ABI (disk/vdso.inc).
+typedef struct {
+    volatile uint32_t seq;      // 0x00
+    volatile uint32_t ticks;    // 0x04 PIT ticks since boot
+    uint32_t hz;                // 0x08 PIT ticks per second
+    volatile uint32_t tsc_lo;   // 0x0C TSC at the last tick
+    volatile uint32_t tsc_hi;   // 0x10
+    uint32_t tsc_per_tick;      // 0x14 0 when the TSC is not usable
+    uint32_t us_per_tick;       // 0x18
+    uint32_t tsc_us_mult;       // 0x1C microseconds per TSC cycle, 0.32 fixed point
+} vdso_data_t;
+
+void vdso_init(void);
+void vdso_tick(uint32_t ticks);
+uint32_t vdso_page(void);
@@ -0,0 +1,708 @@
+#include <stdint.h>
+#include "vfs.h"
+#include "console.h"
+#include "pcache.h"
+#include "vmm.h"
+#include "wait.h"
+
+typedef struct {
+    int used;
+    int flags;
+    vnode_t* vn;
+    uint32_t pos;
+} vfs_file_t;
+
+typedef struct {
+    int used;
+    vnode_t* vn;
+    uint32_t base;
+    uint32_t pages;
+    uint32_t first_index;
+} vfs_mapping_t;
+
+static vfs_mount_t g_mounts[VFS_MAX_MOUNTS];
+static vfs_file_t g_files[VFS_MAX_OPEN];
+static vfs_mapping_t g_maps[VFS_MAX_MAPS];
+static vfs_change_fn g_watchers[VFS_MAX_WATCHERS];
+static uint32_t g_next_mount_id = 1;
+
+// Tasks on any CPU use the VFS; one at a time is inside it (and below it:
+// page cache, block cache, backends). Public entry points take the lock
+// and call the *_locked function that does the work.
+static mutex_t g_lock = MUTEX_INIT;
+
+static uint32_t str_len(const char* s) {
+    uint32_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+static void str_copy(char* dst, const char* src, uint32_t max) {
+    uint32_t i = 0;
+    for (; src[i] && i + 1 < max; i++) dst[i] = src[i];
+    dst[i] = 0;
+}
+
+static int str_eq_n(const char* a, const char* b, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) return 0;
+    }
+    return 1;
+}
+
+// Produces an absolute path with "." and ".." resolved and repeated slashes
+// collapsed, e.g. "tmp//a/../b" -> "/tmp/b". Paths are always rooted.
+static int normalize(const char* in, char out[VFS_PATH_MAX]) {
+    uint32_t len = 0;
+    out[len++] = '/';
+
+    const char* p = in;
+    while (*p) {
+        while (*p == '/') p++;
+        if (!*p) break;
+
+        const char* comp = p;
+        uint32_t n = 0;
+        while (p[n] && p[n] != '/') n++;
+        p += n;
+
+        if (n == 1 && comp[0] == '.') continue;
+        if (n == 2 && comp[0] == '.' && comp[1] == '.') {
+            while (len > 1 && out[len - 1] != '/') len--;
+            if (len > 1) len--;
+            continue;
+        }
+        if (n > VFS_NAME_MAX) return -1;
+
+        if (len > 1) {
+            if (len + 1 >= VFS_PATH_MAX) return -1;
+            out[len++] = '/';
+        }
+        if (len + n >= VFS_PATH_MAX) return -1;
+        for (uint32_t i = 0; i < n; i++) out[len++] = comp[i];
+    }
+
+    out[len] = 0;
+    return 0;
+}
+
+// Longest mount point that is a whole-component prefix of `path`.
+static vfs_mount_t* find_mount(const char* path, const char** rest) {
+    vfs_mount_t* best = 0;
+    uint32_t best_len = 0;
+
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mount_t* m = &g_mounts[i];
+        if (!m->used) continue;
+
+        uint32_t n = str_len(m->path);
+        if (n == 1) {
+            if (!best) {
+                best = m;
+                best_len = 0;
+            }
+            continue;
+        }
+        if (!str_eq_n(path, m->path, n)) continue;
+        if (path[n] != 0 && path[n] != '/') continue;
+        if (n > best_len) {
+            best = m;
+            best_len = n;
+        }
+    }
+
+    if (best) *rest = path + best_len;
+    return best;
+}
+
+int vfs_watch(vfs_change_fn fn) {
+    for (int i = 0; i < VFS_MAX_WATCHERS; i++) {
+        if (!g_watchers[i]) {
+            g_watchers[i] = fn;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void notify_change(uint32_t mount_id, uint32_t ino) {
+    for (int i = 0; i < VFS_MAX_WATCHERS; i++) {
+        if (g_watchers[i]) g_watchers[i](mount_id, ino);
+    }
+}
+
+static void changed(const vnode_t* vn) {
+    notify_change(vn->mnt ? vn->mnt->id : 0, vn->ino);
+}
+
+void vfs_ref(vnode_t* vn) {
+    if (vn) vn->refs++;
+}
+
+void vfs_release(vnode_t* vn) {
+    if (!vn || vn->refs == 0) return;
+    vn->refs--;
+    if (vn->refs == 0 && vn->ops->release) vn->ops->release(vn);
+}
+
+// Walks a normalized path and returns a referenced vnode.
+static int walk(const char* norm, vnode_t** out) {
+    const char* rest = 0;
+    vfs_mount_t* m = find_mount(norm, &rest);
+    if (!m) return -1;
+
+    vnode_t* cur = m->root;
+    vfs_ref(cur);
+
+    char comp[VFS_NAME_MAX + 1];
+    while (*rest) {
+        while (*rest == '/') rest++;
+        if (!*rest) break;
+
+        uint32_t n = 0;
+        while (rest[n] && rest[n] != '/') {
+            comp[n] = rest[n];
+            n++;
+        }
+        comp[n] = 0;
+        rest += n;
+
+        vnode_t* next = 0;
+        if (cur->type != VFS_DIR || !cur->ops->lookup || cur->ops->lookup(cur, comp, &next) < 0) {
+            vfs_release(cur);
+            return -1;
+        }
+        vfs_release(cur);
+        cur = next;
+    }
+
+    *out = cur;
+    return 0;
+}
+
+// Resolves the directory holding the last component of `path`.
+static int walk_parent(const char* path, vnode_t** dir, char leaf[VFS_NAME_MAX + 1]) {
+    char norm[VFS_PATH_MAX];
+    if (normalize(path, norm) < 0) return -1;
+
+    uint32_t len = str_len(norm);
+    if (len <= 1) return -1;
+
+    uint32_t slash = len;
+    while (slash > 0 && norm[slash - 1] != '/') slash--;
+    str_copy(leaf, norm + slash, VFS_NAME_MAX + 1);
+
+    // A mount point is never created or removed through its parent.
+    const char* rest = 0;
+    vfs_mount_t* m = find_mount(norm, &rest);
+    if (!m || *rest == 0) return -1;
+
+    if (slash == 1) norm[1] = 0;
+    else norm[slash - 1] = 0;
+
+    if (walk(norm, dir) < 0) return -1;
+    if ((*dir)->type != VFS_DIR) {
+        vfs_release(*dir);
+        return -1;
+    }
+    return 0;
+}
+
+static int fd_valid(int fd) {
+    return fd >= 0 && fd < VFS_MAX_OPEN && g_files[fd].used;
+}
+
+void vfs_init(void) {
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) g_mounts[i].used = 0;
+    for (int i = 0; i < VFS_MAX_OPEN; i++) g_files[i].used = 0;
+    for (int i = 0; i < VFS_MAX_MAPS; i++) g_maps[i].used = 0;
+    for (int i = 0; i < VFS_MAX_WATCHERS; i++) g_watchers[i] = 0;
+    pcache_init();
+}
+
+int vfs_mount(const char* path, const char* fs_name, vnode_t* root, int (*sync)(void)) {
+    if (!root || root->type != VFS_DIR) return -1;
+
+    char norm[VFS_PATH_MAX];
+    if (normalize(path, norm) < 0) return -1;
+
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mount_t* m = &g_mounts[i];
+        if (m->used && str_len(m->path) == str_len(norm) && str_eq_n(m->path, norm, str_len(norm))) return -1;
+    }
+
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mount_t* m = &g_mounts[i];
+        if (m->used) continue;
+
+        m->used = 1;
+        m->id = g_next_mount_id++;
+        str_copy(m->path, norm, VFS_PATH_MAX);
+        m->fs_name = fs_name;
+        m->root = root;
+        m->sync = sync;
+        root->mnt = m;
+        vfs_ref(root);
+        return 0;
+    }
+
+    return -1;
+}
+
+void vfs_list_mounts(void) {
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mount_t* m = &g_mounts[i];
+        if (!m->used) continue;
+        console_puts(m->fs_name);
+        console_puts(" on ");
+        console_puts(m->path);
+        console_putc('\n');
+    }
+}
+
+static int open_locked(const char* path, int flags) {
+    if (!path) return -1;
+    if ((flags & (VFS_O_CREATE | VFS_O_TRUNC | VFS_O_APPEND)) && !(flags & VFS_O_WRITE)) return -1;
+
+    int fd = -1;
+    for (int i = 0; i < VFS_MAX_OPEN; i++) {
+        if (!g_files[i].used) {
+            fd = i;
+            break;
+        }
+    }
+    if (fd < 0) return -1;
+
+    char norm[VFS_PATH_MAX];
+    if (normalize(path, norm) < 0) return -1;
+
+    vnode_t* vn = 0;
+    if (walk(norm, &vn) < 0) {
+        if (!(flags & VFS_O_CREATE)) return -1;
+
+        vnode_t* dir = 0;
+        char leaf[VFS_NAME_MAX + 1];
+        if (walk_parent(norm, &dir, leaf) < 0) return -1;
+
+        int rc = dir->ops->create ? dir->ops->create(dir, leaf, &vn) : -1;
+        vfs_release(dir);
+        if (rc < 0) return -1;
+    }
+
+    if (vn->type != VFS_FILE || ((flags & VFS_O_WRITE) && !vn->ops->write)) {
+        vfs_release(vn);
+        return -1;
+    }
+
+    if ((flags & VFS_O_TRUNC) && vn->size > 0) {
+        if (!vn->ops->truncate || vn->ops->truncate(vn, 0) < 0) {
+            vfs_release(vn);
+            return -1;
+        }
+        pcache_truncate(vn, 0);
+        changed(vn);
+    }
+
+    vfs_file_t* f = &g_files[fd];
+    f->used = 1;
+    f->flags = flags;
+    f->vn = vn;
+    f->pos = 0;
+    return fd;
+}
+
+// Reads at `off` without moving the file position.
+static int pread_locked(int fd, void* buf, uint32_t n, uint32_t off) {
+    if (!fd_valid(fd) || !buf) return -1;
+
+    vfs_file_t* f = &g_files[fd];
+    int cached = (f->vn->ops->flags & VFS_OPS_PAGE_CACHE) && !(f->flags & VFS_O_DIRECT);
+    if (cached) return pcache_read(f->vn, off, buf, n);
+    return f->vn->ops->read(f->vn, off, buf, n);
+}
+
+static int read_locked(int fd, void* buf, uint32_t n) {
+    if (!fd_valid(fd)) return -1;
+
+    vfs_file_t* f = &g_files[fd];
+    int rc = pread_locked(fd, buf, n, f->pos);
+    if (rc > 0) f->pos += (uint32_t)rc;
+    return rc;
+}
+
+// Touches every page of a source buffer that may live in a file mapping, so
+// the backend never takes a fill fault in the middle of its own update.
+static void prefault(const void* buf, uint32_t n) {
+    uint32_t a = (uint32_t)buf;
+    if (n == 0 || a + n < VMM_WINDOW_BASE) return;
+
+    volatile const uint8_t* p = (volatile const uint8_t*)buf;
+    for (uint32_t off = 0; off < n; off += VMM_PAGE_SIZE - (a + off) % VMM_PAGE_SIZE) (void)p[off];
+    (void)p[n - 1];
+}
+
+static int write_locked(int fd, const void* buf, uint32_t n) {
+    if (!fd_valid(fd) || !buf) return -1;
+
+    vfs_file_t* f = &g_files[fd];
+    if (!(f->flags & VFS_O_WRITE)) return -1;
+    if (f->flags & VFS_O_APPEND) f->pos = f->vn->size;
+
+    prefault(buf, n);
+    int rc = f->vn->ops->write(f->vn, f->pos, buf, n);
+    if (rc > 0) {
+        pcache_update(f->vn, f->pos, buf, (uint32_t)rc);
+        changed(f->vn);
+        f->pos += (uint32_t)rc;
+    }
+    return rc;
+}
+
+static int seek_locked(int fd, int32_t off, int whence) {
+    if (!fd_valid(fd)) return -1;
+
+    vfs_file_t* f = &g_files[fd];
+    int32_t base;
+    if (whence == VFS_SEEK_SET) base = 0;
+    else if (whence == VFS_SEEK_CUR) base = (int32_t)f->pos;
+    else if (whence == VFS_SEEK_END) base = (int32_t)f->vn->size;
+    else return -1;
+
+    int32_t pos = base + off;
+    if (pos < 0) return -1;
+
+    f->pos = (uint32_t)pos;
+    return pos;
+}
+
+static int truncate_locked(int fd, uint32_t len) {
+    if (!fd_valid(fd)) return -1;
+
+    vfs_file_t* f = &g_files[fd];
+    if (!(f->flags & VFS_O_WRITE) || !f->vn->ops->truncate) return -1;
+    int rc = f->vn->ops->truncate(f->vn, len);
+    if (rc == 0) {
+        pcache_truncate(f->vn, len);
+        changed(f->vn);
+    }
+    return rc;
+}
+
+static void fill_stat(const vnode_t* vn, vfs_stat_t* st) {
+    st->type = vn->type;
+    st->size = vn->size;
+    st->ino = vn->ino;
+    st->mtime = vn->mtime;
+    st->mount_id = vn->mnt ? vn->mnt->id : 0;
+}
+
+static int fstat_locked(int fd, vfs_stat_t* st) {
+    if (!fd_valid(fd) || !st) return -1;
+    fill_stat(g_files[fd].vn, st);
+    return 0;
+}
+
+// The pointer stays valid only while the file is open and unmodified.
+static const void* map_locked(int fd, uint32_t off, uint32_t len) {
+    if (!fd_valid(fd)) return 0;
+
+    vnode_t* vn = g_files[fd].vn;
+    if (!vn->ops->map) return 0;
+    return vn->ops->map(vn, off, len);
+}
+
+static int map_fault(void* ctx, uint32_t addr, uint32_t err) {
+    vfs_mapping_t* m = (vfs_mapping_t*)ctx;
+    if (err & 0x2) return -1; // write to a read-only mapping
+    if (err & VMM_FAULT_NOSLEEP) return -1; // would sleep and do I/O with IRQs off
+
+    mutex_lock(&g_lock);
+    uint32_t page = (addr - m->base) / VMM_PAGE_SIZE;
+    uint8_t* data = pcache_get(m->vn, m->first_index + page, 1);
+    int rc = data ? 0 : -1;
+    if (data && vmm_map_page(addr, (uint32_t)data, VMM_PRESENT) < 0) {
+        pcache_unpin(m->vn, m->first_index + page, data);
+        rc = -1;
+    }
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+static void* mmap_locked(int fd, uint32_t off, uint32_t len) {
+    if (!fd_valid(fd) || len == 0 || (off % VMM_PAGE_SIZE) != 0) return 0;
+
+    vfs_mapping_t* m = 0;
+    for (int i = 0; i < VFS_MAX_MAPS; i++) {
+        if (!g_maps[i].used) {
+            m = &g_maps[i];
+            break;
+        }
+    }
+    if (!m) return 0;
+
+    uint32_t pages = (len + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    uint32_t base = vmm_alloc_window(pages, map_fault, m);
+    if (!base) return 0;
+
+    m->used = 1;
+    m->vn = g_files[fd].vn;
+    m->base = base;
+    m->pages = pages;
+    m->first_index = off / VMM_PAGE_SIZE;
+    vfs_ref(m->vn);
+    return (void*)base;
+}
+
+static int munmap_locked(void* addr) {
+    for (int i = 0; i < VFS_MAX_MAPS; i++) {
+        vfs_mapping_t* m = &g_maps[i];
+        if (!m->used || m->base != (uint32_t)addr) continue;
+
+        for (uint32_t p = 0; p < m->pages; p++) {
+            uint32_t va = m->base + p * VMM_PAGE_SIZE;
+            uint32_t data = vmm_translate(va);
+            if (!data) continue;
+            vmm_unmap_page(va);
+            pcache_unpin(m->vn, m->first_index + p, (const void*)data);
+        }
+        vmm_free_window(m->base);
+        vfs_release(m->vn);
+        m->used = 0;
+        return 0;
+    }
+    return -1;
+}
+
+static int close_locked(int fd) {
+    if (!fd_valid(fd)) return -1;
+
+    vfs_file_t* f = &g_files[fd];
+    f->used = 0;
+    vfs_release(f->vn);
+    f->vn = 0;
+    return 0;
+}
+
+static int stat_locked(const char* path, vfs_stat_t* st) {
+    if (!path || !st) return -1;
+
+    char norm[VFS_PATH_MAX];
+    if (normalize(path, norm) < 0) return -1;
+
+    vnode_t* vn = 0;
+    if (walk(norm, &vn) < 0) return -1;
+    fill_stat(vn, st);
+    vfs_release(vn);
+    return 0;
+}
+
+static int unlink_locked(const char* path) {
+    if (!path) return -1;
+
+    vnode_t* dir = 0;
+    char leaf[VFS_NAME_MAX + 1];
+    if (walk_parent(path, &dir, leaf) < 0) return -1;
+
+    // Remember who the file was: its ino may be reused once it is gone.
+    uint32_t mount_id = 0;
+    uint32_t ino = 0;
+    vnode_t* vn = 0;
+    if (dir->ops->lookup && dir->ops->lookup(dir, leaf, &vn) == 0) {
+        mount_id = vn->mnt ? vn->mnt->id : 0;
+        ino = vn->ino;
+        vfs_release(vn);
+    }
+
+    int rc = dir->ops->unlink ? dir->ops->unlink(dir, leaf) : -1;
+    vfs_release(dir);
+    if (rc == 0) {
+        pcache_drop(mount_id, ino);
+        notify_change(mount_id, ino);
+    }
+    return rc;
+}
+
+static int mkdir_locked(const char* path) {
+    if (!path) return -1;
+
+    vnode_t* dir = 0;
+    char leaf[VFS_NAME_MAX + 1];
+    if (walk_parent(path, &dir, leaf) < 0) return -1;
+
+    vnode_t* existing = 0;
+    int rc = -1;
+    if (dir->ops->lookup && dir->ops->lookup(dir, leaf, &existing) == 0) {
+        vfs_release(existing);
+    } else if (dir->ops->mkdir) {
+        rc = dir->ops->mkdir(dir, leaf);
+    }
+    vfs_release(dir);
+    return rc;
+}
+
+// Lists a directory, followed by any mount points directly below it.
+static int readdir_locked(const char* path, vfs_filldir_t fn, void* ctx) {
+    if (!path || !fn) return -1;
+
+    char norm[VFS_PATH_MAX];
+    if (normalize(path, norm) < 0) return -1;
+
+    vnode_t* dir = 0;
+    if (walk(norm, &dir) < 0) return -1;
+    if (dir->type != VFS_DIR || !dir->ops->readdir) {
+        vfs_release(dir);
+        return -1;
+    }
+
+    int rc = dir->ops->readdir(dir, fn, ctx);
+    vfs_release(dir);
+    if (rc < 0) return rc;
+
+    uint32_t n = str_len(norm);
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mount_t* m = &g_mounts[i];
+        if (!m->used || str_len(m->path) <= 1) continue;
+
+        uint32_t prefix = (n == 1) ? 0 : n;
+        if (!str_eq_n(m->path, norm, prefix) || m->path[prefix] != '/') continue;
+
+        const char* name = m->path + prefix + 1;
+        int nested = 0;
+        for (const char* c = name; *c; c++) {
+            if (*c == '/') nested = 1;
+        }
+        if (nested) continue;
+        if (fn(ctx, name, VFS_DIR, 0)) break;
+    }
+
+    return 0;
+}
+
+static int sync_locked(void) {
+    int rc = 0;
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mount_t* m = &g_mounts[i];
+        if (m->used && m->sync && m->sync() < 0) rc = -1;
+    }
+    return rc;
+}
+
+void vfs_lock(void) {
+    mutex_lock(&g_lock);
+}
+
+void vfs_unlock(void) {
+    mutex_unlock(&g_lock);
+}
+
+int vfs_open(const char* path, int flags) {
+    mutex_lock(&g_lock);
+    int rc = open_locked(path, flags);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+int vfs_read(int fd, void* buf, uint32_t n) {
+    mutex_lock(&g_lock);
+    int rc = read_locked(fd, buf, n);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+int vfs_pread(int fd, void* buf, uint32_t n, uint32_t off) {
+    mutex_lock(&g_lock);
+    int rc = pread_locked(fd, buf, n, off);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+int vfs_write(int fd, const void* buf, uint32_t n) {
+    mutex_lock(&g_lock);
+    int rc = write_locked(fd, buf, n);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+int vfs_seek(int fd, int32_t off, int whence) {
+    mutex_lock(&g_lock);
+    int rc = seek_locked(fd, off, whence);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+int vfs_truncate(int fd, uint32_t len) {
+    mutex_lock(&g_lock);
+    int rc = truncate_locked(fd, len);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+int vfs_fstat(int fd, vfs_stat_t* st) {
+    mutex_lock(&g_lock);
+    int rc = fstat_locked(fd, st);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+const void* vfs_map(int fd, uint32_t off, uint32_t len) {
+    mutex_lock(&g_lock);
+    const void* p = map_locked(fd, off, len);
+    mutex_unlock(&g_lock);
+    return p;
+}
+
+void* vfs_mmap(int fd, uint32_t off, uint32_t len) {
+    mutex_lock(&g_lock);
+    void* p = mmap_locked(fd, off, len);
+    mutex_unlock(&g_lock);
+    return p;
+}
+
+int vfs_munmap(void* addr) {
+    mutex_lock(&g_lock);
+    int rc = munmap_locked(addr);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+int vfs_close(int fd) {
+    mutex_lock(&g_lock);
+    int rc = close_locked(fd);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+int vfs_stat(const char* path, vfs_stat_t* st) {
+    mutex_lock(&g_lock);
+    int rc = stat_locked(path, st);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+int vfs_unlink(const char* path) {
+    mutex_lock(&g_lock);
+    int rc = unlink_locked(path);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+int vfs_mkdir(const char* path) {
+    mutex_lock(&g_lock);
+    int rc = mkdir_locked(path);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+int vfs_readdir(const char* path, vfs_filldir_t fn, void* ctx) {
+    mutex_lock(&g_lock);
+    int rc = readdir_locked(path, fn, ctx);
+    mutex_unlock(&g_lock);
+    return rc;
+}
+
+int vfs_sync(void) {
+    mutex_lock(&g_lock);
+    int rc = sync_locked();
+    mutex_unlock(&g_lock);
+    return rc;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <stdint.h>
+
+#define VFS_MAX_OPEN   16
+#define VFS_MAX_MOUNTS 8
+#define VFS_NAME_MAX   31
+#define VFS_PATH_MAX   128
+
+#define VFS_O_READ   0x01
+#define VFS_O_WRITE  0x02
+#define VFS_O_CREATE 0x04
+#define VFS_O_TRUNC  0x08
+#define VFS_O_APPEND 0x10
+#define VFS_O_DIRECT 0x20   // reads bypass the page cache
+
+#define VFS_SEEK_SET 0
+#define VFS_SEEK_CUR 1
+#define VFS_SEEK_END 2
+
+#define VFS_FILE 1
+#define VFS_DIR  2
+
+#define VFS_MAX_MAPS 16
+#define VFS_MAX_WATCHERS 4
+
+// vnode_ops_t.flags
+#define VFS_OPS_PAGE_CACHE 0x1   // reads are served through the page cache
+
+typedef struct vnode vnode_t;
+typedef struct vfs_mount vfs_mount_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint32_t ino;
+    uint32_t mtime;
+    uint32_t mount_id;
+} vfs_stat_t;
+
+// Return nonzero to stop the directory walk.
+typedef int (*vfs_filldir_t)(void* ctx, const char* name, uint32_t type, uint32_t size);
+
+typedef struct {
+    uint32_t flags;
+    int (*lookup)(vnode_t* dir, const char* name, vnode_t** out);
+    int (*create)(vnode_t* dir, const char* name, vnode_t** out);
+    int (*mkdir)(vnode_t* dir, const char* name);
+    int (*unlink)(vnode_t* dir, const char* name);
+    int (*readdir)(vnode_t* dir, vfs_filldir_t fn, void* ctx);
+    int (*read)(vnode_t* vn, uint32_t off, void* buf, uint32_t n);
+    int (*write)(vnode_t* vn, uint32_t off, const void* buf, uint32_t n);
+    int (*truncate)(vnode_t* vn, uint32_t len);
+    // Optional: direct pointer to [off, off + len), or 0 if not addressable.
+    const void* (*map)(vnode_t* vn, uint32_t off, uint32_t len);
+    void (*release)(vnode_t* vn);
+} vnode_ops_t;
+
+// Backends embed a vnode as the first member of their node structure.
+// ino identifies the file within its mount; mtime is the backend's own
+// modification stamp and is only comparable within one mount.
+struct vnode {
+    const vnode_ops_t* ops;
+    vfs_mount_t* mnt;
+    uint32_t type;
+    uint32_t size;
+    uint32_t ino;
+    uint32_t mtime;
+    uint32_t refs;
+};
+
+struct vfs_mount {
+    int used;
+    uint32_t id;
+    char path[VFS_PATH_MAX];
+    const char* fs_name;
+    vnode_t* root;
+    int (*sync)(void);
+};
+
+void vfs_init(void);
+int vfs_mount(const char* path, const char* fs_name, vnode_t* root, int (*sync)(void));
+void vfs_list_mounts(void);
+
+// Called after a file's contents change or it is removed. Lets caches
+// keyed by (mount_id, ino) drop stale entries even when mtime does not move.
+typedef void (*vfs_change_fn)(uint32_t mount_id, uint32_t ino);
+int vfs_watch(vfs_change_fn fn);
+
+void vfs_ref(vnode_t* vn);
+void vfs_release(vnode_t* vn);
+
+int vfs_open(const char* path, int flags);
+int vfs_read(int fd, void* buf, uint32_t n);
+int vfs_pread(int fd, void* buf, uint32_t n, uint32_t off);
+int vfs_write(int fd, const void* buf, uint32_t n);
+int vfs_seek(int fd, int32_t off, int whence);
+int vfs_truncate(int fd, uint32_t len);
+int vfs_fstat(int fd, vfs_stat_t* st);
+const void* vfs_map(int fd, uint32_t off, uint32_t len);
+int vfs_close(int fd);
+
+// Read-only mapping of [off, off + len) of an open file; off must be page
+// aligned. Pages are filled from the page cache on first touch, which takes
+// the VFS mutex and may read the disk, so the window may only be touched
+// with interrupts on and no spinlock held (such faults are refused). Unmap
+// invalidates only this CPU's TLB: touch the window on the mapping CPU alone
+// and copy out anything other CPUs need.
+void* vfs_mmap(int fd, uint32_t off, uint32_t len);
+int vfs_munmap(void* addr);
+
+int vfs_stat(const char* path, vfs_stat_t* st);
+int vfs_unlink(const char* path);
+int vfs_mkdir(const char* path);
+int vfs_readdir(const char* path, vfs_filldir_t fn, void* ctx);
+int vfs_sync(void);
+
+// For work below the VFS (e.g. block cache write-back) done outside it.
+void vfs_lock(void);
+void vfs_unlock(void);
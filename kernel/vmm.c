@@ -0,0 +1,359 @@
+#include <stdint.h>
+#include "vmm.h"
+#include "pmm.h"
+#include "mb2.h"
+#include "console.h"
+
+#define VMM_IDENTITY_LIMIT (128 * 1024 * 1024)
+#define VMM_MAX_REGIONS    32
+
+#define PF_PRESENT 0x1
+#define PF_USER    0x4
+
+#define PDE_USER_FIRST (VMM_USER_BASE >> 22)
+#define PDE_USER_LAST  ((VMM_USER_TOP >> 22) - 1)
+
+// Physical memory below VMM_IDENTITY_LIMIT (everything the PMM hands out)
+// and any boot modules stay identity-mapped, so existing kernel pointers
+// keep working once paging is on. Page tables come from the PMM and are
+// therefore reachable at their physical address.
+typedef struct {
+    int used;
+    uint32_t base;
+    uint32_t pages;
+    vmm_fault_fn fault;
+    void* ctx;
+} vmm_region_t;
+
+static uint32_t* g_pd = 0;
+static int g_enabled = 0;
+static uint32_t g_window_used[VMM_WINDOW_PAGES / 32];
+static vmm_region_t g_regions[VMM_MAX_REGIONS];
+
+static uint32_t g_stat_faults = 0;
+static uint32_t g_stat_tables = 0;
+static uint32_t g_stat_spaces = 0;
+
+static void print_u32(uint32_t v) {
+    char buf[16];
+    int i = 0;
+    if (v == 0) {
+        console_putc('0');
+        return;
+    }
+    while (v && i < (int)sizeof(buf)) {
+        buf[i++] = '0' + (v % 10);
+        v /= 10;
+    }
+    while (i--) console_putc(buf[i]);
+}
+
+static void print_hex32(uint32_t v) {
+    const char* hex = "0123456789ABCDEF";
+    console_puts("0x");
+    for (int i = 7; i >= 0; i--) console_putc(hex[(v >> (i * 4)) & 0xF]);
+}
+
+static void zero_page(uint32_t addr) {
+    uint32_t* p = (uint32_t*)addr;
+    for (int i = 0; i < 1024; i++) p[i] = 0;
+}
+
+static inline void invlpg(uint32_t virt) {
+    __asm__ __volatile__("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+// Each CPU has its own CR3, so the loaded space is read back, not tracked.
+static inline uint32_t* current_pd(void) {
+    uint32_t cr3;
+    __asm__ __volatile__("mov %%cr3, %0" : "=r"(cr3));
+    return (uint32_t*)(cr3 & ~0xFFFu);
+}
+
+static uint32_t* table_in(uint32_t* pd, uint32_t virt, int create, uint32_t flags) {
+    uint32_t* pde = &pd[virt >> 22];
+    if (!(*pde & VMM_PRESENT)) {
+        if (!create) return 0;
+        uint32_t table = pmm_alloc_page();
+        if (!table) return 0;
+        zero_page(table);
+        *pde = table | VMM_PRESENT | VMM_WRITE | (flags & VMM_USER);
+        g_stat_tables++;
+    } else if (flags & VMM_USER) {
+        *pde |= VMM_USER;
+    }
+    return (uint32_t*)(*pde & ~0xFFFu);
+}
+
+static uint32_t* table_for(uint32_t virt, int create, uint32_t flags) {
+    return table_in(g_pd, virt, create, flags);
+}
+
+int vmm_map_page(uint32_t virt, uint32_t phys, uint32_t flags) {
+    uint32_t* table = table_for(virt, 1, flags);
+    if (!table) return -1;
+
+    table[(virt >> 12) & 0x3FF] = (phys & ~0xFFFu) | (flags & 0xFFFu) | VMM_PRESENT;
+    if (g_enabled) invlpg(virt);
+    return 0;
+}
+
+void vmm_unmap_page(uint32_t virt) {
+    uint32_t* table = table_for(virt, 0, 0);
+    if (!table) return;
+
+    table[(virt >> 12) & 0x3FF] = 0;
+    if (g_enabled) invlpg(virt);
+}
+
+// Returns the physical address backing `virt`, or 0 if it is not mapped.
+uint32_t vmm_translate(uint32_t virt) {
+    uint32_t* table = table_for(virt, 0, 0);
+    if (!table) return 0;
+
+    uint32_t pte = table[(virt >> 12) & 0x3FF];
+    if (!(pte & VMM_PRESENT)) return 0;
+    return (pte & ~0xFFFu) | (virt & 0xFFFu);
+}
+
+static int identity_map(uint32_t start, uint32_t end) {
+    for (uint32_t a = start & ~0xFFFu; a < end && a >= (start & ~0xFFFu); a += VMM_PAGE_SIZE) {
+        if (vmm_map_page(a, a, VMM_WRITE) < 0) return -1;
+    }
+    return 0;
+}
+
+void vmm_init(uint32_t mb2_info_addr) {
+    for (uint32_t i = 0; i < VMM_WINDOW_PAGES / 32; i++) g_window_used[i] = 0;
+    for (int i = 0; i < VMM_MAX_REGIONS; i++) g_regions[i].used = 0;
+
+    uint32_t pd = pmm_alloc_page();
+    if (!pd) {
+        console_puts("[vmm] no page for the page directory, paging off\n");
+        return;
+    }
+    zero_page(pd);
+    g_pd = (uint32_t*)pd;
+
+    int rc = identity_map(0, VMM_IDENTITY_LIMIT);
+    for (const mb2_module_tag_t* m = mb2_next_module(mb2_info_addr, 0); m && rc == 0; m = mb2_next_module(mb2_info_addr, m)) {
+        if (m->mod_end > m->mod_start) rc = identity_map(m->mod_start, m->mod_end);
+    }
+    // The console draws to the framebuffer from before paging is enabled.
+    const mb2_framebuffer_tag_t* fb = mb2_find_framebuffer(mb2_info_addr);
+    if (fb && rc == 0) rc = identity_map((uint32_t)fb->addr, (uint32_t)fb->addr + fb->pitch * fb->height);
+    // Window tables exist up front: address spaces copy the kernel's page
+    // directory entries once, so none may appear later.
+    for (uint32_t a = VMM_WINDOW_BASE; rc == 0 && a - VMM_WINDOW_BASE < VMM_WINDOW_PAGES * VMM_PAGE_SIZE; a += 1024 * VMM_PAGE_SIZE) {
+        if (!table_for(a, 1, 0)) rc = -1;
+    }
+    if (rc < 0) {
+        console_puts("[vmm] out of page tables, paging off\n");
+        return;
+    }
+
+    // CR0.WP makes read-only mappings binding for ring 0 as well.
+    uint32_t cr0;
+    __asm__ __volatile__("mov %0, %%cr3" : : "r"(pd) : "memory");
+    __asm__ __volatile__("mov %%cr0, %0" : "=r"(cr0));
+    cr0 |= 0x80010000u;
+    __asm__ __volatile__("mov %0, %%cr0" : : "r"(cr0) : "memory");
+    g_enabled = 1;
+
+    console_puts("[vmm] paging on, identity ");
+    print_u32(VMM_IDENTITY_LIMIT >> 20);
+    console_puts(" MB, tables=");
+    print_u32(g_stat_tables);
+    console_putc('\n');
+}
+
+// Identity-maps device registers uncached. Must run before the first
+// address space is created, like every other new kernel page table.
+int vmm_map_mmio(uint32_t phys, uint32_t bytes) {
+    if (!g_enabled) return 0;
+    for (uint32_t a = phys & ~0xFFFu; a < phys + bytes; a += VMM_PAGE_SIZE) {
+        if (vmm_map_page(a, a, VMM_WRITE | VMM_NOCACHE) < 0) return -1;
+    }
+    return 0;
+}
+
+// Page directory holding only kernel mappings, for CPUs without a process.
+uint32_t vmm_kernel_space(void) {
+    return (uint32_t)g_pd;
+}
+
+// A new address space: the kernel's page directory with an empty user range.
+uint32_t vmm_space_create(void) {
+    if (!g_enabled) return 0;
+
+    uint32_t pd = pmm_alloc_page();
+    if (!pd) return 0;
+
+    uint32_t* dir = (uint32_t*)pd;
+    for (uint32_t i = 0; i < 1024; i++) {
+        dir[i] = (i >= PDE_USER_FIRST && i <= PDE_USER_LAST) ? 0 : g_pd[i];
+    }
+    g_stat_spaces++;
+    return pd;
+}
+
+// Frees the space's user page tables and directory; the pages they mapped
+// belong to the caller.
+void vmm_space_destroy(uint32_t space) {
+    if (!space || space == (uint32_t)g_pd) return;
+    if (space == (uint32_t)current_pd()) vmm_space_switch(0);
+
+    uint32_t* dir = (uint32_t*)space;
+    for (uint32_t i = PDE_USER_FIRST; i <= PDE_USER_LAST; i++) {
+        if (dir[i] & VMM_PRESENT) {
+            pmm_free_page(dir[i] & ~0xFFFu);
+            g_stat_tables--;
+        }
+    }
+    pmm_free_page(space);
+    g_stat_spaces--;
+}
+
+int vmm_space_map(uint32_t space, uint32_t virt, uint32_t phys, uint32_t flags) {
+    if (!space || virt < VMM_USER_BASE || virt >= VMM_USER_TOP) return -1;
+
+    uint32_t* table = table_in((uint32_t*)space, virt, 1, flags);
+    if (!table) return -1;
+
+    table[(virt >> 12) & 0x3FF] = (phys & ~0xFFFu) | (flags & 0xFFFu) | VMM_PRESENT;
+    if (space == (uint32_t)current_pd()) invlpg(virt);
+    return 0;
+}
+
+// Loads `space` into CR3; 0 selects the kernel's own page directory.
+void vmm_space_switch(uint32_t space) {
+    if (!g_enabled) return;
+
+    uint32_t* pd = space ? (uint32_t*)space : g_pd;
+    if (pd == current_pd()) return;
+    __asm__ __volatile__("mov %0, %%cr3" : : "r"(pd) : "memory");
+}
+
+// Checks that ring 3 may access [addr, addr + len) in the loaded space.
+int vmm_check_user(uint32_t addr, uint32_t len, int write) {
+    if (!g_enabled) return -1;
+    if (len == 0) return 0;
+    if (addr < VMM_USER_BASE || addr > VMM_USER_TOP || len > VMM_USER_TOP - addr) return -1;
+
+    uint32_t need = VMM_PRESENT | VMM_USER | (write ? VMM_WRITE : 0);
+    uint32_t* pd = current_pd();
+    for (uint32_t a = addr & ~0xFFFu; a < addr + len; a += VMM_PAGE_SIZE) {
+        uint32_t* table = table_in(pd, a, 0, 0);
+        if (!table || (table[(a >> 12) & 0x3FF] & need) != need) return -1;
+    }
+    return 0;
+}
+
+// Physical address behind `addr` in `space` if ring 3 may access it (for
+// writing when `write` is set), else 0. Lets code running in another space
+// reach a process's memory through the identity map.
+uint32_t vmm_space_user_phys(uint32_t space, uint32_t addr, int write) {
+    if (!space || addr < VMM_USER_BASE || addr >= VMM_USER_TOP) return 0;
+
+    uint32_t need = VMM_PRESENT | VMM_USER | (write ? VMM_WRITE : 0);
+    uint32_t* table = table_in((uint32_t*)space, addr, 0, 0);
+    if (!table) return 0;
+    uint32_t pte = table[(addr >> 12) & 0x3FF];
+    if ((pte & need) != need) return 0;
+    return (pte & ~0xFFFu) | (addr & 0xFFFu);
+}
+
+static int window_test(uint32_t i) { return (g_window_used[i >> 5] >> (i & 31)) & 1u; }
+
+static void window_mark(uint32_t first, uint32_t pages, int used) {
+    for (uint32_t i = first; i < first + pages; i++) {
+        if (used) g_window_used[i >> 5] |= (1u << (i & 31));
+        else g_window_used[i >> 5] &= ~(1u << (i & 31));
+    }
+}
+
+// Reserves `pages` of unmapped window space; faults inside it go to `fault`.
+uint32_t vmm_alloc_window(uint32_t pages, vmm_fault_fn fault, void* ctx) {
+    if (!g_enabled || pages == 0 || pages > VMM_WINDOW_PAGES || !fault) return 0;
+
+    vmm_region_t* r = 0;
+    for (int i = 0; i < VMM_MAX_REGIONS; i++) {
+        if (!g_regions[i].used) {
+            r = &g_regions[i];
+            break;
+        }
+    }
+    if (!r) return 0;
+
+    uint32_t run = 0;
+    for (uint32_t i = 0; i < VMM_WINDOW_PAGES; i++) {
+        if (window_test(i)) {
+            run = 0;
+            continue;
+        }
+        if (++run < pages) continue;
+
+        uint32_t first = i + 1 - pages;
+        window_mark(first, pages, 1);
+        r->used = 1;
+        r->base = VMM_WINDOW_BASE + first * VMM_PAGE_SIZE;
+        r->pages = pages;
+        r->fault = fault;
+        r->ctx = ctx;
+        return r->base;
+    }
+    return 0;
+}
+
+// The caller must already have unmapped (and released) every page it mapped.
+void vmm_free_window(uint32_t base) {
+    for (int i = 0; i < VMM_MAX_REGIONS; i++) {
+        vmm_region_t* r = &g_regions[i];
+        if (!r->used || r->base != base) continue;
+
+        window_mark((base - VMM_WINDOW_BASE) / VMM_PAGE_SIZE, r->pages, 0);
+        r->used = 0;
+        return;
+    }
+}
+
+// Exception context (interrupts off). Only not-present faults from ring 0
+// inside a window region are resolvable; everything else is a real fault.
+int vmm_handle_fault(uint32_t addr, uint32_t err) {
+    if (!g_enabled || (err & (PF_PRESENT | PF_USER))) return -1;
+
+    for (int i = 0; i < VMM_MAX_REGIONS; i++) {
+        vmm_region_t* r = &g_regions[i];
+        if (!r->used || addr < r->base || addr - r->base >= r->pages * VMM_PAGE_SIZE) continue;
+
+        g_stat_faults++;
+        return r->fault(r->ctx, addr & ~0xFFFu, err);
+    }
+    return -1;
+}
+
+void vmm_dump(void) {
+    uint32_t regions = 0;
+    uint32_t pages = 0;
+    for (int i = 0; i < VMM_MAX_REGIONS; i++) {
+        if (!g_regions[i].used) continue;
+        regions++;
+        pages += g_regions[i].pages;
+    }
+
+    console_puts("[vmm] paging=");
+    console_puts(g_enabled ? "on" : "off");
+    console_puts(" pd=");
+    print_hex32((uint32_t)g_pd);
+    console_puts(" tables=");
+    print_u32(g_stat_tables);
+    console_puts(" spaces=");
+    print_u32(g_stat_spaces);
+    console_puts(" regions=");
+    print_u32(regions);
+    console_puts(" window_pages=");
+    print_u32(pages);
+    console_puts(" faults=");
+    print_u32(g_stat_faults);
+    console_putc('\n');
+}
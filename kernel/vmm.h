@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+
+#define VMM_PAGE_SIZE 4096
+
+#define VMM_PRESENT 0x001
+#define VMM_WRITE   0x002
+#define VMM_USER    0x004
+#define VMM_NOCACHE 0x010
+
+// Kernel-only window handed out by vmm_alloc_window() for file mappings.
+#define VMM_WINDOW_BASE  0xD0000000u
+#define VMM_WINDOW_PAGES 16384u
+
+// Per-process range. Every address space shares all page tables outside it,
+// so kernel mappings look the same whichever space is loaded.
+#define VMM_USER_BASE 0x40000000u
+#define VMM_USER_TOP  0x80000000u
+
+// Called with the page-aligned faulting address and the page-fault error
+// code for a fault inside the caller's window; returns 0 once it is mapped.
+// VMM_FAULT_NOSLEEP is or-ed into the code when the faulting code ran with
+// interrupts off: the handler must not block.
+#define VMM_FAULT_NOSLEEP 0x80000000u
+typedef int (*vmm_fault_fn)(void* ctx, uint32_t addr, uint32_t err);
+
+void vmm_init(uint32_t mb2_info_addr);
+int vmm_map_page(uint32_t virt, uint32_t phys, uint32_t flags);
+void vmm_unmap_page(uint32_t virt);
+uint32_t vmm_translate(uint32_t virt);
+
+int vmm_map_mmio(uint32_t phys, uint32_t bytes);
+uint32_t vmm_kernel_space(void);
+
+uint32_t vmm_space_create(void);
+void vmm_space_destroy(uint32_t space);
+int vmm_space_map(uint32_t space, uint32_t virt, uint32_t phys, uint32_t flags);
+void vmm_space_switch(uint32_t space);
+int vmm_check_user(uint32_t addr, uint32_t len, int write);
+uint32_t vmm_space_user_phys(uint32_t space, uint32_t addr, int write);
+
+uint32_t vmm_alloc_window(uint32_t pages, vmm_fault_fn fault, void* ctx);
+void vmm_free_window(uint32_t base);
+
+int vmm_handle_fault(uint32_t addr, uint32_t err);
+void vmm_dump(void);
@@ -0,0 +1,118 @@
+#include <stdint.h>
+#include "wait.h"
+#include "proc.h"
+#include "pit.h"
+
+// The condition is checked and the task queued under the queue's lock, and
+// a waker takes the same lock after making the condition true, so a wakeup
+// cannot fall between the check and the sleep. Idle tasks (a CPU's boot
+// context, which is also the shell on the BSP) must stay runnable: they
+// halt until the next interrupt and check again instead of blocking.
+
+void wait_init(wait_queue_t* q) {
+    q->lock = (spinlock_t)SPINLOCK_INIT;
+    q->head = 0;
+}
+
+// q->lock held.
+static void unlink(wait_queue_t* q, proc_t* p) {
+    for (proc_t** pp = &q->head; *pp; pp = &(*pp)->wait_next) {
+        if (*pp == p) {
+            *pp = p->wait_next;
+            break;
+        }
+    }
+    p->wait_next = 0;
+}
+
+// Blocks until cond(arg) holds (0) or `timeout_ticks` PIT ticks have passed
+// (-1); WAIT_FOREVER never times out. A null cond never holds, which makes
+// this a plain sleep. Deadlines are compared as signed tick differences, so
+// timeouts beyond WAIT_MAX_TICKS are clamped to it.
+int wait_event(wait_queue_t* q, wait_cond_fn cond, void* arg, uint32_t timeout_ticks) {
+    proc_t* p = proc_current();
+    if (timeout_ticks > WAIT_MAX_TICKS) timeout_ticks = WAIT_MAX_TICKS;
+    uint32_t deadline = pit_get_ticks() + timeout_ticks;
+
+    for (;;) {
+        uint32_t flags = spin_lock_irqsave(&q->lock);
+        if (cond && cond(arg)) {
+            spin_unlock_irqrestore(&q->lock, flags);
+            return 0;
+        }
+        if (timeout_ticks != WAIT_FOREVER && (int32_t)(pit_get_ticks() - deadline) >= 0) {
+            spin_unlock_irqrestore(&q->lock, flags);
+            return -1;
+        }
+
+        if (!p || p->idle) {
+            spin_unlock_irqrestore(&q->lock, flags);
+            if (p) {
+                proc_idle();
+            } else {
+                __asm__ __volatile__("sti; hlt; cli" : : : "memory");
+                if (flags & 0x200) __asm__ __volatile__("sti");
+            }
+            continue;
+        }
+
+        p->wait_next = q->head;
+        q->head = p;
+        proc_block(timeout_ticks != WAIT_FOREVER, deadline);
+        spin_unlock(&q->lock);
+        proc_yield();
+
+        spin_lock(&q->lock);
+        unlink(q, p);
+        spin_unlock_irqrestore(&q->lock, flags);
+    }
+}
+
+// Wakes every task waiting on `q`.
+void wait_wake(wait_queue_t* q) {
+    uint32_t flags = spin_lock_irqsave(&q->lock);
+    proc_t* p = q->head;
+    q->head = 0;
+    while (p) {
+        proc_t* next = p->wait_next;
+        p->wait_next = 0;
+        proc_wake(p);
+        p = next;
+    }
+    spin_unlock_irqrestore(&q->lock, flags);
+}
+
+void mutex_init(mutex_t* m) {
+    wait_init(&m->q);
+    m->owner = 0;
+    m->depth = 0;
+}
+
+// m->q.lock held.
+static int mutex_take(void* arg) {
+    mutex_t* m = (mutex_t*)arg;
+    if (m->owner) return 0;
+    m->owner = proc_current();
+    return 1;
+}
+
+// Before the scheduler exists there is only one context: nothing to lock.
+void mutex_lock(mutex_t* m) {
+    proc_t* p = proc_current();
+    if (!p) return;
+    if (m->owner == p) {
+        m->depth++;
+        return;
+    }
+    wait_event(&m->q, mutex_take, m, WAIT_FOREVER);
+    m->depth = 1;
+}
+
+void mutex_unlock(mutex_t* m) {
+    if (!proc_current() || --m->depth) return;
+
+    uint32_t flags = spin_lock_irqsave(&m->q.lock);
+    m->owner = 0;
+    spin_unlock_irqrestore(&m->q.lock, flags);
+    wait_wake(&m->q);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+#include "spinlock.h"
+
+struct proc;
+
+// Tasks blocked until some event. Whoever makes the event happen (often an
+// IRQ handler) calls wait_wake(); waiters re-check their condition.
+typedef struct {
+    spinlock_t lock;
+    struct proc* head;    // linked through proc->wait_next
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { SPINLOCK_INIT, 0 }
+#define WAIT_FOREVER    0
+#define WAIT_MAX_TICKS  0x7FFFFFFFu   // longer timeouts are clamped
+
+typedef int (*wait_cond_fn)(void* arg);
+
+// Sleeping lock, recursive for its owner. May be held across blocking
+// work such as disk I/O; never taken in interrupt handlers.
+typedef struct {
+    wait_queue_t q;
+    struct proc* owner;
+    uint32_t depth;
+} mutex_t;
+
+#define MUTEX_INIT { WAIT_QUEUE_INIT, 0, 0 }
+
+void wait_init(wait_queue_t* q);
+int wait_event(wait_queue_t* q, wait_cond_fn cond, void* arg, uint32_t timeout_ticks);
+void wait_wake(wait_queue_t* q);
+
+void mutex_init(mutex_t* m);
+void mutex_lock(mutex_t* m);
+void mutex_unlock(mutex_t* m);
@@ -1,17 +1,19 @@
 #!/usr/bin/env bash
 set -euo pipefail
 
-if [ "$#" -ne 1 ]; then
-  echo "usage: $0 <output-elf>" >&2
+if [ "$#" -lt 1 ] || [ "$#" -gt 2 ]; then
+  echo "usage: $0 <output-elf> [source.asm]" >&2
   exit 1
 fi
 
 out="$1"
 root_dir="$(cd "$(dirname "$0")/.." && pwd)"
+src="${2:-$root_dir/disk/HELLO_ELF.asm}"
 tmp_o="$(mktemp /tmp/hello-elf-XXXXXX.o)"
 trap 'rm -f "$tmp_o"' EXIT
 
-nasm -f elf32 "$root_dir/disk/HELLO_ELF.asm" -o "$tmp_o"
-ld -m elf_i386 -nostdlib -e _start -Ttext 0 -o "$out" "$tmp_o"
+nasm -f elf32 -I "$(dirname "$src")/" "$src" -o "$tmp_o"
+# Position-independent: the loader applies PT_DYNAMIC relocations.
+ld -m elf_i386 -nostdlib -pie --no-dynamic-linker -z notext -e _start -o "$out" "$tmp_o"
 
-echo "[disk] built ELF sample: $out"
+echo "[disk] built ELF: $out"
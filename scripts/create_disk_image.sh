@@ -9,17 +9,40 @@ fi
 img="$1"
 root_dir="$(cd "$(dirname "$0")/.." && pwd)"
 tmp_elf="$(mktemp /tmp/myos-hello-elf-XXXXXX.elf)"
-trap 'rm -f "$tmp_elf"' EXIT
+tmp_bench="$(mktemp /tmp/myos-sysbench-XXXXXX.elf)"
+trap 'rm -f "$tmp_elf" "$tmp_bench"' EXIT
 
-rm -f "$img"
-dd if=/dev/zero of="$img" bs=1024 count=1440 status=none
+# DISK_FAT selects the volume layout: 12 (1.44 MB floppy), 16 or 32.
+fat="${DISK_FAT:-12}"
 
-mformat -i "$img" -f 1440 ::
+rm -f "$img"
+case "$fat" in
+  12)
+    dd if=/dev/zero of="$img" bs=1024 count=1440 status=none
+    mformat -i "$img" -f 1440 ::
+    ;;
+  16)
+    dd if=/dev/zero of="$img" bs=1M count=32 status=none
+    mformat -i "$img" -t 32 -h 64 -s 32 ::
+    ;;
+  32)
+    dd if=/dev/zero of="$img" bs=1M count=64 status=none
+    mformat -i "$img" -F -t 64 -h 64 -s 32 ::
+    ;;
+  *)
+    echo "unsupported DISK_FAT=$fat (want 12, 16 or 32)" >&2
+    exit 1
+    ;;
+esac
 
 "$root_dir/scripts/build_hello_elf.sh" "$tmp_elf"
+"$root_dir/scripts/build_hello_elf.sh" "$tmp_bench" "$root_dir/disk/SYSBENCH.asm"
 
 mcopy -i "$img" "$root_dir/disk/HELLO.TXT" ::HELLO.TXT
 mcopy -i "$img" "$root_dir/disk/HELLO.BIN" ::HELLO.BIN
 mcopy -i "$img" "$tmp_elf" ::HELLO.ELF
+mcopy -i "$img" "$tmp_bench" ::SYSBENCH.ELF
+mmd -i "$img" ::DOCS
+mcopy -i "$img" "$root_dir/disk/HELLO.TXT" ::DOCS/HELLO.TXT
 
 echo "[disk] created $img"
@@ -7,8 +7,14 @@ for i in 1 2 3; do
   echo "[smoke] build #$i"
   make clean >/dev/null
   make >/dev/null
+  # No IDE disk: the root filesystem comes from the ISO's rootfs module.
   echo "[smoke] boot #$i (5s)"
-  timeout 5s qemu-system-i386 -cdrom myos.iso -m 256M -no-reboot -no-shutdown -display none >/dev/null 2>&1 || true
+  timeout 5s qemu-system-i386 -cdrom myos.iso -m 256M -no-reboot -no-shutdown -display none \
+    -serial file:build/serial.log >/dev/null 2>&1 || true
+  if ! grep -q '\[init\] Boot OK' build/serial.log; then
+    echo "[smoke] boot #$i: no boot log on COM1"
+    exit 1
+  fi
 done
 
 echo "[smoke] done"